@@ -0,0 +1,104 @@
+// Banc d'essai hote : requetes min / max / moyenne sur l'historique
+// (7 jours de minutes) par l'arbre de segments horaire de src/segtree.h
+// contre un parcours naif des minutes. Verifie aussi que les resultats
+// sont identiques.
+//
+//   g++ -O2 -std=c++17 -I../src segtree_bench.cpp -o segtree_bench && ./segtree_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "segtree.h"
+
+static const uint32_t HOURS   = 168;
+static const uint32_t MINUTES = HOURS * 60;
+static const int16_t  NO_DATA = INT16_MIN;
+
+// meme decoupage que historyAggregate() : bords a la minute, heures par l'arbre
+static AggNode treeQuery(const std::vector<int16_t> &minutes, const AggNode *tree,
+                         uint32_t fromMin, uint32_t toMin) {
+  AggNode acc = aggEmpty();
+  uint32_t fromH = (fromMin + 59) / 60;
+  uint32_t toH   = toMin / 60;
+
+  auto scan = [&](uint32_t a, uint32_t b) {
+    for (uint32_t m = a; m < b; m++) {
+      if (minutes[m] != NO_DATA) aggAdd(acc, minutes[m]);
+    }
+  };
+
+  if (fromH >= toH) {
+    scan(fromMin, toMin);
+  } else {
+    scan(fromMin, fromH * 60);
+    scan(toH * 60, toMin);
+    acc = aggMerge(acc, segQuery(tree, HOURS, fromH, toH));
+  }
+  return acc;
+}
+
+static AggNode naiveQuery(const std::vector<int16_t> &minutes, uint32_t fromMin, uint32_t toMin) {
+  AggNode acc = aggEmpty();
+  for (uint32_t m = fromMin; m < toMin; m++) {
+    if (minutes[m] != NO_DATA) aggAdd(acc, minutes[m]);
+  }
+  return acc;
+}
+
+static bool same(const AggNode &a, const AggNode &b) {
+  if (a.n != b.n) return false;
+  if (a.n == 0) return true;
+  return a.sum == b.sum && a.mn == b.mn && a.mx == b.mx;
+}
+
+int main() {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> val(0, 20000);
+  std::uniform_int_distribution<int> gap(0, 99);
+
+  // ~3% de minutes manquantes
+  std::vector<int16_t> minutes(MINUTES);
+  for (auto &v : minutes) v = gap(rng) < 3 ? NO_DATA : (int16_t)val(rng);
+
+  std::vector<AggNode> tree(2 * HOURS);
+  for (uint32_t h = 0; h < HOURS; h++) {
+    AggNode a = aggEmpty();
+    for (uint32_t m = h * 60; m < (h + 1) * 60; m++) {
+      if (minutes[m] != NO_DATA) aggAdd(a, minutes[m]);
+    }
+    tree[HOURS + h] = a;
+  }
+  segBuild(tree.data(), HOURS);
+
+  const uint32_t windows[] = { 60, 360, 1440, 10080 };
+  const int QUERIES = 20000;
+
+  printf("%-10s %14s %14s %8s\n", "fenetre", "naif (ns)", "arbre (ns)", "gain");
+  for (uint32_t w : windows) {
+    std::uniform_int_distribution<uint32_t> start(0, MINUTES - w);
+    std::vector<uint32_t> from(QUERIES);
+    for (auto &f : from) f = start(rng);
+
+    volatile int64_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t f : from) sink += naiveQuery(minutes, f, f + w).sum;
+    auto t1 = std::chrono::steady_clock::now();
+    for (uint32_t f : from) sink += treeQuery(minutes, tree.data(), f, f + w).sum;
+    auto t2 = std::chrono::steady_clock::now();
+
+    for (uint32_t f : from) {
+      if (!same(naiveQuery(minutes, f, f + w), treeQuery(minutes, tree.data(), f, f + w))) {
+        printf("ERREUR : resultats differents pour [%u, %u[\n", f, f + w);
+        return 1;
+      }
+    }
+
+    double naive = std::chrono::duration<double, std::nano>(t1 - t0).count() / QUERIES;
+    double fast  = std::chrono::duration<double, std::nano>(t2 - t1).count() / QUERIES;
+    printf("%-10u %14.0f %14.0f %7.1fx\n", w, naive, fast, naive / fast);
+  }
+  return 0;
+}
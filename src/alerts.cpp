@@ -0,0 +1,628 @@
+#include "alerts.h"
+
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <time.h>
+
+#include "miner.h"
+#include "analytics.h"
+#include "governor.h"
+#include "pools.h"
+#include "journal.h"
+#include "logger.h"
+
+// --- mesures DHT venant de main.cpp ---
+extern float gTempC;
+
+// =======================
+// Metriques
+// =======================
+
+enum AlertMetric : uint8_t {
+  M_THS = 0,        // TH/s, EWMA 1 min
+  M_THS15M,
+  M_THS1H,
+  M_WATTS,          // PS[] instantane
+  M_JTH,
+  M_REJ,            // % rejets
+  M_HW,             // erreurs HW / min
+  M_TEMP,           // TMax puces
+  M_TAMB,           // DHT
+  M_HOUSE,          // compteur du foyer (gouverneur)
+  M_UNREACHABLE,    // 1 si la derniere interrogation a echoue
+  M_OFFLINE_S,      // secondes depuis le dernier status
+  M_POOL_BAD,       // 1 si le pool actif est degrade
+  M_ACTIVE,         // 1 = In Work
+  M_COUNT
+};
+
+static const char *const METRIC_NAMES[M_COUNT] = {
+  "ths", "ths15m", "ths1h", "watts", "jth", "rej", "hw", "temp", "tamb",
+  "house", "unreachable", "offline_s", "pool_bad", "active"
+};
+
+static void readMetrics(float *m) {
+  AnalyticsSnapshot an = analyticsGet();
+  MinerStatus       st = minerGetStatus();
+  MinerPollState    ps = minerGetPollState();
+  uint32_t now = millis();
+
+  m[M_THS]    = an.ths1m;
+  m[M_THS15M] = an.ths15m;
+  m[M_THS1H]  = an.ths60m;
+  m[M_WATTS]  = st.power.length() > 0 ? st.power.toFloat() : NAN;
+  m[M_JTH]    = an.jth;
+  m[M_REJ]    = an.rejectPct;
+  m[M_HW]     = an.hwPerMin;
+  m[M_TEMP]   = st.tempMax;
+  m[M_TAMB]   = gTempC;
+  m[M_HOUSE]  = governorGetStats().houseW;
+  m[M_UNREACHABLE] = (ps.failures > 0 || ps.circuitOpen) ? 1.0f : 0.0f;
+  m[M_OFFLINE_S]   = (ps.lastOkMs ? now - ps.lastOkMs : now) / 1000.0f;
+  m[M_ACTIVE]      = st.isActive ? 1.0f : 0.0f;
+
+  PoolsStats pl = poolsGetStats();
+  m[M_POOL_BAD] = (pl.active >= 0 && pl.pools[pl.active].degraded) ? 1.0f : 0.0f;
+}
+
+// =======================
+// Bytecode
+// =======================
+
+enum AlertOp : uint8_t {
+  OP_END = 0,
+  OP_METRIC,        // + 1 octet : index
+  OP_CONST,         // + 4 octets : float
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG,
+  OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+  OP_AND, OP_OR, OP_NOT,
+};
+
+const uint8_t ALERT_STACK = 8;
+
+static float runCode(const uint8_t *code, const float *m) {
+  float st[ALERT_STACK];
+  uint8_t sp = 0;
+  const uint8_t *pc = code;
+
+  for (;;) {
+    uint8_t op = *pc++;
+    switch (op) {
+      case OP_END:    return sp ? st[sp - 1] : NAN;
+      case OP_METRIC: st[sp++] = m[*pc++]; break;
+      case OP_CONST:  memcpy(&st[sp++], pc, sizeof(float)); pc += sizeof(float); break;
+      case OP_NEG:    st[sp - 1] = -st[sp - 1]; break;
+      case OP_NOT:    st[sp - 1] = (st[sp - 1] != 0) ? 0.0f : 1.0f; break;
+      default: {
+        float b = st[--sp];
+        float &a = st[sp - 1];
+        switch (op) {
+          case OP_ADD: a = a + b; break;
+          case OP_SUB: a = a - b; break;
+          case OP_MUL: a = a * b; break;
+          case OP_DIV: a = b != 0 ? a / b : NAN; break;
+          case OP_LT:  a = a <  b ? 1.0f : 0.0f; break;
+          case OP_LE:  a = a <= b ? 1.0f : 0.0f; break;
+          case OP_GT:  a = a >  b ? 1.0f : 0.0f; break;
+          case OP_GE:  a = a >= b ? 1.0f : 0.0f; break;
+          case OP_EQ:  a = a == b ? 1.0f : 0.0f; break;
+          case OP_NE:  a = a != b ? 1.0f : 0.0f; break;
+          case OP_AND: a = (a != 0 && !isnan(a) && b != 0 && !isnan(b)) ? 1.0f : 0.0f; break;
+          case OP_OR:  a = ((a != 0 && !isnan(a)) || (b != 0 && !isnan(b))) ? 1.0f : 0.0f; break;
+        }
+        break;
+      }
+    }
+  }
+}
+
+// =======================
+// Compilateur (descente recursive)
+// =======================
+
+struct AlertCompiler {
+  const char *p;
+  uint8_t    *code;
+  uint8_t     len;
+  int8_t      depth;
+  const char *err;
+  uint8_t     firstMetric;
+};
+
+static void skipSpaces(AlertCompiler &c) {
+  while (*c.p == ' ' || *c.p == '\t') c.p++;
+}
+
+// mot-cle isole (pas le debut d'un identifiant plus long)
+static bool acceptWord(AlertCompiler &c, const char *w) {
+  skipSpaces(c);
+  size_t n = strlen(w);
+  if (strncmp(c.p, w, n) != 0 || isalnum((unsigned char)c.p[n]) || c.p[n] == '_') return false;
+  c.p += n;
+  return true;
+}
+
+static bool acceptSym(AlertCompiler &c, const char *s) {
+  skipSpaces(c);
+  size_t n = strlen(s);
+  if (strncmp(c.p, s, n) != 0) return false;
+  c.p += n;
+  return true;
+}
+
+static bool emit(AlertCompiler &c, uint8_t op, int8_t stackDelta) {
+  if (c.len + 1 >= ALERT_CODE_MAX) {
+    c.err = "regle trop longue";
+    return false;
+  }
+  c.code[c.len++] = op;
+  c.depth += stackDelta;
+  if (c.depth > ALERT_STACK) {
+    c.err = "expression trop imbriquee";
+    return false;
+  }
+  return true;
+}
+
+static bool emitConst(AlertCompiler &c, float v) {
+  if (c.len + 1 + sizeof(float) >= ALERT_CODE_MAX) {
+    c.err = "regle trop longue";
+    return false;
+  }
+  if (!emit(c, OP_CONST, 1)) return false;
+  memcpy(&c.code[c.len], &v, sizeof(float));
+  c.len += sizeof(float);
+  return true;
+}
+
+static bool parseOr(AlertCompiler &c);
+
+static bool parseAtom(AlertCompiler &c) {
+  skipSpaces(c);
+
+  if (acceptSym(c, "(")) {
+    if (!parseOr(c)) return false;
+    if (!acceptSym(c, ")")) {
+      c.err = "')' attendue";
+      return false;
+    }
+    return true;
+  }
+  if (acceptSym(c, "-")) {
+    return parseAtom(c) && emit(c, OP_NEG, 0);
+  }
+
+  if (isdigit((unsigned char)*c.p) || *c.p == '.') {
+    char *end;
+    float v = strtof(c.p, &end);
+    c.p = end;
+    if (*c.p == '%') {
+      v /= 100.0f;
+      c.p++;
+    }
+    return emitConst(c, v);
+  }
+
+  if (isalpha((unsigned char)*c.p)) {
+    const char *start = c.p;
+    while (isalnum((unsigned char)*c.p) || *c.p == '_') c.p++;
+    size_t n = c.p - start;
+    for (uint8_t i = 0; i < M_COUNT; i++) {
+      if (strlen(METRIC_NAMES[i]) == n && strncmp(METRIC_NAMES[i], start, n) == 0) {
+        if (c.firstMetric == 0xFF) c.firstMetric = i;
+        if (!emit(c, OP_METRIC, 1)) return false;
+        if (c.len + 1 >= ALERT_CODE_MAX) {
+          c.err = "regle trop longue";
+          return false;
+        }
+        c.code[c.len++] = i;
+        return true;
+      }
+    }
+    c.p = start;
+    c.err = "metrique inconnue";
+    return false;
+  }
+
+  c.err = "valeur attendue";
+  return false;
+}
+
+static bool parseProduct(AlertCompiler &c) {
+  if (!parseAtom(c)) return false;
+  for (;;) {
+    if      (acceptSym(c, "*")) { if (!parseAtom(c) || !emit(c, OP_MUL, -1)) return false; }
+    else if (acceptSym(c, "/")) { if (!parseAtom(c) || !emit(c, OP_DIV, -1)) return false; }
+    else return true;
+  }
+}
+
+static bool parseSum(AlertCompiler &c) {
+  if (!parseProduct(c)) return false;
+  for (;;) {
+    if      (acceptSym(c, "+")) { if (!parseProduct(c) || !emit(c, OP_ADD, -1)) return false; }
+    else if (acceptSym(c, "-")) { if (!parseProduct(c) || !emit(c, OP_SUB, -1)) return false; }
+    else return true;
+  }
+}
+
+static bool parseCompare(AlertCompiler &c) {
+  if (!parseSum(c)) return false;
+
+  // les operateurs a deux caracteres d'abord
+  static const struct { const char *sym; uint8_t op; } OPS[] = {
+    { "<=", OP_LE }, { ">=", OP_GE }, { "==", OP_EQ }, { "!=", OP_NE },
+    { "<",  OP_LT }, { ">",  OP_GT },
+  };
+  for (const auto &o : OPS) {
+    if (acceptSym(c, o.sym)) return parseSum(c) && emit(c, o.op, -1);
+  }
+  return true;
+}
+
+static bool parseNot(AlertCompiler &c) {
+  if (acceptWord(c, "not")) return parseNot(c) && emit(c, OP_NOT, 0);
+  return parseCompare(c);
+}
+
+static bool parseAnd(AlertCompiler &c) {
+  if (!parseNot(c)) return false;
+  while (acceptWord(c, "and")) {
+    if (!parseNot(c) || !emit(c, OP_AND, -1)) return false;
+  }
+  return true;
+}
+
+static bool parseOr(AlertCompiler &c) {
+  if (!parseAnd(c)) return false;
+  while (acceptWord(c, "or")) {
+    if (!parseAnd(c) || !emit(c, OP_OR, -1)) return false;
+  }
+  return true;
+}
+
+// "nom: expression [for 5m]" -> regle compilee
+static bool compileRule(const char *line, AlertRule &r, const char *&err) {
+  memset(&r, 0, sizeof(r));
+
+  const char *colon = strchr(line, ':');
+  if (!colon) {
+    err = "':' attendu apres le nom";
+    return false;
+  }
+  const char *ns = line;
+  while (*ns == ' ') ns++;
+  size_t nlen = colon - ns;
+  while (nlen > 0 && ns[nlen - 1] == ' ') nlen--;
+  if (nlen == 0 || nlen >= sizeof(r.name)) {
+    err = "nom vide ou trop long";
+    return false;
+  }
+  memcpy(r.name, ns, nlen);
+
+  AlertCompiler c = { colon + 1, r.code, 0, 0, nullptr, 0xFF };
+  if (!parseOr(c)) {
+    err = c.err;
+    return false;
+  }
+
+  if (acceptWord(c, "for")) {
+    skipSpaces(c);
+    char *end;
+    long n = strtol(c.p, &end, 10);
+    if (end == c.p || n < 0) {
+      err = "duree attendue apres 'for'";
+      return false;
+    }
+    c.p = end;
+    uint32_t mult = 1;
+    if      (*c.p == 's') { c.p++; }
+    else if (*c.p == 'm') { mult = 60;   c.p++; }
+    else if (*c.p == 'h') { mult = 3600; c.p++; }
+    if ((unsigned long)n > ALERT_FOR_MAX_S / mult) {
+      err = "duree 'for' trop longue (24 h maxi)";
+      return false;
+    }
+    r.forSec = (uint32_t)n * mult;
+  }
+
+  skipSpaces(c);
+  if (*c.p != '\0') {
+    err = "fin de regle attendue";
+    return false;
+  }
+  if (!emit(c, OP_END, 0)) {
+    err = c.err;
+    return false;
+  }
+
+  r.codeLen     = c.len;
+  r.firstMetric = c.firstMetric;
+  return true;
+}
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences alertPrefs;
+
+const uint32_t ALERT_TICK_MS      = 5000;     // sans nouveau status (miner injoignable)
+const uint8_t  ALERT_QUEUE_SIZE   = 16;
+const uint8_t  ALERT_BATCH_MAX    = 8;        // on poste des que la file en contient autant
+const uint32_t ALERT_BATCH_MS     = 10000;    // sinon, au plus tard 10 s apres la premiere
+const uint32_t ALERT_RETRY_MIN_MS = 5000;
+const uint32_t ALERT_RETRY_MAX_MS = 300000;
+const uint16_t ALERT_HTTP_TIMEOUT = 2000;
+
+static const char *DEFAULT_RULES =
+  "hashrate: ths < 80% * ths1h for 5m\n"
+  "erreurs_hw: hw > 5 for 10m\n"
+  "surchauffe: temp > 90\n"
+  "injoignable: unreachable for 2m\n";
+
+static AlertRule  gRules[ALERT_MAX_RULES];
+static AlertStats gStats = {};
+static String     gRulesText;
+static String     gUrl;
+static bool       gWebhookOn = false;
+
+static uint32_t gLastOkMs   = 0;
+static uint32_t gLastEvalMs = 0;
+
+struct AlertNote {
+  char     rule[16];
+  bool     firing;
+  float    value;
+  uint32_t epoch;
+  uint32_t queuedMs;
+};
+
+static AlertNote gQueue[ALERT_QUEUE_SIZE];
+static uint8_t   gQHead = 0;   // prochain emplacement libre
+static uint8_t   gRetries = 0;
+
+static void enqueue(const AlertRule &r, float value, uint32_t now) {
+  if (gStats.queued == ALERT_QUEUE_SIZE) gStats.dropped++;   // on ecrase la plus ancienne
+  AlertNote &n = gQueue[gQHead];
+  memcpy(n.rule, r.name, sizeof(n.rule));
+  n.firing   = r.firing;
+  n.value    = value;
+  time_t t   = time(nullptr);
+  n.epoch    = t > 1600000000 ? (uint32_t)t : 0;
+  n.queuedMs = now;
+  gQHead = (gQHead + 1) % ALERT_QUEUE_SIZE;
+  if (gStats.queued < ALERT_QUEUE_SIZE) gStats.queued++;
+
+  LOG_I("alerts", "Alerte %s : %s", r.name, r.firing ? "declenchee" : "resolue");
+}
+
+static const AlertNote &queueAt(uint8_t i) {   // 0 = plus ancienne
+  return gQueue[(gQHead + ALERT_QUEUE_SIZE - gStats.queued + i) % ALERT_QUEUE_SIZE];
+}
+
+static void evaluateAll(uint32_t now) {
+  float m[M_COUNT];
+  readMetrics(m);
+
+  uint32_t t0 = micros();
+  bool cond[ALERT_MAX_RULES];
+  for (uint8_t i = 0; i < gStats.ruleCount; i++) {
+    float v = runCode(gRules[i].code, m);
+    cond[i] = (v != 0 && !isnan(v));
+  }
+  gStats.lastEvalUs = micros() - t0;
+  if (gStats.lastEvalUs > gStats.maxEvalUs) gStats.maxEvalUs = gStats.lastEvalUs;
+  gStats.evals++;
+
+  for (uint8_t i = 0; i < gStats.ruleCount; i++) {
+    AlertRule &r = gRules[i];
+    float value = r.firstMetric < M_COUNT ? m[r.firstMetric] : NAN;
+
+    if (cond[i]) {
+      if (r.trueSinceMs == 0) r.trueSinceMs = now | 1;
+      if (!r.firing && now - r.trueSinceMs >= r.forSec * 1000UL) {
+        r.firing = true;
+        r.fireCount++;
+        time_t t = time(nullptr);
+        r.firedEpoch = t > 1600000000 ? (uint32_t)t : 0;
+        enqueue(r, value, now);
+        journalLog(JE_ALERT, JSRC_ALERTS, 1, r.name);
+      }
+    } else {
+      r.trueSinceMs = 0;
+      if (r.firing) {
+        r.firing = false;
+        enqueue(r, value, now);
+        journalLog(JE_ALERT, JSRC_ALERTS, 0, r.name);
+      }
+    }
+  }
+}
+
+static void flushQueue(uint32_t now) {
+  if (!gWebhookOn || gUrl.length() == 0 || gStats.queued == 0) return;
+  if (!WiFi.isConnected()) return;
+
+  if (gStats.nextRetryMs != 0) {
+    if ((int32_t)(now - gStats.nextRetryMs) < 0) return;
+  } else if (gStats.queued < ALERT_BATCH_MAX && now - queueAt(0).queuedMs < ALERT_BATCH_MS) {
+    return;   // on attend d'autres changements pour les regrouper
+  }
+
+  uint8_t n = gStats.queued;
+  String body = "{\"device\":\"" + WiFi.macAddress() + "\",\"ip\":\"" + WiFi.localIP().toString() +
+                "\",\"alerts\":[";
+  for (uint8_t i = 0; i < n; i++) {
+    const AlertNote &a = queueAt(i);
+    if (i) body += ",";
+    body += "{\"rule\":\"" + String(a.rule) + "\",\"state\":\"" +
+            (a.firing ? "firing" : "resolved") + "\",\"value\":" +
+            (isnan(a.value) ? String("null") : String(a.value, 3)) +
+            ",\"epoch\":" + String(a.epoch) + "}";
+  }
+  body += "]}";
+
+  WiFiClient client;
+  HTTPClient http;
+  http.setConnectTimeout(ALERT_HTTP_TIMEOUT);
+  http.setTimeout(ALERT_HTTP_TIMEOUT);
+
+  int code = -1;
+  if (http.begin(client, gUrl)) {
+    http.addHeader("Content-Type", "application/json");
+    code = http.POST(body);
+    http.end();
+  }
+  gStats.lastHttpCode = code;
+
+  if (code >= 200 && code < 300) {
+    gStats.sent  += n;
+    gStats.queued = 0;   // les nouvelles arrivees pendant le POST n'existent pas (meme tache)
+    gStats.nextRetryMs = 0;
+    gRetries = 0;
+    return;
+  }
+
+  gStats.postErrors++;
+  uint32_t backoff = ALERT_RETRY_MIN_MS << (gRetries < 6 ? gRetries : 6);
+  if (backoff > ALERT_RETRY_MAX_MS) backoff = ALERT_RETRY_MAX_MS;
+  if (gRetries < 0xFF) gRetries++;
+  gStats.nextRetryMs = (now + backoff) | 1;
+  LOG_W("alerts", "Webhook : echec (%d), nouvel essai dans %lu s", code, (unsigned long)(backoff / 1000));
+}
+
+// compile tout le texte ; ne touche a gRules que si tout est valide
+static bool compileAll(const String &text, String &err) {
+  AlertRule tmp[ALERT_MAX_RULES];
+  uint8_t count = 0;
+  int lineNo = 0;
+  int start = 0;
+
+  while (start <= (int)text.length()) {
+    int end = text.indexOf('\n', start);
+    if (end < 0) end = text.length();
+    String line = text.substring(start, end);
+    start = end + 1;
+    lineNo++;
+
+    line.trim();
+    if (line.length() == 0 || line[0] == '#') continue;
+    if (count == ALERT_MAX_RULES) {
+      err = "Trop de regles (max " + String(ALERT_MAX_RULES) + ")";
+      return false;
+    }
+
+    const char *e = nullptr;
+    if (!compileRule(line.c_str(), tmp[count], e)) {
+      err = "Ligne " + String(lineNo) + " : " + e;
+      return false;
+    }
+
+    // on garde l'etat d'une regle existante de meme nom
+    for (uint8_t i = 0; i < gStats.ruleCount; i++) {
+      if (strcmp(gRules[i].name, tmp[count].name) == 0) {
+        tmp[count].firing      = gRules[i].firing;
+        tmp[count].trueSinceMs = gRules[i].trueSinceMs;
+        tmp[count].firedEpoch  = gRules[i].firedEpoch;
+        tmp[count].fireCount   = gRules[i].fireCount;
+      }
+    }
+    count++;
+  }
+
+  memcpy(gRules, tmp, sizeof(AlertRule) * count);
+  gStats.ruleCount = count;
+  return true;
+}
+
+// =======================
+// API publique
+// =======================
+
+void alertsInit() {
+  alertPrefs.begin("alerts", true);
+  gRulesText = alertPrefs.getString("rules", DEFAULT_RULES);
+  gUrl       = alertPrefs.getString("url", "");
+  gWebhookOn = alertPrefs.getBool("on", false);
+  alertPrefs.end();
+
+  gStats.ruleCount = 0;
+  String err;
+  if (!compileAll(gRulesText, err)) {
+    LOG_W("alerts", "Regles d'alerte invalides : %s", err.c_str());
+  }
+}
+
+void alertsLoop() {
+  uint32_t now = millis();
+
+  // a chaque nouveau status, ou periodiquement si le miner ne repond plus
+  MinerPollState ps = minerGetPollState();
+  bool fresh = ps.lastOkMs != 0 && ps.lastOkMs != gLastOkMs;
+  if (fresh || now - gLastEvalMs >= ALERT_TICK_MS) {
+    gLastOkMs   = ps.lastOkMs;
+    gLastEvalMs = now;
+    if (gStats.ruleCount > 0) evaluateAll(now);
+  }
+
+  flushQueue(now);
+}
+
+bool alertsSetRules(const String &text, String &err) {
+  if (!compileAll(text, err)) return false;
+
+  gRulesText = text;
+  alertPrefs.begin("alerts", false);
+  alertPrefs.putString("rules", gRulesText);
+  alertPrefs.end();
+  return true;
+}
+
+String alertsGetRules() {
+  return gRulesText;
+}
+
+void alertsSetWebhook(bool enabled, const String &url) {
+  gWebhookOn = enabled;
+  gUrl       = url;
+  gStats.nextRetryMs = 0;
+  gRetries = 0;
+
+  alertPrefs.begin("alerts", false);
+  alertPrefs.putBool("on", gWebhookOn);
+  alertPrefs.putString("url", gUrl);
+  alertPrefs.end();
+}
+
+bool alertsWebhookEnabled() {
+  return gWebhookOn;
+}
+
+String alertsGetWebhook() {
+  return gUrl;
+}
+
+AlertStats alertsGetStats() {
+  return gStats;
+}
+
+bool alertsGetRule(uint8_t i, AlertRule &out) {
+  if (i >= gStats.ruleCount) return false;
+  out = gRules[i];
+  return true;
+}
+
+const char* alertsMetricName(uint8_t idx) {
+  return idx < M_COUNT ? METRIC_NAMES[idx] : "";
+}
+
+void alertsFactoryReset() {
+  alertPrefs.begin("alerts", false);
+  alertPrefs.clear();
+  alertPrefs.end();
+  gQHead = 0;
+  gStats = AlertStats();
+  alertsInit();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <Arduino.h>
+
+// Alertes : regles texte compilees a l'enregistrement en un petit bytecode
+// a pile, evalue a chaque nouveau status (quelques microsecondes).
+// Les changements d'etat (declenchee / resolue) sont regroupes dans une
+// file et postes en JSON vers un webhook local, avec reessais.
+//
+// Une regle par ligne :   nom: expression [for <n>s|m|h]   (for : 24 h maxi)
+//   ths < 80% * ths1h for 5m
+//   hw > 5 for 10m
+//   temp > 90
+//   unreachable for 2m
+// Operateurs : + - * /  < <= > >= == !=  and or not  ( )
+// Un nombre suivi de % est divise par 100.
+
+const uint8_t  ALERT_MAX_RULES = 8;
+const uint8_t  ALERT_CODE_MAX  = 48;
+const uint32_t ALERT_FOR_MAX_S = 86400;   // forSec * 1000 doit tenir sur 32 bits
+
+struct AlertRule {
+  char     name[16];
+  uint8_t  code[ALERT_CODE_MAX];
+  uint8_t  codeLen;
+  uint8_t  firstMetric;   // valeur jointe a la notification (0xFF = aucune)
+  uint32_t forSec;        // condition vraie depuis au moins forSec
+  // etat
+  bool     firing;
+  uint32_t trueSinceMs;   // 0 = condition fausse
+  uint32_t firedEpoch;    // 0 = jamais
+  uint32_t fireCount;
+};
+
+struct AlertStats {
+  uint8_t  ruleCount;
+  uint32_t evals;
+  uint32_t lastEvalUs;    // duree de la derniere evaluation (toutes regles)
+  uint32_t maxEvalUs;
+  uint8_t  queued;        // notifications en attente
+  uint32_t sent;          // notifications livrees
+  uint32_t dropped;       // perdues (file pleine)
+  uint32_t postErrors;
+  int      lastHttpCode;  // 0 = jamais poste
+  uint32_t nextRetryMs;   // 0 = pas de reessai en attente
+};
+
+void alertsInit();
+void alertsLoop();            // a appeler dans loop()
+
+// Compile et enregistre ; false + err (ligne, message) si une regle est invalide
+bool alertsSetRules(const String &text, String &err);
+String alertsGetRules();
+void alertsSetWebhook(bool enabled, const String &url);
+bool alertsWebhookEnabled();
+String alertsGetWebhook();
+
+AlertStats alertsGetStats();
+bool alertsGetRule(uint8_t i, AlertRule &out);
+const char* alertsMetricName(uint8_t idx);
+
+void alertsFactoryReset();
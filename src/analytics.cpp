@@ -0,0 +1,191 @@
+#include "analytics.h"
+
+#include <Preferences.h>
+#include <time.h>
+
+#include "miner.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences anPrefs;
+
+static AnalyticsConfig   gCfg  = { 22, 6 };
+static AnalyticsSnapshot gSnap = {};
+
+const float    TAU_1M_S          = 60.0f;
+const float    TAU_15M_S         = 900.0f;
+const float    TAU_60M_S         = 3600.0f;
+const uint32_t MAX_GAP_S         = 600;       // au-dela, on n'integre pas l'energie
+const uint32_t CHECKPOINT_MIN_MS = 900000;    // 15 min entre deux ecritures NVS
+const uint32_t CHECKPOINT_MAX_MS = 3600000;   // au moins une fois par heure
+const double   CHECKPOINT_KWH    = 0.5;       // ou des qu'on a 0,5 kWh non sauvegarde
+
+static uint32_t gLastOkMs   = 0;     // detection d'un nouveau status miner
+static uint32_t gPrevMs     = 0;     // millis() de l'echantillon precedent
+static float    gPrevWatts  = NAN;
+static long     gPrevAcc    = -1;
+static long     gPrevRej    = -1;
+static long     gPrevHw     = -1;
+
+// taux en EWMA : on lisse les numerateurs / denominateurs, pas le ratio
+static float gAccPerMin = 0;
+static float gRejPerMin = 0;
+
+static uint32_t gLastCheckpointMs = 0;
+static double   gKwhAtCheckpoint  = 0;
+
+// coefficient exponentiel pour un pas dt et une constante de temps tau
+static float ewmaAlpha(float dtS, float tau) {
+  return 1.0f - expf(-dtS / tau);
+}
+
+static void ewma(float &acc, float x, float alpha, bool first) {
+  acc = first ? x : acc + alpha * (x - acc);
+}
+
+static AnalyticsTariff currentTariff() {
+  time_t now = time(nullptr);
+  if (now < 1600000000) return TARIFF_HP;   // heure pas encore connue
+
+  struct tm lt;
+  localtime_r(&now, &lt);
+  uint8_t h = (uint8_t)lt.tm_hour;
+
+  bool hc;
+  if (gCfg.hcStartHour <= gCfg.hcEndHour) hc = (h >= gCfg.hcStartHour && h < gCfg.hcEndHour);
+  else                                    hc = (h >= gCfg.hcStartHour || h < gCfg.hcEndHour);
+  return hc ? TARIFF_HC : TARIFF_HP;
+}
+
+static void checkpoint(uint32_t now) {
+  anPrefs.begin("analytics", false);
+  anPrefs.putDouble("kwhHp", gSnap.kwh[TARIFF_HP]);
+  anPrefs.putDouble("kwhHc", gSnap.kwh[TARIFF_HC]);
+  anPrefs.putUInt("since", gSnap.sinceEpoch);
+  anPrefs.end();
+
+  gLastCheckpointMs = now;
+  gKwhAtCheckpoint  = gSnap.kwhTotal;
+}
+
+static void addSample(const MinerStatus &st, uint32_t now) {
+  bool  first = (gSnap.samples == 0);
+  float dtS   = first ? 0 : (now - gPrevMs) / 1000.0f;
+  gPrevMs = now;
+
+  float ths   = st.isActive ? (float)(st.sum.mhs_5s.toDouble() / 1000000.0) : 0.0f;
+  float watts = st.power.length() > 0 ? st.power.toFloat() : NAN;
+
+  float a1  = ewmaAlpha(dtS, TAU_1M_S);
+  float a15 = ewmaAlpha(dtS, TAU_15M_S);
+  float a60 = ewmaAlpha(dtS, TAU_60M_S);
+
+  ewma(gSnap.ths1m,  ths, a1,  first);
+  ewma(gSnap.ths15m, ths, a15, first);
+  ewma(gSnap.ths60m, ths, a60, first);
+  if (!isnan(watts)) ewma(gSnap.watts15m, watts, a15, first || isnan(gPrevWatts));
+
+  gSnap.jth = gSnap.ths15m > 0.01f ? gSnap.watts15m / gSnap.ths15m : 0;
+
+  // parts et erreurs : deltas des compteurs cumulatifs
+  long dAcc = counterDelta(st.sum.accepted.toInt(), gPrevAcc);
+  long dRej = counterDelta(st.sum.rejected.toInt(), gPrevRej);
+  long dHw  = counterDelta(st.sum.hw_errors.toInt(), gPrevHw);
+
+  if (dtS > 0) {
+    float perMin = 60.0f / dtS;
+    ewma(gAccPerMin,     dAcc * perMin, a15, false);
+    ewma(gRejPerMin,     dRej * perMin, a15, false);
+    ewma(gSnap.hwPerMin, dHw * perMin,  a15, false);
+    float shares = gAccPerMin + gRejPerMin;
+    gSnap.rejectPct = shares > 0 ? 100.0f * gRejPerMin / shares : 0;
+  }
+
+  // energie : trapeze entre deux echantillons, sauf trou de mesure
+  if (!first && dtS <= MAX_GAP_S && !isnan(watts) && !isnan(gPrevWatts)) {
+    double kwh = (watts + gPrevWatts) * 0.5 * dtS / 3600.0 / 1000.0;
+    gSnap.kwh[currentTariff()] += kwh;
+    gSnap.kwhTotal += kwh;
+  }
+  gPrevWatts = watts;
+
+  if (gSnap.sinceEpoch == 0 && time(nullptr) > 1600000000) {
+    gSnap.sinceEpoch = (uint32_t)time(nullptr);
+  }
+  gSnap.samples++;
+}
+
+// =======================
+// API publique
+// =======================
+
+void analyticsInit() {
+  anPrefs.begin("analytics", true);
+  gCfg.hcStartHour = anPrefs.getUChar("hcStart", 22);
+  gCfg.hcEndHour   = anPrefs.getUChar("hcEnd", 6);
+  gSnap.kwh[TARIFF_HP] = anPrefs.getDouble("kwhHp", 0);
+  gSnap.kwh[TARIFF_HC] = anPrefs.getDouble("kwhHc", 0);
+  gSnap.sinceEpoch     = anPrefs.getUInt("since", 0);
+  anPrefs.end();
+
+  if (isnan(gSnap.kwh[TARIFF_HP])) gSnap.kwh[TARIFF_HP] = 0;
+  if (isnan(gSnap.kwh[TARIFF_HC])) gSnap.kwh[TARIFF_HC] = 0;
+  gSnap.kwhTotal   = gSnap.kwh[TARIFF_HP] + gSnap.kwh[TARIFF_HC];
+  gKwhAtCheckpoint = gSnap.kwhTotal;
+}
+
+void analyticsLoop() {
+  MinerPollState ps = minerGetPollState();
+  if (ps.lastOkMs == 0 || ps.lastOkMs == gLastOkMs) return;
+  gLastOkMs = ps.lastOkMs;
+
+  addSample(minerGetStatus(), ps.lastOkMs);
+
+  // sauvegarde NVS a faible cadence (usure de la flash)
+  uint32_t now = millis();
+  uint32_t since = now - gLastCheckpointMs;
+  double   unsaved = gSnap.kwhTotal - gKwhAtCheckpoint;
+  if (unsaved > 0 &&
+      (since >= CHECKPOINT_MAX_MS || (since >= CHECKPOINT_MIN_MS && unsaved >= CHECKPOINT_KWH))) {
+    checkpoint(now);
+  }
+}
+
+AnalyticsSnapshot analyticsGet() {
+  return gSnap;
+}
+
+AnalyticsConfig analyticsGetConfig() {
+  return gCfg;
+}
+
+void analyticsSetConfig(const AnalyticsConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.hcStartHour > 23) gCfg.hcStartHour = 0;
+  if (gCfg.hcEndHour > 23)   gCfg.hcEndHour = 0;
+
+  anPrefs.begin("analytics", false);
+  anPrefs.putUChar("hcStart", gCfg.hcStartHour);
+  anPrefs.putUChar("hcEnd", gCfg.hcEndHour);
+  anPrefs.end();
+}
+
+void analyticsResetEnergy() {
+  gSnap.kwh[TARIFF_HP] = 0;
+  gSnap.kwh[TARIFF_HC] = 0;
+  gSnap.kwhTotal       = 0;
+  gSnap.sinceEpoch     = time(nullptr) > 1600000000 ? (uint32_t)time(nullptr) : 0;
+  checkpoint(millis());
+}
+
+void analyticsFactoryReset() {
+  anPrefs.begin("analytics", false);
+  anPrefs.clear();
+  anPrefs.end();
+
+  gSnap = AnalyticsSnapshot();
+  gCfg  = { 22, 6 };
+  gKwhAtCheckpoint = 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+
+// Statistiques en continu, O(1) par echantillon : moyennes glissantes
+// exponentielles du hashrate, efficacite, taux de rejets / erreurs HW
+// et energie consommee (kWh) par tranche tarifaire.
+
+enum AnalyticsTariff : uint8_t {
+  TARIFF_HP = 0,   // heures pleines
+  TARIFF_HC,       // heures creuses
+  TARIFF_COUNT
+};
+
+struct AnalyticsSnapshot {
+  float  ths1m;           // EWMA hashrate (TH/s), constante de temps 1 min
+  float  ths15m;
+  float  ths60m;
+  float  watts15m;        // EWMA puissance (W)
+  float  jth;             // watts15m / ths15m (0 si pas de hashrate)
+  float  rejectPct;       // rejets / (acceptes + rejets), EWMA 15 min
+  float  hwPerMin;        // erreurs HW par minute, EWMA 15 min
+  double kwh[TARIFF_COUNT];
+  double kwhTotal;
+  uint32_t sinceEpoch;    // debut des compteurs d'energie (0 = inconnu)
+  uint32_t samples;       // echantillons depuis le boot
+};
+
+struct AnalyticsConfig {
+  uint8_t hcStartHour;    // debut des heures creuses (heure locale)
+  uint8_t hcEndHour;      // fin des heures creuses
+};
+
+void analyticsInit();           // recharge les compteurs d'energie depuis NVS
+void analyticsLoop();           // a appeler dans loop(), consomme chaque nouveau status
+
+AnalyticsSnapshot analyticsGet();
+AnalyticsConfig analyticsGetConfig();
+void analyticsSetConfig(const AnalyticsConfig &cfg);
+
+void analyticsResetEnergy();    // remet les kWh a zero
+void analyticsFactoryReset();
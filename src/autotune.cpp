@@ -0,0 +1,338 @@
+#include "autotune.h"
+
+#include <Preferences.h>
+#include <time.h>
+
+#include "miner.h"
+#include "cmdqueue.h"
+#include "governor.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences atPrefs;
+
+static AutotuneConfig gCfg = { 10, 10, 30, 0, 0 };
+static AutotuneResult gTable[AUTOTUNE_MODES];
+static AutotuneStatus gStatus;
+
+const uint32_t AT_BATCH_MS      = 60000;   // >> fenetre MHS 5s : lots quasi independants
+const uint16_t AT_MIN_BATCHES   = 10;
+const float    AT_TARGET_RELERR = 0.01f;   // IC 95% a +/- 1% du hashrate moyen
+
+static uint32_t gCmdId      = 0;
+static int8_t   gOrigLevel  = 0;   // mode du miner avant l'autotune (1..3), rendu si interrompu
+static uint32_t gLastOkMs   = 0;   // detection d'un nouveau status miner
+
+// Moyennes / variances incrementales (Welford)
+struct RunningStat {
+  uint32_t n;
+  double   mean;
+  double   m2;
+
+  void reset() { n = 0; mean = 0; m2 = 0; }
+  void add(double x) {
+    n++;
+    double d = x - mean;
+    mean += d / n;
+    m2   += d * (x - mean);
+  }
+  double variance() const { return n > 1 ? m2 / (n - 1) : 0; }
+};
+
+static RunningStat gBatch;         // lectures du lot en cours
+static RunningStat gHash;          // moyennes des lots termines
+static RunningStat gPower;
+static uint32_t    gBatchStartMs = 0;
+static float       gPeakTemp = NAN;
+
+static void saveTable() {
+  atPrefs.begin("autotune", false);
+  atPrefs.putBytes("table", gTable, sizeof(gTable));
+  atPrefs.end();
+}
+
+static void setPhase(AutotunePhase phase, const String &detail) {
+  gStatus.phase        = phase;
+  gStatus.phaseStartMs = millis();
+  gStatus.detail       = detail;
+  LOG_I("autotune", "%s", detail.c_str());
+}
+
+// quantile 97,5% de Student : peu de lots, 1.96 serait trop optimiste
+static double tQuantile95(uint32_t dof) {
+  static const float T[] = { 12.71f, 4.30f, 3.18f, 2.78f, 2.57f, 2.45f, 2.36f, 2.31f, 2.26f, 2.23f,
+                             2.20f, 2.18f, 2.16f, 2.14f, 2.13f, 2.12f, 2.11f, 2.10f, 2.09f, 2.09f };
+  if (dof == 0) return INFINITY;
+  if (dof <= sizeof(T) / sizeof(T[0])) return T[dof - 1];
+  return dof <= 40 ? 2.04 : 1.98;
+}
+
+// demi-largeur IC 95% / moyenne, sur les moyennes de lots
+static float relativeError() {
+  if (gHash.n < 2 || gHash.mean <= 0) return 1.0f;
+  return (float)(tQuantile95(gHash.n - 1) * sqrt(gHash.variance() / gHash.n) / gHash.mean);
+}
+
+// le plafond du gouverneur de puissance prime sur tout mode demande
+static int8_t capLevel(int8_t level) {
+  int8_t cap = governorLevelCap();
+  return level > cap ? cap : level;
+}
+
+// Interruption : le miner ne doit pas rester dans le mode en cours de test
+static void abortRun(const String &detail) {
+  setPhase(AT_ABORTED, detail);
+  if (gOrigLevel <= 0) return;
+
+  int8_t level = capLevel(gOrigLevel);
+  if (level <= 0) return;
+  LOG_I("autotune", "Retour au mode %s", minerLevelMode(level));
+  cmdQueueSubmit(CMD_MODE, minerLevelMode(level), 0, false, JSRC_AUTOTUNE);
+}
+
+static bool eligible(const AutotuneResult &r) {
+  if (r.epoch == 0 || r.jth <= 0) return false;
+  if (gCfg.powerCeilW > 0 && r.watts > gCfg.powerCeilW) return false;
+  if (gCfg.tempCeilC > 0 && !isnan(r.tempMax) && r.tempMax > gCfg.tempCeilC) return false;
+  return true;
+}
+
+static void startMode(uint8_t idx) {
+  gStatus.modeIndex = idx;
+  gStatus.samples   = 0;
+
+  // mode interdit par le gouverneur de puissance : on le saute
+  if ((int8_t)(idx + 1) > governorLevelCap()) {
+    setPhase(AT_SWITCHING, String("Mode ") + minerLevelMode(idx + 1) + " bride, ignore");
+    gCmdId = 0;
+    return;
+  }
+
+  gCmdId = cmdQueueSubmit(CMD_MODE, minerLevelMode(idx + 1), 0, false, JSRC_AUTOTUNE);
+  setPhase(AT_SWITCHING, String("Passage en ") + minerLevelMode(idx + 1));
+}
+
+static void nextMode() {
+  if (gStatus.modeIndex + 1 < AUTOTUNE_MODES) {
+    startMode(gStatus.modeIndex + 1);
+    return;
+  }
+
+  saveTable();
+  gStatus.bestIndex = autotuneBestIndex();
+  if (gStatus.bestIndex < 0) {
+    setPhase(AT_DONE, "Termine : aucun mode sous les plafonds");
+    return;
+  }
+
+  int8_t level = capLevel(gStatus.bestIndex + 1);
+  if (level > 0) cmdQueueSubmit(CMD_MODE, minerLevelMode(level), 0, false, JSRC_AUTOTUNE);
+  setPhase(AT_DONE, String("Termine : meilleur mode ") + minerLevelMode(gStatus.bestIndex + 1) +
+                    " (" + String(gTable[gStatus.bestIndex].jth, 1) + " J/TH)");
+}
+
+static void finishMeasure() {
+  AutotuneResult &r = gTable[gStatus.modeIndex];
+  r.ths     = (float)gHash.mean;
+  r.watts   = (float)gPower.mean;
+  r.jth     = r.ths > 0 ? r.watts / r.ths : 0;
+  r.tempMax = gPeakTemp;
+  r.relErr  = relativeError();
+  r.samples = (uint16_t)gHash.n;
+  r.epoch   = (uint32_t)time(nullptr);
+
+  LOG_I("autotune", "%s : %.2f TH/s, %.0f W, %.1f J/TH (+/-%.1f%%, %u lots)",
+                minerLevelMode(gStatus.modeIndex + 1), r.ths, r.watts, r.jth,
+                r.relErr * 100.0f, (unsigned)r.samples);
+  nextMode();
+}
+
+// =======================
+// API publique
+// =======================
+
+void autotuneInit() {
+  atPrefs.begin("autotune", true);
+  if (atPrefs.getBytes("table", gTable, sizeof(gTable)) != sizeof(gTable)) {
+    memset(gTable, 0, sizeof(gTable));
+  }
+  gCfg.settleMin    = atPrefs.getUShort("settle", 10);
+  gCfg.minWindowMin = atPrefs.getUShort("minWin", 10);
+  gCfg.maxWindowMin = atPrefs.getUShort("maxWin", 30);
+  gCfg.powerCeilW   = atPrefs.getUShort("powerCeil", 0);
+  gCfg.tempCeilC    = atPrefs.getUChar("tempCeil", 0);
+  atPrefs.end();
+
+  gStatus = AutotuneStatus();
+  gStatus.phase     = AT_IDLE;
+  gStatus.bestIndex = autotuneBestIndex();
+}
+
+void autotuneLoop() {
+  if (!autotuneIsRunning()) return;
+
+  minerPollDemand();   // echantillons toutes les 2s pendant la mesure
+  uint32_t now = millis();
+
+  // miner en veille / injoignable trop longtemps : inutile d'insister
+  MinerPollState ps = minerGetPollState();
+  if (ps.circuitOpen) {
+    abortRun("Interrompu : miner injoignable");
+    return;
+  }
+
+  switch (gStatus.phase) {
+    case AT_SWITCHING: {
+      if (gCmdId == 0) {         // mode saute
+        nextMode();
+        return;
+      }
+      CmdInfo c;
+      c.state = CMD_FAILED;
+      if (cmdQueueGet(gCmdId, c) && !cmdStateIsFinal(c.state)) return;
+      if (c.state != CMD_CONFIRMED) {
+        abortRun("Interrompu : changement de mode non confirme");
+        return;
+      }
+      setPhase(AT_SETTLING, String("Stabilisation en ") + minerLevelMode(gStatus.modeIndex + 1));
+      return;
+    }
+
+    case AT_SETTLING:
+      if (now - gStatus.phaseStartMs < (uint32_t)gCfg.settleMin * 60000UL) return;
+      gBatch.reset();
+      gHash.reset();
+      gPower.reset();
+      gPeakTemp = NAN;
+      gBatchStartMs  = now;
+      gStatus.batches = 0;
+      gLastOkMs = ps.lastOkMs;
+      setPhase(AT_MEASURING, String("Mesure en ") + minerLevelMode(gStatus.modeIndex + 1));
+      return;
+
+    case AT_MEASURING: {
+      if (ps.lastOkMs != gLastOkMs) {
+        gLastOkMs = ps.lastOkMs;
+        MinerStatus st = minerGetStatus();
+
+        if (minerStatusLevel(st) != gStatus.modeIndex + 1) {
+          abortRun("Interrompu : mode change pendant la mesure");
+          return;
+        }
+
+        double ths = st.sum.mhs_5s.toDouble() / 1000000.0;   // MH/s -> TH/s
+        double w   = st.power.toDouble();
+        if (ths > 0 && w > 0) {
+          gBatch.add(ths);
+          gPower.add(w);
+          if (!isnan(st.tempMax) && (isnan(gPeakTemp) || st.tempMax > gPeakTemp)) {
+            gPeakTemp = st.tempMax;
+          }
+          gStatus.samples = (uint16_t)gPower.n;
+        }
+      }
+
+      // lot termine : sa moyenne est un echantillon (le lot partiel final est ignore)
+      if (now - gBatchStartMs >= AT_BATCH_MS) {
+        if (gBatch.n > 0) gHash.add(gBatch.mean);
+        gBatch.reset();
+        gBatchStartMs   = now;
+        gStatus.batches = (uint16_t)gHash.n;
+      }
+
+      uint32_t elapsed = now - gStatus.phaseStartMs;
+      bool minDone = elapsed >= (uint32_t)gCfg.minWindowMin * 60000UL && gHash.n >= AT_MIN_BATCHES;
+      bool maxDone = elapsed >= (uint32_t)gCfg.maxWindowMin * 60000UL;
+
+      if ((minDone && relativeError() <= AT_TARGET_RELERR) || maxDone) {
+        if (gHash.n < AT_MIN_BATCHES) {
+          abortRun("Interrompu : pas assez d'echantillons");
+          return;
+        }
+        finishMeasure();
+      }
+      return;
+    }
+
+    default:
+      return;
+  }
+}
+
+bool autotuneStart() {
+  if (autotuneIsRunning()) return false;
+
+  MinerPollState ps = minerGetPollState();
+  MinerStatus st = minerGetStatus();
+  if (ps.lastOkMs == 0 || ps.failures > 0 || minerStatusLevel(st) <= 0) return false;
+
+  gOrigLevel = minerStatusLevel(st);
+  // les modes sautes (bride) ne doivent pas garder une mesure d'un ancien passage
+  for (uint8_t i = 0; i < AUTOTUNE_MODES; i++) gTable[i].epoch = 0;
+  startMode(0);
+  return true;
+}
+
+void autotuneAbort() {
+  if (!autotuneIsRunning()) return;
+  abortRun("Interrompu par l'utilisateur");
+}
+
+bool autotuneIsRunning() {
+  return gStatus.phase == AT_SWITCHING ||
+         gStatus.phase == AT_SETTLING  ||
+         gStatus.phase == AT_MEASURING;
+}
+
+AutotuneConfig autotuneGetConfig() {
+  return gCfg;
+}
+
+void autotuneSetConfig(const AutotuneConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.minWindowMin < 1) gCfg.minWindowMin = 1;
+  if (gCfg.maxWindowMin < gCfg.minWindowMin) gCfg.maxWindowMin = gCfg.minWindowMin;
+  // un lot par minute : assez de temps pour AT_MIN_BATCHES lots
+  if (gCfg.maxWindowMin < AT_MIN_BATCHES) gCfg.maxWindowMin = AT_MIN_BATCHES;
+
+  atPrefs.begin("autotune", false);
+  atPrefs.putUShort("settle", gCfg.settleMin);
+  atPrefs.putUShort("minWin", gCfg.minWindowMin);
+  atPrefs.putUShort("maxWin", gCfg.maxWindowMin);
+  atPrefs.putUShort("powerCeil", gCfg.powerCeilW);
+  atPrefs.putUChar("tempCeil", gCfg.tempCeilC);
+  atPrefs.end();
+
+  if (!autotuneIsRunning()) gStatus.bestIndex = autotuneBestIndex();
+}
+
+AutotuneStatus autotuneGetStatus() {
+  return gStatus;
+}
+
+bool autotuneGetResult(uint8_t modeIndex, AutotuneResult &out) {
+  if (modeIndex >= AUTOTUNE_MODES || gTable[modeIndex].epoch == 0) return false;
+  out = gTable[modeIndex];
+  return true;
+}
+
+int8_t autotuneBestIndex() {
+  int8_t best = -1;
+  int8_t cap = governorLevelCap();
+  for (uint8_t i = 0; i < AUTOTUNE_MODES; i++) {
+    if ((int8_t)(i + 1) > cap) continue;
+    if (!eligible(gTable[i])) continue;
+    if (best < 0 || gTable[i].jth < gTable[best].jth) best = i;
+  }
+  return best;
+}
+
+void autotuneFactoryReset() {
+  atPrefs.begin("autotune", false);
+  atPrefs.clear();
+  atPrefs.end();
+  autotuneInit();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+
+// Autotune : passe le miner par eco / standard / super, laisse chaque mode
+// se stabiliser, mesure hashrate (MHS 5s) et puissance (PS[]) sur une
+// fenetre statistiquement suffisante, puis garde le mode le plus efficace
+// (J/TH minimal) sous les plafonds de puissance et de temperature.
+// Les lectures MHS 5s se recouvrent (une toutes les 2 s) : l'intervalle de
+// confiance est calcule sur des moyennes par lots de 60 s, pas sur les
+// lectures brutes.
+
+const uint8_t AUTOTUNE_MODES = 3;   // index 0 = eco, 1 = standard, 2 = super
+
+struct AutotuneResult {
+  float    ths;        // hashrate moyen (TH/s)
+  float    watts;      // puissance moyenne (W)
+  float    jth;        // efficacite (J/TH), 0 = non mesure
+  float    tempMax;    // TMax[] maxi observe pendant la mesure
+  float    relErr;     // demi-largeur IC 95% / moyenne du hashrate
+  uint16_t samples;    // lots de 60 s
+  uint32_t epoch;      // date de la mesure (0 = jamais)
+};
+
+struct AutotuneConfig {
+  uint16_t settleMin;      // stabilisation apres changement de mode
+  uint16_t minWindowMin;   // mesure mini
+  uint16_t maxWindowMin;   // mesure maxi (si le bruit ne descend pas)
+  uint16_t powerCeilW;     // 0 = pas de plafond
+  uint8_t  tempCeilC;      // 0 = pas de plafond (TMax puces)
+};
+
+enum AutotunePhase : uint8_t {
+  AT_IDLE = 0,
+  AT_SWITCHING,    // commande de mode en file
+  AT_SETTLING,
+  AT_MEASURING,
+  AT_DONE,
+  AT_ABORTED,
+};
+
+struct AutotuneStatus {
+  AutotunePhase phase;
+  uint8_t  modeIndex;      // mode en cours de mesure
+  uint32_t phaseStartMs;
+  uint16_t samples;        // lectures brutes
+  uint16_t batches;        // lots de 60 s termines
+  int8_t   bestIndex;      // -1 = aucun mode eligible
+  String   detail;
+};
+
+void autotuneInit();            // charge table + config depuis NVS
+void autotuneLoop();            // a appeler dans loop()
+
+bool autotuneStart();           // false si deja en cours / miner indisponible
+void autotuneAbort();
+bool autotuneIsRunning();
+
+AutotuneConfig autotuneGetConfig();
+void autotuneSetConfig(const AutotuneConfig &cfg);
+AutotuneStatus autotuneGetStatus();
+bool autotuneGetResult(uint8_t modeIndex, AutotuneResult &out);
+
+// Meilleur mode mesure sous les plafonds (et le plafond du gouverneur), -1 si aucun
+int8_t autotuneBestIndex();
+
+void autotuneFactoryReset();
@@ -0,0 +1,413 @@
+#include "cgapi.h"
+#include "miner.h"
+
+// =======================
+// Parseur JSON SAX
+// =======================
+
+// Une reponse cgminer a toujours la forme
+//   {"STATUS":[{...}],"POOLS":[{...},{...}],"id":1}
+// On suit la profondeur : 1 = racine, 2 = tableau de section,
+// 3 = enregistrement. Seuls les scalaires de profondeur 3 sont remontes,
+// et seulement si leur cle est dans le filtre ; le reste est survole sans
+// etre copie.
+
+const uint8_t JSON_MAX_DEPTH = 8;
+
+// key = nullptr : fin de l'enregistrement (section, index)
+typedef void (*CgFieldFn)(void *ctx, const char *section, int8_t index,
+                          const char *key, const char *val);
+
+struct CgJsonParser {
+  const char *const *keys;   // filtre, termine par nullptr
+  CgFieldFn  onField;
+  void      *ctx;
+
+  char    stack[JSON_MAX_DEPTH];   // '{' ou '['
+  uint8_t depth;
+  bool    inString;
+  bool    inScalar;
+  bool    escape;
+  uint8_t unicode;       // chiffres hex restants d'un \uXXXX
+  bool    expectKey;
+  bool    readingKey;
+  bool    capture;       // la valeur courante est demandee
+  bool    overflow;      // profondeur depassee : reponse ignoree
+
+  char    section[16];
+  int8_t  index;         // enregistrement courant dans la section
+  char    key[24];
+  uint8_t klen;
+  char    val[96];
+  uint8_t vlen;
+
+  CgStatus *status;      // rempli au passage depuis la section STATUS
+};
+
+static const char *const STATUS_KEYS[] = { "STATUS", "Code", "Msg", nullptr };
+
+static bool keyIn(const char *const *keys, const char *key) {
+  for (; keys && *keys; keys++) {
+    if (strcmp(*keys, key) == 0) return true;
+  }
+  return false;
+}
+
+static void copyStr(char *dst, size_t size, const char *src) {
+  strncpy(dst, src, size - 1);
+  dst[size - 1] = '\0';
+}
+
+static void jsonInit(CgJsonParser &p, const char *const *keys, CgFieldFn fn, void *ctx, CgStatus *st) {
+  memset(&p, 0, sizeof(p));
+  p.keys    = keys;
+  p.onField = fn;
+  p.ctx     = ctx;
+  p.index   = -1;
+  p.status  = st;
+}
+
+static void jsonEmit(CgJsonParser &p) {
+  if (!p.capture) return;
+  p.val[p.vlen] = '\0';
+
+  if (strcmp(p.section, "STATUS") == 0) {
+    if (!p.status) return;
+    if      (strcmp(p.key, "STATUS") == 0) p.status->code = p.val[0];
+    else if (strcmp(p.key, "Code") == 0)   p.status->num  = (uint16_t)strtoul(p.val, nullptr, 10);
+    else if (strcmp(p.key, "Msg") == 0)    copyStr(p.status->msg, sizeof(p.status->msg), p.val);
+    return;
+  }
+  if (p.onField) p.onField(p.ctx, p.section, p.index, p.key, p.val);
+}
+
+// Debut d'une valeur : on decide ici si elle est copiee
+static void jsonBeginValue(CgJsonParser &p) {
+  p.vlen = 0;
+  p.capture = false;
+  if (p.depth != 3 || p.stack[2] != '{') return;
+  if (strcmp(p.section, "STATUS") == 0) p.capture = keyIn(STATUS_KEYS, p.key);
+  else                                  p.capture = keyIn(p.keys, p.key);
+}
+
+static void jsonPutChar(CgJsonParser &p, char c) {
+  if (p.readingKey) {
+    if (p.klen < sizeof(p.key) - 1) p.key[p.klen++] = c;
+  } else if (p.capture) {
+    if (p.vlen < sizeof(p.val) - 1) p.val[p.vlen++] = c;
+  }
+}
+
+static void jsonFeed(CgJsonParser &p, const char *data, size_t len) {
+  for (size_t i = 0; i < len && !p.overflow; i++) {
+    char c = data[i];
+
+    if (p.inString) {
+      if (p.unicode) {
+        if (--p.unicode == 0) jsonPutChar(p, '?');   // hors ASCII : remplace
+      } else if (p.escape) {
+        p.escape = false;
+        switch (c) {
+          case 'n': jsonPutChar(p, '\n'); break;
+          case 't': jsonPutChar(p, '\t'); break;
+          case 'r': case 'b': case 'f': break;
+          case 'u': p.unicode = 4; break;
+          default:  jsonPutChar(p, c); break;   // \" \\ \/
+        }
+      } else if (c == '\\') {
+        p.escape = true;
+      } else if (c == '"') {
+        p.inString = false;
+        if (p.readingKey) {
+          p.key[p.klen] = '\0';
+          p.readingKey = false;
+        } else {
+          jsonEmit(p);
+        }
+      } else {
+        jsonPutChar(p, c);
+      }
+      continue;
+    }
+
+    if (p.inScalar) {
+      if (c != ',' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        jsonPutChar(p, c);
+        continue;
+      }
+      p.inScalar = false;
+      jsonEmit(p);
+      // le delimiteur est traite ci-dessous
+    }
+
+    switch (c) {
+      case '{':
+      case '[':
+        if (p.depth >= JSON_MAX_DEPTH) {
+          p.overflow = true;
+          break;
+        }
+        p.stack[p.depth++] = c;
+        if (p.depth == 2 && c == '[') {
+          // le tableau d'une section : la cle qui precede est son nom
+          copyStr(p.section, sizeof(p.section), p.key);
+          p.index = -1;
+        } else if (p.depth == 3 && c == '{') {
+          p.index++;
+        }
+        p.expectKey = (c == '{');
+        break;
+
+      case '}':
+      case ']':
+        if (p.depth == 0) break;
+        if (p.depth == 3 && c == '}' && strcmp(p.section, "STATUS") != 0 && p.onField) {
+          p.onField(p.ctx, p.section, p.index, nullptr, nullptr);
+        }
+        p.depth--;
+        p.expectKey = false;
+        break;
+
+      case ':':
+        p.expectKey = false;
+        break;
+
+      case ',':
+        p.expectKey = (p.depth > 0 && p.stack[p.depth - 1] == '{');
+        break;
+
+      case '"':
+        p.inString = true;
+        if (p.expectKey) {
+          p.readingKey = true;
+          p.klen = 0;
+        } else {
+          jsonBeginValue(p);
+        }
+        break;
+
+      case ' ': case '\t': case '\r': case '\n':
+        break;
+
+      default:   // nombre, true, false, null
+        p.inScalar = true;
+        jsonBeginValue(p);
+        jsonPutChar(p, c);
+        break;
+    }
+  }
+}
+
+static void jsonEnd(CgJsonParser &p) {
+  if (p.inScalar) {
+    p.inScalar = false;
+    jsonEmit(p);
+  }
+}
+
+static bool jsonSink(void *ctx, const char *data, size_t len) {
+  CgJsonParser *p = (CgJsonParser *)ctx;
+  jsonFeed(*p, data, len);
+  return !p->overflow;
+}
+
+// =======================
+// Requetes
+// =======================
+
+static char gReqBuf[96];
+
+static bool cgRequest(const char *command, const char *param,
+                      const char *const *keys, CgFieldFn fn, void *ctx, CgStatus &st) {
+  memset(&st, 0, sizeof(st));
+
+  if (param) {
+    snprintf(gReqBuf, sizeof(gReqBuf), "{\"command\":\"%s\",\"parameter\":\"%s\"}", command, param);
+  } else {
+    snprintf(gReqBuf, sizeof(gReqBuf), "{\"command\":\"%s\"}", command);
+  }
+
+  CgJsonParser p;
+  jsonInit(p, keys, fn, ctx, &st);
+  if (!minerApiRequest(gReqBuf, jsonSink, &p)) return false;
+  jsonEnd(p);
+
+  if (p.overflow) {
+    copyStr(st.msg, sizeof(st.msg), "Reponse trop imbriquee");
+    st.code = 'F';
+    return false;
+  }
+  if (st.code == 0) copyStr(st.msg, sizeof(st.msg), "Reponse sans STATUS");
+  return st.code == 'S' || st.code == 'I';
+}
+
+// Ecriture ascset : le miner repond parfois STATUS=I avec un message d'echec
+static bool cgAscset(const char *param, CgStatus &st) {
+  if (!cgRequest("ascset", param, nullptr, nullptr, nullptr, st)) return false;
+  if (st.code == 'S') return true;
+  return strstr(st.msg, "success") != nullptr;
+}
+
+static bool truthy(const char *v) {
+  return v[0] == 't' || v[0] == 'T' || v[0] == 'Y' || v[0] == '1';
+}
+
+// =======================
+// pools
+// =======================
+
+static const char *const POOL_KEYS[] = {
+  "POOL", "URL", "User", "Status", "Priority", "Stratum Active",
+  "Accepted", "Rejected", "Stale", "Get Failures", "Remote Failures",
+  "Last Share Time", nullptr
+};
+
+struct PoolCtx {
+  CgPool *out;
+  uint8_t max;
+  uint8_t count;
+};
+
+static void poolField(void *ctx, const char *section, int8_t index, const char *key, const char *val) {
+  PoolCtx *c = (PoolCtx *)ctx;
+  if (strcmp(section, "POOLS") != 0 || index < 0 || index >= c->max) return;
+
+  CgPool &pl = c->out[index];
+  if (!key) {
+    if (index + 1 > c->count) c->count = index + 1;
+    return;
+  }
+
+  if      (strcmp(key, "POOL") == 0)            pl.index = (int8_t)atoi(val);
+  else if (strcmp(key, "URL") == 0)             copyStr(pl.url, sizeof(pl.url), val);
+  else if (strcmp(key, "User") == 0)            copyStr(pl.user, sizeof(pl.user), val);
+  else if (strcmp(key, "Status") == 0)          copyStr(pl.status, sizeof(pl.status), val);
+  else if (strcmp(key, "Priority") == 0)        pl.priority = (int8_t)atoi(val);
+  else if (strcmp(key, "Stratum Active") == 0)  pl.stratumActive = truthy(val);
+  else if (strcmp(key, "Accepted") == 0)        pl.accepted = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Rejected") == 0)        pl.rejected = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Stale") == 0)           pl.stale = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Get Failures") == 0)    pl.getFailures = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Remote Failures") == 0) pl.remoteFailures = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Last Share Time") == 0) pl.lastShareTime = strtoul(val, nullptr, 10);
+}
+
+bool cgPools(CgPool *out, uint8_t max, uint8_t &count, CgStatus &st) {
+  memset(out, 0, sizeof(CgPool) * max);
+  PoolCtx c = { out, max, 0 };
+  bool ok = cgRequest("pools", nullptr, POOL_KEYS, poolField, &c, st);
+  count = c.count;
+  return ok;
+}
+
+// =======================
+// devs / edevs
+// =======================
+
+static const char *const DEV_KEYS[] = {
+  "ASC", "Name", "Enabled", "Status", "Temperature", "MHS av", "MHS 5s",
+  "Accepted", "Rejected", "Hardware Errors", "Device Elapsed", nullptr
+};
+
+struct DevCtx {
+  CgDevice *out;
+  uint8_t   max;
+  uint8_t   count;
+};
+
+static void devField(void *ctx, const char *section, int8_t index, const char *key, const char *val) {
+  DevCtx *c = (DevCtx *)ctx;
+  if (strcmp(section, "DEVS") != 0 || index < 0 || index >= c->max) return;
+
+  CgDevice &d = c->out[index];
+  if (!key) {
+    if (index + 1 > c->count) c->count = index + 1;
+    return;
+  }
+
+  if      (strcmp(key, "ASC") == 0)             d.index = (int8_t)atoi(val);
+  else if (strcmp(key, "Name") == 0)            copyStr(d.name, sizeof(d.name), val);
+  else if (strcmp(key, "Enabled") == 0)         d.enabled = truthy(val);
+  else if (strcmp(key, "Status") == 0)          copyStr(d.status, sizeof(d.status), val);
+  else if (strcmp(key, "Temperature") == 0)     d.temperature = strtof(val, nullptr);
+  else if (strcmp(key, "MHS av") == 0)          d.mhsAv = strtof(val, nullptr);
+  else if (strcmp(key, "MHS 5s") == 0)          d.mhs5s = strtof(val, nullptr);
+  else if (strcmp(key, "Accepted") == 0)        d.accepted = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Rejected") == 0)        d.rejected = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Hardware Errors") == 0) d.hwErrors = strtoul(val, nullptr, 10);
+  else if (strcmp(key, "Device Elapsed") == 0)  d.elapsed = strtoul(val, nullptr, 10);
+}
+
+static bool cgDevList(const char *command, CgDevice *out, uint8_t max, uint8_t &count, CgStatus &st) {
+  memset(out, 0, sizeof(CgDevice) * max);
+  DevCtx c = { out, max, 0 };
+  bool ok = cgRequest(command, nullptr, DEV_KEYS, devField, &c, st);
+  count = c.count;
+  return ok;
+}
+
+bool cgDevs(CgDevice *out, uint8_t max, uint8_t &count, CgStatus &st) {
+  return cgDevList("devs", out, max, count, st);
+}
+
+bool cgEdevs(CgDevice *out, uint8_t max, uint8_t &count, CgStatus &st) {
+  return cgDevList("edevs", out, max, count, st);
+}
+
+// =======================
+// Ecritures
+// =======================
+
+bool cgSwitchPool(uint8_t pool, CgStatus &st) {
+  char param[8];
+  snprintf(param, sizeof(param), "%u", pool);
+  return cgRequest("switchpool", param, nullptr, nullptr, nullptr, st);
+}
+
+bool cgAscsetWorkMode(uint8_t mode, CgStatus &st) {
+  if (mode > 2) {
+    memset(&st, 0, sizeof(st));
+    copyStr(st.msg, sizeof(st.msg), "Mode inconnu");
+    return false;
+  }
+  char param[24];
+  snprintf(param, sizeof(param), "0,workmode,set,%u", mode);
+  return cgRequest("ascset", param, nullptr, nullptr, nullptr, st) && st.code == 'S';
+}
+
+bool cgAscsetSoft(bool on, uint32_t ts, CgStatus &st) {
+  const char *what = on ? "softon" : "softoff";
+  char param[32];
+  snprintf(param, sizeof(param), "0,%s,1:%u", what, (unsigned)ts);
+  if (!cgRequest("ascset", param, nullptr, nullptr, nullptr, st)) return false;
+
+  // ex: "ASC 0 set info: success softoff:1700000000"
+  char expect[24];
+  snprintf(expect, sizeof(expect), "success %s:", what);
+  return strstr(st.msg, expect) != nullptr;
+}
+
+bool cgAscsetFan(int8_t pct, CgStatus &st) {
+  if (pct != -1 && (pct < 15 || pct > 100)) {
+    memset(&st, 0, sizeof(st));
+    copyStr(st.msg, sizeof(st.msg), "Vitesse ventilateur hors plage");
+    return false;
+  }
+  char param[24];
+  snprintf(param, sizeof(param), "0,fan-spd,%d", pct);
+  return cgAscset(param, st);
+}
+
+bool cgAscsetVoltage(uint16_t mv, CgStatus &st) {
+  char param[24];
+  snprintf(param, sizeof(param), "0,voltage,%u", mv);
+  return cgAscset(param, st);
+}
+
+bool cgAscsetLed(bool on, CgStatus &st) {
+  return cgAscset(on ? "0,led,1-1" : "0,led,1-0", st);
+}
+
+bool cgAscsetReboot(CgStatus &st) {
+  return cgAscset("0,reboot,0", st);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+
+// Client type de l'API JSON cgminer / Avalon (port 4028).
+// Requete {"command":"...","parameter":"..."} ; la reponse est lue par
+// morceaux et passe dans un parseur SAX qui ne garde que les champs
+// demandes : pas de DOM, quelques centaines d'octets quelle que soit la
+// taille de la reponse.
+
+// Bloc STATUS de toute reponse
+struct CgStatus {
+  char     code;        // 'S' succes, 'I' info, 'W', 'E', 'F' ; 0 = pas de reponse
+  uint16_t num;         // Code
+  char     msg[80];     // Msg (tronque)
+};
+
+const uint8_t CG_MAX_POOLS = 4;
+const uint8_t CG_MAX_DEVS  = 4;
+
+struct CgPool {
+  int8_t   index;           // POOL
+  char     url[96];
+  char     user[48];
+  char     status[12];      // "Alive" / "Dead" / "Disabled" ...
+  int8_t   priority;
+  bool     stratumActive;
+  uint32_t accepted;
+  uint32_t rejected;
+  uint32_t stale;
+  uint32_t getFailures;
+  uint32_t remoteFailures;
+  uint32_t lastShareTime;   // epoch du dernier share (0 = jamais)
+};
+
+struct CgDevice {
+  int8_t   index;           // ASC
+  char     name[8];
+  bool     enabled;
+  char     status[12];      // "Alive" / "Sick" / "Dead" ...
+  float    temperature;
+  float    mhsAv;
+  float    mhs5s;
+  uint32_t accepted;
+  uint32_t rejected;
+  uint32_t hwErrors;
+  uint32_t elapsed;         // Device Elapsed (s)
+};
+
+// Lectures : false si pas de reponse ou STATUS en erreur.
+// count = nombre d'entrees remplies (au plus max).
+bool cgPools(CgPool *out, uint8_t max, uint8_t &count, CgStatus &st);
+bool cgDevs(CgDevice *out, uint8_t max, uint8_t &count, CgStatus &st);
+bool cgEdevs(CgDevice *out, uint8_t max, uint8_t &count, CgStatus &st);   // devices actifs seulement
+
+// Ecritures : true si le miner a accepte (STATUS S ou I sans erreur).
+bool cgSwitchPool(uint8_t pool, CgStatus &st);
+bool cgAscsetWorkMode(uint8_t mode, CgStatus &st);                // 0=eco, 1=standard, 2=super
+bool cgAscsetSoft(bool on, uint32_t ts, CgStatus &st);             // softon / softoff a ts
+bool cgAscsetFan(int8_t pct, CgStatus &st);                        // 15..100, -1 = auto
+bool cgAscsetVoltage(uint16_t mv, CgStatus &st);
+bool cgAscsetLed(bool on, CgStatus &st);
+bool cgAscsetReboot(CgStatus &st);
@@ -0,0 +1,267 @@
+#include "cmdqueue.h"
+
+#include <time.h>
+
+#include "miner.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+const uint8_t  CMD_SLOTS            = 8;       // commandes en cours + historique recent
+const uint8_t  CMD_MAX_ATTEMPTS     = 3;       // envois avant abandon
+const uint32_t CMD_RETRY_MS         = 2000;    // entre deux envois rates
+const uint32_t CMD_CONFIRM_DELAY_MS = 3000;    // premiere relecture apres envoi
+const uint32_t CMD_CONFIRM_EVERY_MS = 3000;    // relectures suivantes
+const uint32_t CMD_CONFIRM_MODE_MS  = 30000;   // delai max de confirmation d'un mode
+const uint32_t CMD_CONFIRM_POWER_MS = 120000;  // softon : les cartes mettent du temps
+const uint32_t CMD_POWER_AFTER_S    = 5;       // ecart apres une veille/reveil deja programme
+
+struct CmdSlot {
+  CmdInfo  info;
+  uint32_t dueMs;        // prochaine action (envoi ou relecture)
+  uint32_t deadlineMs;   // fin de la fenetre de confirmation
+};
+
+static CmdSlot  gSlots[CMD_SLOTS];
+static uint32_t gNextId = 1;
+
+// mode et veille/reveil sont deux "natures" independantes
+static bool sameKind(CmdType a, CmdType b) {
+  bool powerA = (a == CMD_STANDBY || a == CMD_WAKEUP);
+  bool powerB = (b == CMD_STANDBY || b == CMD_WAKEUP);
+  return powerA == powerB;
+}
+
+// Commande plus recente de meme nature encore valable (0 = aucune) : une
+// commande remplacee ou en echec n'a rien change sur le miner
+static uint32_t newerOfKind(const CmdSlot &s) {
+  uint32_t newer = 0;
+  for (uint8_t i = 0; i < CMD_SLOTS; i++) {
+    const CmdInfo &o = gSlots[i].info;
+    if (o.id <= s.info.id || o.state == CMD_SUPERSEDED || o.state == CMD_FAILED) continue;
+    if (sameKind(o.type, s.info.type) && o.id > newer) newer = o.id;
+  }
+  return newer;
+}
+
+static void finish(CmdSlot &s, CmdState state, const String &detail) {
+  s.info.state  = state;
+  s.info.doneMs = millis();
+  s.info.detail = detail;
+
+  LOG_I("cmd", "#%u %s %s -> %s %s",
+                (unsigned)s.info.id, cmdTypeLabel(s.info.type), s.info.arg.c_str(),
+                cmdStateLabel(state), detail.c_str());
+
+  char text[28];
+  snprintf(text, sizeof(text), "#%u %s", (unsigned)s.info.id,
+           detail.length() ? detail.c_str() : cmdStateLabel(state));
+  journalLog(JE_CMD_DONE, (JournalSource)s.info.source, state, text);
+}
+
+// Slot libre, sinon la plus ancienne commande terminee
+static CmdSlot *allocSlot() {
+  CmdSlot *oldest = nullptr;
+  for (uint8_t i = 0; i < CMD_SLOTS; i++) {
+    CmdSlot &s = gSlots[i];
+    if (s.info.id == 0) return &s;
+    if (cmdStateIsFinal(s.info.state) &&
+        (!oldest || s.info.id < oldest->info.id)) {
+      oldest = &s;
+    }
+  }
+  return oldest;
+}
+
+// =======================
+// Execution
+// =======================
+
+static void sendCommand(CmdSlot &s) {
+  uint32_t now = millis();
+  s.info.attempts++;
+
+  bool ok = false;
+  String resp;
+
+  if (s.info.type == CMD_MODE) {
+    resp = minerSendMode(s.info.arg, ok);
+  } else {
+    uint32_t ts = s.info.ts;
+    uint32_t epoch = (uint32_t)time(nullptr);
+    if (ts == 0 || ts <= epoch) ts = epoch + 5;   // dans 5 secondes
+    s.info.ts = ts;
+
+    if (s.info.type == CMD_STANDBY) resp = minerSetStandby(ts, ok);
+    else                            resp = minerSetWakeup(ts, ok);
+  }
+
+  now = millis();
+  if (ok) {
+    s.info.state = CMD_SENT;
+    uint32_t wait = CMD_CONFIRM_DELAY_MS;
+    if (s.info.type != CMD_MODE) {
+      // pas la peine de relire avant l'heure demandee au miner
+      uint32_t epoch = (uint32_t)time(nullptr);
+      if (s.info.ts > epoch) wait += (s.info.ts - epoch) * 1000UL;
+    }
+    s.dueMs      = now + wait;
+    s.deadlineMs = s.dueMs + (s.info.type == CMD_MODE ? CMD_CONFIRM_MODE_MS
+                                                      : CMD_CONFIRM_POWER_MS);
+    return;
+  }
+
+  String why = minerGetStatus().lastError;
+  if (why.length() == 0) why = resp.length() > 0 ? resp : String("Aucune reponse");
+
+  if (s.info.type == CMD_MODE && why == "Mode inconnu.") {
+    finish(s, CMD_FAILED, why);   // inutile d'insister
+  } else if (s.info.attempts >= CMD_MAX_ATTEMPTS) {
+    finish(s, CMD_FAILED, why);
+  } else {
+    s.info.detail = why;
+    s.dueMs = now + CMD_RETRY_MS;
+  }
+}
+
+static void confirmCommand(CmdSlot &s) {
+  String mode;
+  bool active = false;
+  bool stateKnown = false;
+  bool read = minerReadState(mode, active, stateKnown);
+
+  bool confirmed = false;
+  if (read) {
+    if (s.info.type == CMD_MODE) {
+      String want = (s.info.arg == "normal") ? String("standard") : s.info.arg;
+      confirmed = (mode == want);
+    } else if (s.info.type == CMD_STANDBY) {
+      confirmed = stateKnown && !active;   // sans SYSTEMSTATU, rien de prouve
+    } else {
+      confirmed = stateKnown && active;
+    }
+  }
+
+  uint32_t now = millis();
+  bool known = (s.info.type == CMD_MODE) ? mode.length() > 0 : stateKnown;
+  uint32_t newer = read && known && !confirmed ? newerOfKind(s) : 0;
+  if (confirmed) {
+    finish(s, CMD_CONFIRMED, "");
+    minerPollNow();   // le dashboard doit refleter le nouvel etat
+  } else if (newer) {
+    // envoyee puis contredite par une demande plus recente : pas un echec
+    finish(s, CMD_SUPERSEDED, "Remplacee par #" + String(newer));
+  } else if ((int32_t)(now - s.deadlineMs) >= 0) {
+    finish(s, CMD_FAILED, read ? "Etat non confirme par estats" : "Relecture estats impossible");
+    minerPollNow();
+  } else {
+    s.dueMs = now + CMD_CONFIRM_EVERY_MS;
+  }
+}
+
+// =======================
+// API publique
+// =======================
+
+uint32_t cmdQueueSubmit(CmdType type, const String &arg, uint32_t ts, bool urgent,
+                        JournalSource source) {
+  // Coalescence : la derniere demande l'emporte. Seule une commande pas
+  // encore envoyee peut etre retiree ; une commande acceptee par le miner
+  // reste suivie jusqu'a sa confirmation.
+  uint32_t epoch = (uint32_t)time(nullptr);
+  for (uint8_t i = 0; i < CMD_SLOTS; i++) {
+    CmdSlot &s = gSlots[i];
+    if (s.info.id == 0 || cmdStateIsFinal(s.info.state)) continue;
+    if (!sameKind(s.info.type, type)) continue;
+    if (s.info.state == CMD_PENDING) {
+      finish(s, CMD_SUPERSEDED, "Remplacee par #" + String(gNextId));
+    } else if (type != CMD_MODE && s.info.type != type && s.info.ts > epoch) {
+      // veille/reveil deja programme sur le miner (planning : 60 s
+      // d'avance) : la commande contraire passe juste apres, sinon le
+      // miner executerait l'ancienne a son heure
+      uint32_t after = s.info.ts + CMD_POWER_AFTER_S;
+      if (ts < after) ts = after;
+    }
+  }
+
+  CmdSlot *s = allocSlot();
+  if (!s) return 0;
+
+  *s = CmdSlot();
+  s->info.id        = gNextId++;
+  s->info.type      = type;
+  s->info.state     = CMD_PENDING;
+  s->info.arg       = arg;
+  s->info.ts        = ts;
+  s->info.urgent    = urgent;
+  s->info.source    = source;
+  s->info.createdMs = millis();
+  s->dueMs          = s->info.createdMs;
+
+  LOG_I("cmd", "#%u %s %s en file%s",
+                (unsigned)s->info.id, cmdTypeLabel(type), arg.c_str(),
+                urgent ? " (urgente)" : "");
+
+  char text[28];
+  snprintf(text, sizeof(text), "#%u %s %s", (unsigned)s->info.id, cmdTypeLabel(type), arg.c_str());
+  journalLog(JE_CMD_SUBMIT, source, type, text);
+  return s->info.id;
+}
+
+bool cmdQueueGet(uint32_t id, CmdInfo &out) {
+  if (id == 0) return false;
+  for (uint8_t i = 0; i < CMD_SLOTS; i++) {
+    if (gSlots[i].info.id == id) {
+      out = gSlots[i].info;
+      return true;
+    }
+  }
+  return false;
+}
+
+void cmdQueueLoop() {
+  // Une seule action par tour pour ne pas monopoliser loop()
+  uint32_t now = millis();
+  CmdSlot *next = nullptr;
+
+  for (uint8_t i = 0; i < CMD_SLOTS; i++) {
+    CmdSlot &s = gSlots[i];
+    if (s.info.id == 0 || cmdStateIsFinal(s.info.state)) continue;
+    if ((int32_t)(now - s.dueMs) < 0) continue;
+    if (!next ||
+        (s.info.urgent && !next->info.urgent) ||
+        (s.info.urgent == next->info.urgent && s.info.id < next->info.id)) {
+      next = &s;
+    }
+  }
+  if (!next) return;
+
+  if (next->info.state == CMD_PENDING) sendCommand(*next);
+  else                                 confirmCommand(*next);
+}
+
+const char* cmdTypeLabel(CmdType type) {
+  switch (type) {
+    case CMD_MODE:    return "mode";
+    case CMD_STANDBY: return "standby";
+    case CMD_WAKEUP:  return "wakeup";
+  }
+  return "?";
+}
+
+const char* cmdStateLabel(CmdState state) {
+  switch (state) {
+    case CMD_PENDING:    return "pending";
+    case CMD_SENT:       return "sent";
+    case CMD_CONFIRMED:  return "confirmed";
+    case CMD_FAILED:     return "failed";
+    case CMD_SUPERSEDED: return "superseded";
+  }
+  return "?";
+}
+
+bool cmdStateIsFinal(CmdState state) {
+  return state == CMD_CONFIRMED || state == CMD_FAILED || state == CMD_SUPERSEDED;
+}
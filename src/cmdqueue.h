@@ -0,0 +1,52 @@
+#pragma once
+#include <Arduino.h>
+#include "journal.h"
+
+// File de commandes d'ecriture vers le miner (mode, veille, reveil).
+// Les handlers HTTP deposent une commande et repondent tout de suite avec
+// son ID ; cmdQueueLoop() l'execute depuis loop() puis la confirme en
+// relisant WORKMODE / SYSTEMSTATU dans estats.
+
+enum CmdType : uint8_t {
+  CMD_MODE = 0,     // arg = "eco" / "standard" / "super"
+  CMD_STANDBY,      // softoff
+  CMD_WAKEUP,       // softon
+};
+
+enum CmdState : uint8_t {
+  CMD_PENDING = 0,  // en file, pas encore envoyee
+  CMD_SENT,         // acceptee par le miner, en attente de confirmation
+  CMD_CONFIRMED,    // etat relu dans estats
+  CMD_FAILED,       // refusee, injoignable ou jamais confirmee
+  CMD_SUPERSEDED,   // remplacee par une commande plus recente
+};
+
+struct CmdInfo {
+  uint32_t id;          // 0 = slot libre
+  CmdType  type;
+  CmdState state;
+  String   arg;         // mode demande (CMD_MODE)
+  uint32_t ts;          // horodatage softoff/softon (0 = maintenant + 5s)
+  uint32_t createdMs;
+  uint32_t doneMs;      // millis() de l'etat final (0 si en cours)
+  uint8_t  attempts;    // envois tentes
+  bool     urgent;      // passe devant les autres (delestage)
+  uint8_t  source;      // JournalSource : qui a demande
+  String   detail;      // message d'erreur / info
+};
+
+// Depose une commande, renvoie son ID (0 = file pleine).
+// Une commande de meme nature pas encore envoyee est remplacee ; une
+// commande deja acceptee par le miner reste suivie, et une veille/reveil
+// qu'il a programmee pour plus tard est suivie de la commande contraire.
+// urgent = executee avant toute autre commande due (delestage puissance).
+// source = origine inscrite au journal.
+uint32_t cmdQueueSubmit(CmdType type, const String &arg, uint32_t ts = 0, bool urgent = false,
+                        JournalSource source = JSRC_WEB);
+
+bool cmdQueueGet(uint32_t id, CmdInfo &out);   // false si ID inconnu / expire
+void cmdQueueLoop();                           // a appeler dans loop()
+
+const char* cmdTypeLabel(CmdType type);
+const char* cmdStateLabel(CmdState state);
+bool cmdStateIsFinal(CmdState state);
@@ -50,8 +50,7 @@ void displayShowBoot() {
 
   // Affichage du logo KON8
   tft.pushImage(x, y, KON8_W, KON8_H, kon8_logo);
-
-  delay(1000); // afficher le logo 1.5 sec
+  // pas d'attente : au boot le logo reste affiche pendant la connexion WiFi
 }
 
 void displayShowAPInfo(IPAddress ip) {
@@ -301,3 +300,21 @@ void displayShowOtaStatus(const String &line1, const String &line2) {
     tft.drawString(line2, tft.width() / 2, 80);
   }
 }
+
+void displayShowDebugPage(const String &title, const String *lines, uint8_t count) {
+  tft.fillScreen(TFT_BLACK);
+
+  tft.setTextDatum(TC_DATUM);
+  tft.setTextColor(TFT_MAGENTA, TFT_BLACK);
+  tft.setTextSize(2);
+  tft.drawString(title, tft.width() / 2, 2);
+
+  tft.setTextDatum(TL_DATUM);
+  tft.setTextSize(1);
+  tft.setTextColor(TFT_WHITE, TFT_BLACK);
+  for (uint8_t i = 0; i < count; i++) {
+    int16_t y = 24 + i * 10;
+    if (y + 8 > tft.height()) break;
+    tft.drawString(lines[i], 2, y);
+  }
+}
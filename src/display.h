@@ -33,3 +33,6 @@ void displayShowResetCountdown(uint8_t seconds);
 void displayShowOtaStatus(const String &line1, const String &line2);
 
 
+
+// Page cachee de diagnostic : titre + lignes de texte en petite police
+void displayShowDebugPage(const String &title, const String *lines, uint8_t count);
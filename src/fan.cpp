@@ -0,0 +1,239 @@
+#include "fan.h"
+
+#include <Preferences.h>
+#include <time.h>
+
+#include "miner.h"
+#include "cgapi.h"
+#include "journal.h"
+#include "logger.h"
+
+// --- mesures DHT venant de main.cpp ---
+extern float gTempC;
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences fanPrefs;
+
+static FanConfig gCfg   = { false, 16.0f, 26.0f, 75.0f, 88.0f, 92.0f, 25, 100, 10, 60 };
+static FanStats  gStats = { -1, -1, false, 0, 0, 0 };
+
+const uint8_t FAN_PCT_MIN      = 15;    // plancher accepte par fan-spd
+const float   FAN_SAFETY_HYST  = 5.0f;  // sortie de surchauffe sous safetyC - 5
+const uint8_t FAN_DEADBAND_PCT = 3;     // on ne bouge pas pour moins
+
+static uint32_t    gLastOkMs = 0;       // detection d'un nouveau status miner
+static uint32_t    gLastAttemptMs = 0;  // limitation : reussi ou non
+static bool        gWasEnabled = false;
+static FanLogEntry gLog[FAN_LOG_SIZE];
+static uint8_t     gLogHead  = 0;
+static uint8_t     gLogCount = 0;
+
+static float lerpPct(float x, float x0, float x1, float y0, float y1) {
+  if (x1 <= x0) return x >= x1 ? y1 : y0;
+  if (x <= x0) return y0;
+  if (x >= x1) return y1;
+  return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+}
+
+// vitesse voulue : la plus forte des deux courbes (ambiance, puces)
+static int8_t curvePct(float ambient, float chip) {
+  float pct = gCfg.minPct;
+  if (!isnan(ambient)) pct = lerpPct(ambient, gCfg.ambLowC, gCfg.ambHighC, gCfg.minPct, gCfg.maxPct);
+  if (!isnan(chip)) {
+    float p = lerpPct(chip, gCfg.chipLowC, gCfg.chipHighC, gCfg.minPct, gCfg.maxPct);
+    if (p > pct) pct = p;
+  }
+  return (int8_t)(pct + 0.5f);
+}
+
+static void logChange(int8_t pct, float ambient, float chip, FanReason reason, bool ok) {
+  FanLogEntry &e = gLog[gLogHead];
+  time_t now = time(nullptr);
+  e.epoch    = now > 1600000000 ? (uint32_t)now : 0;
+  e.pct      = pct;
+  e.ambientC = ambient;
+  e.chipC    = chip;
+  e.reason   = reason;
+  e.ok       = ok;
+  gLogHead = (gLogHead + 1) % FAN_LOG_SIZE;
+  if (gLogCount < FAN_LOG_SIZE) gLogCount++;
+
+  LOG_I("fan", "%d%% (%s, ambiance %.1f C, puces %.0f C)%s",
+                pct, fanReasonLabel(reason), ambient, chip, ok ? "" : " REFUSE");
+}
+
+static bool applyPct(int8_t pct, float ambient, float chip, FanReason reason, uint32_t now) {
+  gLastAttemptMs = now;
+  CgStatus st;
+  bool ok = cgAscsetFan(pct, st);
+  logChange(pct, ambient, chip, reason, ok);
+  if (!ok) {
+    gStats.errors++;
+    return false;
+  }
+  gStats.pct = pct;
+  gStats.changes++;
+  gStats.lastChangeMs = now;
+  return true;
+}
+
+static void evaluate(uint32_t now) {
+  MinerStatus st = minerGetStatus();
+  float ambient = gTempC;
+  float chip    = st.tempMax;
+
+  // pas de temperature puces : on laisse le miner se proteger lui-meme
+  if (isnan(chip)) {
+    if (gStats.pct != -1 &&
+        (gLastAttemptMs == 0 || now - gLastAttemptMs >= gCfg.minIntervalSec * 1000UL)) {
+      applyPct(-1, ambient, chip, FAN_R_AUTO, now);
+    }
+    gStats.targetPct = -1;
+    return;
+  }
+
+  // surchauffe : plein regime tout de suite, sans limitation
+  if (chip >= gCfg.safetyC) {
+    gStats.targetPct = 100;
+    if (!gStats.safety || gStats.pct != 100) {
+      if (applyPct(100, ambient, chip, FAN_R_SAFETY, now) && !gStats.safety) {
+        gStats.safety = true;
+        journalLog(JE_FAN_SAFETY, JSRC_FAN, (int16_t)chip, "ventilation 100%");
+      }
+    }
+    return;
+  }
+  bool release = false;
+  if (gStats.safety) {
+    if (chip > gCfg.safetyC - FAN_SAFETY_HYST) return;
+    gStats.safety = false;
+    release = true;
+  }
+
+  int8_t target = curvePct(ambient, chip);
+  gStats.targetPct = target;
+
+  // depuis auto : on se place directement sur la courbe
+  if (gStats.pct < 0) {
+    if (gLastAttemptMs == 0 || now - gLastAttemptMs >= gCfg.minIntervalSec * 1000UL) {
+      applyPct(target, ambient, chip, FAN_R_CURVE, now);
+    }
+    return;
+  }
+
+  if (!release) {
+    if (abs(target - gStats.pct) < FAN_DEADBAND_PCT) return;
+    if (gLastAttemptMs != 0 && now - gLastAttemptMs < gCfg.minIntervalSec * 1000UL) return;
+  }
+
+  // pas maxi par changement
+  int8_t next = target;
+  if (next > gStats.pct + gCfg.stepPct) next = gStats.pct + gCfg.stepPct;
+  if (next < gStats.pct - gCfg.stepPct) next = gStats.pct - gCfg.stepPct;
+  if (next == gStats.pct) return;
+
+  applyPct(next, ambient, chip, release ? FAN_R_RELEASE : FAN_R_CURVE, now);
+}
+
+// =======================
+// API publique
+// =======================
+
+void fanInit() {
+  fanPrefs.begin("fan", true);
+  gCfg.enabled        = fanPrefs.getBool("enabled", false);
+  gCfg.ambLowC        = fanPrefs.getFloat("ambLow", 16.0f);
+  gCfg.ambHighC       = fanPrefs.getFloat("ambHigh", 26.0f);
+  gCfg.chipLowC       = fanPrefs.getFloat("chipLow", 75.0f);
+  gCfg.chipHighC      = fanPrefs.getFloat("chipHigh", 88.0f);
+  gCfg.safetyC        = fanPrefs.getFloat("safety", 92.0f);
+  gCfg.minPct         = fanPrefs.getUChar("minPct", 25);
+  gCfg.maxPct         = fanPrefs.getUChar("maxPct", 100);
+  gCfg.stepPct        = fanPrefs.getUChar("step", 10);
+  gCfg.minIntervalSec = fanPrefs.getUShort("interval", 60);
+  fanPrefs.end();
+}
+
+void fanLoop() {
+  // un calcul par nouveau status miner (temperatures puces fraiches)
+  MinerPollState ps = minerGetPollState();
+  if (ps.lastOkMs == 0 || ps.lastOkMs == gLastOkMs) return;
+  gLastOkMs = ps.lastOkMs;
+
+  uint32_t now = millis();
+
+  if (!gCfg.enabled) {
+    // desactive : on rend la main au miner une fois
+    gStats.safety = false;
+    if (gWasEnabled && gStats.pct != -1) {
+      if (applyPct(-1, gTempC, NAN, FAN_R_AUTO, now)) gWasEnabled = false;
+    } else {
+      gWasEnabled = false;
+    }
+    return;
+  }
+  gWasEnabled = true;
+
+  evaluate(now);
+}
+
+FanConfig fanGetConfig() {
+  return gCfg;
+}
+
+void fanSetConfig(const FanConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.minPct < FAN_PCT_MIN) gCfg.minPct = FAN_PCT_MIN;
+  if (gCfg.maxPct > 100) gCfg.maxPct = 100;
+  if (gCfg.minPct > gCfg.maxPct) gCfg.minPct = gCfg.maxPct;
+  if (gCfg.stepPct < 1) gCfg.stepPct = 1;
+
+  fanPrefs.begin("fan", false);
+  fanPrefs.putBool("enabled", gCfg.enabled);
+  fanPrefs.putFloat("ambLow", gCfg.ambLowC);
+  fanPrefs.putFloat("ambHigh", gCfg.ambHighC);
+  fanPrefs.putFloat("chipLow", gCfg.chipLowC);
+  fanPrefs.putFloat("chipHigh", gCfg.chipHighC);
+  fanPrefs.putFloat("safety", gCfg.safetyC);
+  fanPrefs.putUChar("minPct", gCfg.minPct);
+  fanPrefs.putUChar("maxPct", gCfg.maxPct);
+  fanPrefs.putUChar("step", gCfg.stepPct);
+  fanPrefs.putUShort("interval", gCfg.minIntervalSec);
+  fanPrefs.end();
+
+  gLastAttemptMs = 0;   // nouvelle courbe appliquee au prochain status
+}
+
+FanStats fanGetStats() {
+  return gStats;
+}
+
+uint8_t fanLogCount() {
+  return gLogCount;
+}
+
+bool fanLogGet(uint8_t i, FanLogEntry &out) {
+  if (i >= gLogCount) return false;
+  out = gLog[(gLogHead + FAN_LOG_SIZE - 1 - i) % FAN_LOG_SIZE];
+  return true;
+}
+
+const char* fanReasonLabel(uint8_t reason) {
+  switch (reason) {
+    case FAN_R_CURVE:   return "courbe";
+    case FAN_R_SAFETY:  return "securite";
+    case FAN_R_RELEASE: return "fin securite";
+    case FAN_R_AUTO:    return "auto miner";
+  }
+  return "?";
+}
+
+void fanFactoryReset() {
+  fanPrefs.begin("fan", false);
+  fanPrefs.clear();
+  fanPrefs.end();
+  fanInit();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+
+// Courbe de ventilation : la vitesse des ventilateurs (ascset fan-spd) suit
+// la temperature ambiante (DHT) et celle des puces (estats TMax), au lieu
+// du reglage d'usine trop bruyant dans une piece froide.
+// Changements limites en frequence et en amplitude ; au-dela de la
+// temperature de securite des puces, plein regime immediat.
+
+struct FanConfig {
+  bool    enabled;
+  float   ambLowC;      // ambiance <= ambLowC  -> minPct
+  float   ambHighC;     // ambiance >= ambHighC -> maxPct
+  float   chipLowC;     // TMax puces : debut de montee
+  float   chipHighC;    // TMax puces : maxPct
+  float   safetyC;      // TMax puces : 100% sans attendre
+  uint8_t minPct;       // 15..100
+  uint8_t maxPct;
+  uint8_t stepPct;      // variation maxi par changement
+  uint16_t minIntervalSec;   // delai mini entre deux changements
+};
+
+enum FanReason : uint8_t {
+  FAN_R_CURVE = 0,      // suivi de courbe
+  FAN_R_SAFETY,         // surchauffe puces
+  FAN_R_RELEASE,        // fin de surchauffe
+  FAN_R_AUTO,           // rendu au miner (desactive / pas de mesure)
+};
+
+struct FanLogEntry {
+  uint32_t epoch;       // 0 = heure inconnue
+  int8_t   pct;         // -1 = auto miner
+  float    ambientC;
+  float    chipC;
+  uint8_t  reason;      // FanReason
+  bool     ok;          // accepte par le miner
+};
+
+const uint8_t FAN_LOG_SIZE = 16;
+
+struct FanStats {
+  int8_t   pct;           // dernier reglage applique (-1 = auto / inconnu)
+  int8_t   targetPct;     // courbe (avant limitation)
+  bool     safety;        // surchauffe en cours
+  uint32_t changes;
+  uint32_t errors;
+  uint32_t lastChangeMs;  // 0 = jamais
+};
+
+void fanInit();
+void fanLoop();               // a appeler dans loop()
+
+FanConfig fanGetConfig();
+void fanSetConfig(const FanConfig &cfg);
+FanStats fanGetStats();
+
+// Journal des reglages, du plus recent (i = 0) au plus ancien
+uint8_t fanLogCount();
+bool fanLogGet(uint8_t i, FanLogEntry &out);
+const char* fanReasonLabel(uint8_t reason);
+
+void fanFactoryReset();
@@ -0,0 +1,380 @@
+#include "governor.h"
+
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+
+#include "miner.h"
+#include "cmdqueue.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences govPrefs;
+
+static GovConfig gCfg;
+static GovStats  gStats = {};
+
+const int8_t   GOV_LEVEL_MAX        = 3;
+const uint32_t GOV_HTTP_TIMEOUT_MS  = 800;
+const uint32_t GOV_MB_TIMEOUT_MS    = 400;
+const uint32_t GOV_STEP_SETTLE_MS   = 3000;    // entre deux descentes successives
+const uint32_t GOV_RESTORE_HOLD_MS  = 120000;  // sous la limite depuis 2 min avant de remonter
+const uint32_t GOV_STALE_MS         = 10000;   // lecture trop vieille -> on ne decide pas
+
+static uint32_t gLastPollMs      = 0;
+static uint32_t gOverloadSince   = 0;   // 0 = pas de depassement en cours
+static uint32_t gHeadroomSince   = 0;   // 0 = pas assez de marge pour remonter
+static uint32_t gLastStepMs      = 0;
+static uint32_t gShedCmd         = 0;   // descente en attente de confirmation
+static uint32_t gShedStartMs     = 0;   // debut du depassement qui l'a declenchee
+static uint32_t gRestoreCmd      = 0;
+static uint32_t gClampCmd        = 0;   // retour sous le plafond hors depassement
+
+// Puissance miner observee par niveau (PS[]), pour estimer une remontee
+static float    gLevelPowerW[GOV_LEVEL_MAX + 1] = { 0, 0, 0, 0 };
+
+// Connexion Modbus gardee ouverte : evite un handshake TCP a chaque lecture
+static WiFiClient gMbClient;
+static uint16_t   gMbTxId = 0;
+
+// =======================
+// Lecture du compteur
+// =======================
+
+static bool readHttp(float &watts) {
+  WiFiClient client;
+  HTTPClient http;
+  http.setConnectTimeout(GOV_HTTP_TIMEOUT_MS);
+  http.setTimeout(GOV_HTTP_TIMEOUT_MS);
+
+  if (!http.begin(client, gCfg.url)) return false;
+  int code = http.GET();
+  if (code != HTTP_CODE_OK) {
+    http.end();
+    return false;
+  }
+  String body = http.getString();
+  http.end();
+
+  if (gCfg.jsonKey.length() == 0) {
+    body.trim();
+    if (body.length() == 0) return false;
+    watts = body.toFloat() * gCfg.scale;
+    return true;
+  }
+
+  // "cle": 1234.5  (pas besoin d'un parseur JSON pour un seul champ)
+  String pattern = "\"" + gCfg.jsonKey + "\"";
+  int idx = body.indexOf(pattern);
+  if (idx < 0) return false;
+  idx = body.indexOf(':', idx + pattern.length());
+  if (idx < 0) return false;
+  idx++;
+  while (idx < (int)body.length() && (body[idx] == ' ' || body[idx] == '"')) idx++;
+  if (idx >= (int)body.length()) return false;
+
+  watts = body.substring(idx).toFloat() * gCfg.scale;
+  return true;
+}
+
+static bool readModbus(float &watts) {
+  if (!gMbClient.connected()) {
+    gMbClient.stop();
+    if (!gMbClient.connect(gCfg.host.c_str(), gCfg.port, GOV_MB_TIMEOUT_MS)) return false;
+    gMbClient.setNoDelay(true);
+  }
+
+  uint16_t qty = (gCfg.format == GOV_REG_INT32 || gCfg.format == GOV_REG_FLOAT32) ? 2 : 1;
+  uint16_t tx  = ++gMbTxId;
+
+  // MBAP (7 octets) + PDU (5 octets)
+  uint8_t req[12] = {
+    (uint8_t)(tx >> 8), (uint8_t)tx,
+    0, 0,                       // protocole Modbus
+    0, 6,                       // longueur restante
+    gCfg.unitId,
+    gCfg.function,
+    (uint8_t)(gCfg.reg >> 8), (uint8_t)gCfg.reg,
+    (uint8_t)(qty >> 8), (uint8_t)qty
+  };
+  if (gMbClient.write(req, sizeof(req)) != sizeof(req)) {
+    gMbClient.stop();
+    return false;
+  }
+
+  // reponse : MBAP (7) + fonction + nb octets + donnees
+  uint8_t resp[9 + 4];
+  size_t want = 9 + qty * 2;
+  size_t got  = 0;
+  uint32_t deadline = millis() + GOV_MB_TIMEOUT_MS;
+  while (got < want && (int32_t)(millis() - deadline) < 0) {
+    int n = gMbClient.available();
+    if (n > 0) {
+      int r = gMbClient.read(resp + got, want - got);
+      if (r > 0) got += r;
+    } else if (!gMbClient.connected()) {
+      break;
+    } else {
+      delay(1);
+    }
+    // exception Modbus : reponse courte (9 octets)
+    if (got >= 8 && (resp[7] & 0x80)) break;
+  }
+
+  if (got < 9 || resp[0] != req[0] || resp[1] != req[1] || (resp[7] & 0x80) ||
+      resp[8] != qty * 2 || got < want) {
+    gMbClient.stop();   // desynchronise : on repart sur une connexion propre
+    return false;
+  }
+
+  const uint8_t *d = resp + 9;
+  float raw = 0;
+  switch (gCfg.format) {
+    case GOV_REG_INT16:  raw = (int16_t)((d[0] << 8) | d[1]); break;
+    case GOV_REG_UINT16: raw = (uint16_t)((d[0] << 8) | d[1]); break;
+    case GOV_REG_INT32:
+      raw = (float)(int32_t)(((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) |
+                             ((uint32_t)d[2] << 8) | d[3]);
+      break;
+    case GOV_REG_FLOAT32: {
+      uint32_t bits = ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) |
+                      ((uint32_t)d[2] << 8) | d[3];
+      memcpy(&raw, &bits, sizeof(raw));
+      break;
+    }
+  }
+  watts = raw * gCfg.scale;
+  return true;
+}
+
+static void pollMeter(uint32_t now) {
+  float w = NAN;
+  uint32_t t0 = millis();
+  bool ok = (gCfg.source == GOV_SRC_MODBUS) ? readModbus(w) : readHttp(w);
+  uint32_t dt = millis() - t0;
+
+  gStats.readLatencyMs = dt;
+  if (dt > gStats.maxReadLatencyMs) gStats.maxReadLatencyMs = dt;
+
+  if (!ok || isnan(w)) {
+    gStats.readErrors++;
+    return;
+  }
+  gStats.houseW     = w;
+  gStats.lastReadMs = now;
+}
+
+// =======================
+// Decision
+// =======================
+
+static uint32_t submitLevel(int8_t from, int8_t to) {
+  if (to == 0)   return cmdQueueSubmit(CMD_STANDBY, "", 0, true, JSRC_GOVERNOR);
+  if (from == 0) return cmdQueueSubmit(CMD_WAKEUP, "", 0, true, JSRC_GOVERNOR);
+  return cmdQueueSubmit(CMD_MODE, minerLevelMode(to), 0, true, JSRC_GOVERNOR);
+}
+
+// suivi de la descente en cours : le temps de reaction s'arrete a la confirmation
+static void trackShed(uint32_t now) {
+  if (!gShedCmd) return;
+  CmdInfo c;
+  c.state = CMD_FAILED;   // ID expire de la file : rien a mesurer
+  if (cmdQueueGet(gShedCmd, c) && !cmdStateIsFinal(c.state)) return;
+
+  if (c.state == CMD_CONFIRMED) {
+    uint32_t reaction = now - gShedStartMs;
+    gStats.lastReactionMs = reaction;
+    if (reaction > gStats.maxReactionMs) gStats.maxReactionMs = reaction;
+    if (reaction > gCfg.targetMs) gStats.missedTarget++;
+    LOG_I("gov", "Delestage confirme en %u ms", (unsigned)reaction);
+  }
+  gShedCmd = 0;
+}
+
+static void decide(uint32_t now) {
+  MinerStatus st = minerGetStatus();
+  int8_t level = minerStatusLevel(st);
+  if (level < 0) return;
+
+  // apprend la puissance miner de chaque niveau
+  float minerW = st.power.toFloat();
+  if (level > 0 && minerW > 0) {
+    float &lp = gLevelPowerW[level];
+    lp = (lp == 0) ? minerW : lp * 0.8f + minerW * 0.2f;
+  }
+
+  float house = gStats.houseW;
+  gStats.overload = house > gCfg.limitW;
+
+  if (gStats.overload) {
+    gHeadroomSince = 0;
+    if (gOverloadSince == 0) gOverloadSince = now;
+
+    if (level == 0 || gShedCmd) return;                 // deja au plus bas / en cours
+    if (now - gLastStepMs < GOV_STEP_SETTLE_MS) return; // laisse le compteur suivre
+
+    // un miner deja au-dessus du plafond ne doit pas le relever
+    int8_t target = level - 1;
+    if (target > gStats.cap) target = gStats.cap;
+    uint32_t id = submitLevel(level, target);
+    if (id == 0) return;
+
+    LOG_I("gov", "%.0f W > %u W : %d -> %d, commande #%u",
+                  house, (unsigned)gCfg.limitW, level, target, (unsigned)id);
+    gStats.cap = target;
+    gStats.sheds++;
+    gShedCmd     = id;
+    gShedStartMs = gOverloadSince;
+    gLastStepMs  = now;
+    return;
+  }
+
+  gOverloadSince = 0;
+
+  // Miner au-dessus du plafond (commande manuelle, autre automatisme) : on
+  // l'y ramene sans attendre un depassement
+  if (level > gStats.cap) {
+    gHeadroomSince = 0;
+    if (gShedCmd || now - gLastStepMs < GOV_STEP_SETTLE_MS) return;
+    if (gClampCmd) {
+      CmdInfo c;
+      if (cmdQueueGet(gClampCmd, c) && !cmdStateIsFinal(c.state)) return;
+    }
+    gClampCmd   = submitLevel(level, gStats.cap);
+    gLastStepMs = now;
+    LOG_I("gov", "Miner au-dessus du plafond : %d -> %d", level, gStats.cap);
+    return;
+  }
+
+  if (gStats.cap >= GOV_LEVEL_MAX) return;
+
+  // Remontee : il faut de la marge pour le cran suivant, pendant un moment
+  int8_t next = gStats.cap + 1;
+  float  extra = gLevelPowerW[next] - (level > 0 ? gLevelPowerW[level] : 0);
+  if (gLevelPowerW[next] == 0) {
+    // niveau jamais observe : estimation prudente
+    extra = (level > 0 && minerW > 0) ? minerW * 0.4f : 1500.0f;
+  }
+  if (house + extra + gCfg.marginW > gCfg.limitW) {
+    gHeadroomSince = 0;
+    return;
+  }
+  if (gHeadroomSince == 0) gHeadroomSince = now;
+  if (now - gHeadroomSince < GOV_RESTORE_HOLD_MS) return;
+
+  if (gRestoreCmd) {
+    CmdInfo c;
+    if (cmdQueueGet(gRestoreCmd, c) && !cmdStateIsFinal(c.state)) return;
+    gRestoreCmd = 0;
+  }
+
+  gStats.cap = next;
+  gStats.restores++;
+  gHeadroomSince = now;   // un cran a la fois
+  gLastStepMs    = now;
+
+  // On ne fait que lever le bridage : on ne remonte le miner que s'il
+  // etait exactement au niveau bride (sinon un autre automatisme decide)
+  if (level == next - 1) {
+    gRestoreCmd = submitLevel(level, next);
+    LOG_I("gov", "Marge suffisante (%.0f W) : %d -> %d", house, level, next);
+  }
+}
+
+// =======================
+// API publique
+// =======================
+
+void governorInit() {
+  govPrefs.begin("govern", true);
+  gCfg.enabled  = govPrefs.getBool("enabled", false);
+  gCfg.limitW   = govPrefs.getUShort("limit", 6000);
+  gCfg.marginW  = govPrefs.getUShort("margin", 300);
+  gCfg.pollMs   = govPrefs.getUShort("pollMs", 1000);
+  gCfg.targetMs = govPrefs.getUShort("target", 5000);
+  gCfg.source   = govPrefs.getUChar("source", GOV_SRC_HTTP);
+  gCfg.url      = govPrefs.getString("url", "");
+  gCfg.jsonKey  = govPrefs.getString("jsonKey", "");
+  gCfg.host     = govPrefs.getString("host", "");
+  gCfg.port     = govPrefs.getUShort("port", 502);
+  gCfg.unitId   = govPrefs.getUChar("unit", 1);
+  gCfg.function = govPrefs.getUChar("fc", 3);
+  gCfg.reg      = govPrefs.getUShort("reg", 0);
+  gCfg.format   = govPrefs.getUChar("format", GOV_REG_INT16);
+  gCfg.scale    = govPrefs.getFloat("scale", 1.0f);
+  govPrefs.end();
+
+  gStats = GovStats();
+  gStats.houseW = NAN;
+  gStats.cap    = GOV_LEVEL_MAX;
+}
+
+void governorLoop() {
+  if (!gCfg.enabled) {
+    gStats.cap = GOV_LEVEL_MAX;
+    return;
+  }
+  if (!WiFi.isConnected()) return;
+
+  uint32_t now = millis();
+  trackShed(now);
+
+  if (now - gLastPollMs < gCfg.pollMs) return;
+  gLastPollMs = now;
+
+  pollMeter(now);
+  if (gStats.lastReadMs == 0 || now - gStats.lastReadMs > GOV_STALE_MS) return;
+
+  decide(millis());
+}
+
+GovConfig governorGetConfig() {
+  return gCfg;
+}
+
+void governorSetConfig(const GovConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.pollMs < 250) gCfg.pollMs = 250;
+  if (gCfg.function != 4) gCfg.function = 3;
+  if (gCfg.scale == 0) gCfg.scale = 1.0f;
+
+  govPrefs.begin("govern", false);
+  govPrefs.putBool("enabled", gCfg.enabled);
+  govPrefs.putUShort("limit", gCfg.limitW);
+  govPrefs.putUShort("margin", gCfg.marginW);
+  govPrefs.putUShort("pollMs", gCfg.pollMs);
+  govPrefs.putUShort("target", gCfg.targetMs);
+  govPrefs.putUChar("source", gCfg.source);
+  govPrefs.putString("url", gCfg.url);
+  govPrefs.putString("jsonKey", gCfg.jsonKey);
+  govPrefs.putString("host", gCfg.host);
+  govPrefs.putUShort("port", gCfg.port);
+  govPrefs.putUChar("unit", gCfg.unitId);
+  govPrefs.putUChar("fc", gCfg.function);
+  govPrefs.putUShort("reg", gCfg.reg);
+  govPrefs.putUChar("format", gCfg.format);
+  govPrefs.putFloat("scale", gCfg.scale);
+  govPrefs.end();
+
+  gMbClient.stop();   // hote / port ont pu changer
+  if (!gCfg.enabled) gStats.cap = GOV_LEVEL_MAX;
+}
+
+GovStats governorGetStats() {
+  return gStats;
+}
+
+int8_t governorLevelCap() {
+  return gCfg.enabled ? gStats.cap : GOV_LEVEL_MAX;
+}
+
+void governorFactoryReset() {
+  govPrefs.begin("govern", false);
+  govPrefs.clear();
+  govPrefs.end();
+  gMbClient.stop();
+  governorInit();
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <Arduino.h>
+
+// Gouverneur de puissance du foyer : lit un compteur d'energie local
+// (HTTP ou Modbus-TCP) et, si la consommation totale depasse la limite,
+// fait descendre le miner d'un cran (super > standard > eco > veille)
+// jusqu'a repasser sous la limite. Il remonte ensuite prudemment.
+
+enum GovSource : uint8_t {
+  GOV_SRC_HTTP = 0,     // GET url -> nombre brut ou champ JSON
+  GOV_SRC_MODBUS,       // Modbus-TCP, registre holding / input
+};
+
+enum GovRegFormat : uint8_t {
+  GOV_REG_INT16 = 0,
+  GOV_REG_UINT16,
+  GOV_REG_INT32,        // mot de poids fort en premier
+  GOV_REG_FLOAT32,      // IEEE754, mot de poids fort en premier
+};
+
+struct GovConfig {
+  bool     enabled;
+  uint16_t limitW;       // consommation maxi du foyer
+  uint16_t marginW;      // marge a garder avant de remonter d'un cran
+  uint16_t pollMs;       // periode de lecture du compteur
+  uint16_t targetMs;     // objectif de temps de reaction
+  uint8_t  source;       // GovSource
+  String   url;          // HTTP
+  String   jsonKey;      // HTTP : champ JSON a lire ("" = corps = nombre)
+  String   host;         // Modbus
+  uint16_t port;
+  uint8_t  unitId;
+  uint8_t  function;     // 3 = holding, 4 = input
+  uint16_t reg;
+  uint8_t  format;       // GovRegFormat
+  float    scale;        // valeur brute * scale = W
+};
+
+struct GovStats {
+  float    houseW;           // derniere lecture (NAN si aucune)
+  uint32_t lastReadMs;       // millis() de la derniere lecture reussie
+  uint32_t readLatencyMs;    // duree de la derniere lecture
+  uint32_t maxReadLatencyMs;
+  uint32_t readErrors;
+  int8_t   cap;              // niveau maxi impose (3 = pas de bridage)
+  bool     overload;
+  uint32_t sheds;            // descentes de cran
+  uint32_t restores;         // remontees
+  uint32_t lastReactionMs;   // depassement -> commande confirmee
+  uint32_t maxReactionMs;
+  uint32_t missedTarget;     // reactions plus lentes que targetMs
+};
+
+void governorInit();
+void governorLoop();          // a appeler dans loop(), le plus tot possible
+
+GovConfig governorGetConfig();
+void governorSetConfig(const GovConfig &cfg);
+GovStats governorGetStats();
+
+// Niveau maxi autorise par le gouverneur (0 = veille .. 3 = super).
+// Les autres automatismes doivent s'y plier.
+int8_t governorLevelCap();
+
+void governorFactoryReset();
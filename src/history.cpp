@@ -0,0 +1,454 @@
+#include "history.h"
+
+#include <LittleFS.h>
+#include <time.h>
+
+#include "miner.h"
+#include "analytics.h"
+#include "segtree.h"
+#include "logger.h"
+
+// --- mesures DHT venant de main.cpp ---
+extern float gTempC;
+
+// =======================
+// Etat interne
+// =======================
+
+struct HistoryRecord {
+  uint32_t epoch;                    // debut de la minute, 0 = vide
+  int16_t  v[H_METRIC_COUNT];
+};
+static_assert(sizeof(HistoryRecord) == 16, "enregistrement de 16 octets");
+
+static const char *HISTORY_FILE = "/history.bin";
+
+const uint8_t  HISTORY_PENDING_MAX = 10;    // minutes gardees en RAM avant ecriture
+const uint8_t  HISTORY_READ_CHUNK  = 32;    // enregistrements lus d'un coup (512 octets)
+
+static const char *const METRIC_NAMES[H_METRIC_COUNT] = {
+  "ths", "watts", "tchip", "tamb", "jth", "rej"
+};
+static const uint16_t METRIC_SCALE[H_METRIC_COUNT] = { 100, 1, 10, 10, 10, 100 };
+
+static bool gFsOk = false;
+
+// minute en cours d'accumulation
+static uint32_t gCurMinute = 0;      // epoch / 60, 0 = aucune
+static float    gSum[H_METRIC_COUNT];
+static uint16_t gCount[H_METRIC_COUNT];
+
+static HistoryRecord gPending[HISTORY_PENDING_MAX];
+static uint8_t       gPendingCount = 0;
+
+static uint32_t gLastOkMs = 0;       // detection d'un nouveau status miner
+
+// Index d'agregation : une feuille par heure (anneau de 7 jours), un arbre
+// de segments par mesure. La feuille h % HISTORY_HOURS vaut pour l'heure
+// gLeafHour[] ; construit au premier passage avec l'heure valide.
+const uint16_t HISTORY_HOURS = HISTORY_MINUTES / 60;
+
+static AggNode  gTree[H_METRIC_COUNT][2 * HISTORY_HOURS];
+static uint32_t gLeafHour[HISTORY_HOURS];
+static uint32_t gTreeHour  = 0;      // heure la plus recente indexee
+static bool     gTreeReady = false;
+
+static uint32_t nowEpoch() {
+  time_t t = time(nullptr);
+  return t > 1600000000 ? (uint32_t)t : 0;
+}
+
+static void resetAccumulator() {
+  for (uint8_t i = 0; i < H_METRIC_COUNT; i++) {
+    gSum[i]   = 0;
+    gCount[i] = 0;
+  }
+}
+
+static void addValue(uint8_t m, float v) {
+  if (isnan(v)) return;
+  gSum[m] += v;
+  gCount[m]++;
+}
+
+static int16_t encode(uint8_t m, float v) {
+  if (isnan(v)) return HISTORY_NO_DATA;
+  float x = v * METRIC_SCALE[m];
+  if (x > 32767.0f)  x = 32767.0f;
+  if (x < -32767.0f) x = -32767.0f;
+  return (int16_t)lroundf(x);
+}
+
+// fichier pre-alloue : HISTORY_MINUTES enregistrements vides
+static bool ensureFile() {
+  const size_t size = HISTORY_MINUTES * sizeof(HistoryRecord);
+  if (LittleFS.exists(HISTORY_FILE)) {
+    File f = LittleFS.open(HISTORY_FILE, FILE_READ);
+    bool ok = f && f.size() == size;
+    f.close();
+    if (ok) return true;
+    LittleFS.remove(HISTORY_FILE);
+  }
+
+  File f = LittleFS.open(HISTORY_FILE, FILE_WRITE);
+  if (!f) return false;
+  uint8_t zero[512];
+  memset(zero, 0, sizeof(zero));
+  for (size_t done = 0; done < size; done += sizeof(zero)) {
+    size_t n = size - done < sizeof(zero) ? size - done : sizeof(zero);
+    if (f.write(zero, n) != n) {
+      f.close();
+      return false;
+    }
+  }
+  f.close();
+  LOG_I("history", "Fichier cree");
+  return true;
+}
+
+static void flushPending() {
+  if (gPendingCount == 0 || !gFsOk) return;
+
+  File f = LittleFS.open(HISTORY_FILE, "r+");
+  if (!f) return;
+  for (uint8_t i = 0; i < gPendingCount; i++) {
+    uint32_t slot = (gPending[i].epoch / 60) % HISTORY_MINUTES;
+    f.seek(slot * sizeof(HistoryRecord));
+    f.write((const uint8_t *)&gPending[i], sizeof(HistoryRecord));
+  }
+  f.close();
+  gPendingCount = 0;
+}
+
+// ouvre les feuilles des heures de ]gTreeHour, hour], videes au passage
+static void advanceHours(uint32_t hour) {
+  if (hour <= gTreeHour) return;
+  uint32_t first = gTreeHour + 1;
+  if (hour - first >= HISTORY_HOURS) first = hour - HISTORY_HOURS + 1;
+
+  AggNode empty = aggEmpty();
+  for (uint32_t h = first; h <= hour; h++) {
+    uint16_t leaf = h % HISTORY_HOURS;
+    gLeafHour[leaf] = h;
+    for (uint8_t m = 0; m < H_METRIC_COUNT; m++) segSet(gTree[m], HISTORY_HOURS, leaf, empty);
+  }
+  gTreeHour = hour;
+}
+
+static void indexRecord(const HistoryRecord &r) {
+  uint32_t hour = r.epoch / 3600;
+  advanceHours(hour);
+  uint16_t leaf = hour % HISTORY_HOURS;
+  if (gLeafHour[leaf] != hour) return;   // trop vieux pour l'index
+
+  for (uint8_t m = 0; m < H_METRIC_COUNT; m++) {
+    if (r.v[m] == HISTORY_NO_DATA) continue;
+    AggNode a = gTree[m][HISTORY_HOURS + leaf];
+    aggAdd(a, r.v[m]);
+    segSet(gTree[m], HISTORY_HOURS, leaf, a);
+  }
+}
+
+// relit tout le fichier une fois : feuilles des 7 derniers jours, puis
+// noeuds internes en O(n)
+static void buildIndex(uint32_t epoch) {
+  uint32_t hour = epoch / 3600;
+  for (uint16_t i = 0; i < HISTORY_HOURS; i++) {
+    gLeafHour[i] = 0;
+    for (uint8_t m = 0; m < H_METRIC_COUNT; m++) gTree[m][HISTORY_HOURS + i] = aggEmpty();
+  }
+  for (uint32_t h = hour - HISTORY_HOURS + 1; h <= hour; h++) gLeafHour[h % HISTORY_HOURS] = h;
+
+  if (gFsOk) {
+    File f = LittleFS.open(HISTORY_FILE, FILE_READ);
+    HistoryRecord buf[HISTORY_READ_CHUNK];
+    size_t got;
+    while (f && (got = f.read((uint8_t *)buf, sizeof(buf)) / sizeof(HistoryRecord)) > 0) {
+      for (size_t i = 0; i < got; i++) {
+        if (buf[i].epoch == 0) continue;
+        uint32_t h = buf[i].epoch / 3600;
+        uint16_t leaf = h % HISTORY_HOURS;
+        if (gLeafHour[leaf] != h) continue;
+        for (uint8_t m = 0; m < H_METRIC_COUNT; m++) {
+          if (buf[i].v[m] != HISTORY_NO_DATA) aggAdd(gTree[m][HISTORY_HOURS + leaf], buf[i].v[m]);
+        }
+      }
+    }
+    if (f) f.close();
+  }
+
+  for (uint8_t m = 0; m < H_METRIC_COUNT; m++) segBuild(gTree[m], HISTORY_HOURS);
+  gTreeHour  = hour;
+  gTreeReady = true;
+}
+
+static void closeMinute() {
+  if (gCurMinute == 0) return;
+
+  // l'ambiance est connue meme si le miner n'a pas repondu
+  if (gCount[H_TAMB] == 0) addValue(H_TAMB, gTempC);
+
+  HistoryRecord r;
+  r.epoch = gCurMinute * 60;
+  for (uint8_t m = 0; m < H_METRIC_COUNT; m++) {
+    r.v[m] = gCount[m] ? encode(m, gSum[m] / gCount[m]) : HISTORY_NO_DATA;
+  }
+  // J/TH de la minute = W moyens / TH/s moyens, pas la moyenne des ratios
+  if (gCount[H_THS] && gCount[H_WATTS] && gSum[H_THS] > 0) {
+    r.v[H_JTH] = encode(H_JTH, (gSum[H_WATTS] / gCount[H_WATTS]) / (gSum[H_THS] / gCount[H_THS]));
+  }
+
+  if (gTreeReady) indexRecord(r);
+
+  if (gPendingCount == HISTORY_PENDING_MAX) flushPending();
+  gPending[gPendingCount++] = r;
+  if (gPendingCount == HISTORY_PENDING_MAX) flushPending();
+}
+
+static void addSample() {
+  MinerStatus st = minerGetStatus();
+  float ths = st.isActive ? (float)(st.sum.mhs_5s.toDouble() / 1000000.0) : 0.0f;
+
+  addValue(H_THS, ths);
+  if (st.power.length() > 0) addValue(H_WATTS, st.power.toFloat());
+  addValue(H_TCHIP, st.tempMax);
+  addValue(H_TAMB, gTempC);
+  addValue(H_REJ, analyticsGet().rejectPct);
+}
+
+// =======================
+// API publique
+// =======================
+
+void historyInit() {
+  gFsOk = LittleFS.begin(true) && ensureFile();
+  if (!gFsOk) LOG_E("history", "LittleFS indisponible");
+  resetAccumulator();
+}
+
+void historyLoop() {
+  uint32_t epoch = nowEpoch();
+  if (epoch == 0) return;   // pas d'heure, pas d'horodatage
+  if (!gTreeReady) buildIndex(epoch);
+
+  uint32_t minute = epoch / 60;
+  if (minute != gCurMinute) {
+    closeMinute();
+    resetAccumulator();
+    gCurMinute = minute;
+  }
+
+  MinerPollState ps = minerGetPollState();
+  if (ps.lastOkMs == 0 || ps.lastOkMs == gLastOkMs) return;
+  gLastOkMs = ps.lastOkMs;
+  addSample();
+}
+
+// Agregat d'un pas en cours de remplissage
+struct QueryBucket {
+  uint32_t minPerStep;
+  uint32_t inBucket;
+  int32_t  acc;
+  uint16_t n;
+};
+
+static void bucketEmit(QueryBucket &b, HistorySink sink, void *ctx) {
+  sink(ctx, b.n ? (int16_t)(b.acc / (int32_t)b.n) : HISTORY_NO_DATA);
+  b.acc = 0;
+  b.n = 0;
+  b.inBucket = 0;
+}
+
+// k minutes hors de l'anneau : decomptees sans lecture du fichier
+static void bucketSkip(QueryBucket &b, uint32_t k, HistorySink sink, void *ctx) {
+  while (k > 0) {
+    uint32_t take = b.minPerStep - b.inBucket;
+    if (take > k) take = k;
+    b.inBucket += take;
+    k -= take;
+    if (b.inBucket == b.minPerStep) bucketEmit(b, sink, ctx);
+  }
+}
+
+bool historyQuery(uint8_t metric, uint32_t from, uint32_t to, uint32_t step,
+                  HistorySink sink, void *ctx) {
+  if (!gFsOk || metric >= H_METRIC_COUNT || step < 60 || to <= from) return false;
+  if (step > HISTORY_MINUTES * 60) return false;   // un pas au plus = tout l'anneau
+  flushPending();   // les dernieres minutes doivent etre lisibles
+
+  File f = LittleFS.open(HISTORY_FILE, FILE_READ);
+  if (!f) return false;
+
+  uint32_t firstMin = from / 60;
+  uint32_t lastMin  = (to - 1) / 60;
+
+  // seules les HISTORY_MINUTES dernieres minutes peuvent exister : avant
+  // (et apres maintenant) on ne lit rien, comme historyForEachMinute()
+  uint32_t now    = nowEpoch();
+  uint32_t nowMin = now ? now / 60 : lastMin;
+  uint32_t oldest = nowMin + 1 > HISTORY_MINUTES ? nowMin + 1 - HISTORY_MINUTES : 0;
+  uint32_t readLast = lastMin < nowMin ? lastMin : nowMin;
+
+  HistoryRecord buf[HISTORY_READ_CHUNK];
+  QueryBucket b = { step / 60, 0, 0, 0 };
+
+  uint32_t m = firstMin;
+  if (m < oldest) {
+    uint32_t skip = (oldest <= lastMin ? oldest : lastMin + 1) - m;
+    bucketSkip(b, skip, sink, ctx);
+    m += skip;
+  }
+  while (m <= readLast) {
+    // lot contigu dans le fichier (on coupe au bouclage de l'anneau)
+    uint32_t slot  = m % HISTORY_MINUTES;
+    uint32_t count = readLast - m + 1;
+    if (count > HISTORY_READ_CHUNK) count = HISTORY_READ_CHUNK;
+    if (count > HISTORY_MINUTES - slot) count = HISTORY_MINUTES - slot;
+
+    f.seek(slot * sizeof(HistoryRecord));
+    size_t got = f.read((uint8_t *)buf, count * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+    for (uint32_t i = 0; i < count; i++, m++) {
+      // minute jamais ecrite ou ecrasee par un tour d'anneau plus recent
+      if (i < got && buf[i].epoch == m * 60 && buf[i].v[metric] != HISTORY_NO_DATA) {
+        b.acc += buf[i].v[metric];
+        b.n++;
+      }
+      if (++b.inBucket == b.minPerStep) bucketEmit(b, sink, ctx);
+    }
+  }
+  if (m <= lastMin) bucketSkip(b, lastMin - m + 1, sink, ctx);
+  if (b.inBucket > 0) bucketEmit(b, sink, ctx);
+
+  f.close();
+  return true;
+}
+
+bool historyForEachMinute(uint32_t from, uint32_t to, HistoryRowSink sink, void *ctx) {
+  uint32_t now = nowEpoch();
+  if (!gFsOk || now == 0 || to <= from) return false;
+  flushPending();
+
+  File f = LittleFS.open(HISTORY_FILE, FILE_READ);
+  if (!f) return false;
+
+  // au-dela de la capacite de l'anneau il n'y a rien : inutile de parcourir
+  uint32_t firstMin = (from + 59) / 60;
+  uint32_t endMin   = (to + 59) / 60;
+  uint32_t oldest   = now / 60 - HISTORY_MINUTES + 1;
+  if (firstMin < oldest) firstMin = oldest;
+  if (endMin > now / 60 + 1) endMin = now / 60 + 1;   // ni dans le futur
+
+  HistoryRecord buf[HISTORY_READ_CHUNK];
+  uint32_t m = firstMin;
+  bool go = true;
+  while (go && m < endMin) {
+    uint32_t slot  = m % HISTORY_MINUTES;
+    uint32_t count = endMin - m;
+    if (count > HISTORY_READ_CHUNK) count = HISTORY_READ_CHUNK;
+    if (count > HISTORY_MINUTES - slot) count = HISTORY_MINUTES - slot;
+
+    f.seek(slot * sizeof(HistoryRecord));
+    size_t got = f.read((uint8_t *)buf, count * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+    for (uint32_t i = 0; i < count && go; i++, m++) {
+      if (i < got && buf[i].epoch == m * 60) go = sink(ctx, buf[i].epoch, buf[i].v);
+    }
+  }
+
+  f.close();
+  return true;
+}
+
+// min / max / somme d'une plage de minutes [firstMin, endMin[ lue dans le fichier
+static void scanMinutes(File &f, uint8_t metric, uint32_t firstMin, uint32_t endMin, AggNode &acc) {
+  HistoryRecord buf[HISTORY_READ_CHUNK];
+  uint32_t m = firstMin;
+  while (m < endMin) {
+    uint32_t slot  = m % HISTORY_MINUTES;
+    uint32_t count = endMin - m;
+    if (count > HISTORY_READ_CHUNK) count = HISTORY_READ_CHUNK;
+    if (count > HISTORY_MINUTES - slot) count = HISTORY_MINUTES - slot;
+
+    f.seek(slot * sizeof(HistoryRecord));
+    size_t got = f.read((uint8_t *)buf, count * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+    for (uint32_t i = 0; i < count; i++, m++) {
+      if (i < got && buf[i].epoch == m * 60 && buf[i].v[metric] != HISTORY_NO_DATA) {
+        aggAdd(acc, buf[i].v[metric]);
+      }
+    }
+  }
+}
+
+bool historyAggregate(uint8_t metric, uint32_t from, uint32_t to, HistoryAgg &out) {
+  out.count = 0;
+  out.min = out.max = out.avg = NAN;
+  if (!gFsOk || !gTreeReady || metric >= H_METRIC_COUNT || to <= from) return false;
+  flushPending();
+
+  File f = LittleFS.open(HISTORY_FILE, FILE_READ);
+  if (!f) return false;
+
+  // heures entieres via l'arbre, minutes des bords via le fichier
+  // bornees a la fenetre indexee : au-dela, les feuilles portent d'autres heures
+  uint32_t oldestH = gTreeHour - HISTORY_HOURS + 1;
+  uint32_t fromMin = (from + 59) / 60;
+  uint32_t toMin   = to / 60;
+  if (fromMin < oldestH * 60)        fromMin = oldestH * 60;
+  if (toMin > (gTreeHour + 1) * 60)  toMin   = (gTreeHour + 1) * 60;
+  if (toMin <= fromMin) {
+    f.close();
+    return true;
+  }
+  uint32_t fromH = (fromMin + 59) / 60;
+  uint32_t toH   = toMin / 60;
+
+  AggNode acc = aggEmpty();
+  if (fromH >= toH) {
+    scanMinutes(f, metric, fromMin, toMin, acc);
+  } else {
+    scanMinutes(f, metric, fromMin, fromH * 60, acc);
+    scanMinutes(f, metric, toH * 60, toMin, acc);
+
+    // plage d'heures dans l'anneau : une ou deux requetes
+    uint16_t l   = fromH % HISTORY_HOURS;
+    uint32_t len = toH - fromH;
+    if (l + len <= HISTORY_HOURS) {
+      acc = aggMerge(acc, segQuery(gTree[metric], HISTORY_HOURS, l, l + len));
+    } else {
+      acc = aggMerge(acc, segQuery(gTree[metric], HISTORY_HOURS, l, HISTORY_HOURS));
+      acc = aggMerge(acc, segQuery(gTree[metric], HISTORY_HOURS, 0, l + len - HISTORY_HOURS));
+    }
+  }
+  f.close();
+
+  if (acc.n == 0) return true;
+  float scale = METRIC_SCALE[metric];
+  out.count = acc.n;
+  out.min   = acc.mn / scale;
+  out.max   = acc.mx / scale;
+  out.avg   = (float)acc.sum / acc.n / scale;
+  return true;
+}
+
+int historyMetricFromName(const String &name) {
+  for (uint8_t i = 0; i < H_METRIC_COUNT; i++) {
+    if (name == METRIC_NAMES[i]) return i;
+  }
+  return -1;
+}
+
+const char* historyMetricName(uint8_t metric) {
+  return metric < H_METRIC_COUNT ? METRIC_NAMES[metric] : "";
+}
+
+uint16_t historyMetricScale(uint8_t metric) {
+  return metric < H_METRIC_COUNT ? METRIC_SCALE[metric] : 1;
+}
+
+void historyFactoryReset() {
+  gPendingCount = 0;
+  gCurMinute = 0;
+  gTreeReady = false;
+  gTreeHour  = 0;
+  if (gFsOk) LittleFS.remove(HISTORY_FILE);
+  historyInit();
+}
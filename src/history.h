@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+
+// Historique minute par minute sur LittleFS : un fichier anneau de taille
+// fixe, un enregistrement de 16 octets par minute (epoch + 6 mesures int16).
+// L'emplacement d'une minute est (epoch / 60) % capacite : acces direct,
+// pas d'index a maintenir, une minute ecrasee est detectee par son epoch.
+
+enum HistoryMetric : uint8_t {
+  H_THS = 0,      // TH/s        x100
+  H_WATTS,        // W           x1
+  H_TCHIP,        // TMax puces  x10
+  H_TAMB,         // DHT         x10
+  H_JTH,          // J/TH        x10
+  H_REJ,          // % rejets    x100
+  H_METRIC_COUNT
+};
+
+const int16_t  HISTORY_NO_DATA = INT16_MIN;
+const uint32_t HISTORY_MINUTES = 7 * 1440;   // 7 jours, ~160 Ko
+
+// Recoit les valeurs agregees (moyenne du pas), dans l'ordre chronologique
+typedef void (*HistorySink)(void *ctx, int16_t value);
+
+void historyInit();
+void historyLoop();           // a appeler dans loop(), consomme chaque nouveau status
+
+// Moyenne par pas de step secondes (multiple de 60) sur [from, to[.
+// Appelle sink une fois par pas, HISTORY_NO_DATA si aucune minute valide.
+bool historyQuery(uint8_t metric, uint32_t from, uint32_t to, uint32_t step,
+                  HistorySink sink, void *ctx);
+
+// Parcourt les minutes enregistrees de [from, to[ dans l'ordre, lues par
+// lots de 512 octets ; v[H_METRIC_COUNT] bruts (HISTORY_NO_DATA si absent).
+// sink renvoie false pour arreter (client deconnecte).
+typedef bool (*HistoryRowSink)(void *ctx, uint32_t epoch, const int16_t *v);
+bool historyForEachMinute(uint32_t from, uint32_t to, HistoryRowSink sink, void *ctx);
+
+// min / max / moyenne sur [from, to[ en O(log n) : heures entieres lues dans
+// un arbre de segments tenu en RAM, seules les minutes des bords sont relues.
+struct HistoryAgg {
+  float    min;        // NAN si aucune donnee
+  float    max;
+  float    avg;
+  uint32_t count;      // minutes valides
+};
+bool historyAggregate(uint8_t metric, uint32_t from, uint32_t to, HistoryAgg &out);
+
+int  historyMetricFromName(const String &name);   // -1 si inconnu
+const char* historyMetricName(uint8_t metric);
+uint16_t historyMetricScale(uint8_t metric);      // valeur reelle = int16 / scale
+
+void historyFactoryReset();
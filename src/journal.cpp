@@ -0,0 +1,292 @@
+#include "journal.h"
+
+#include <LittleFS.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "trace.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+struct JournalRecord {
+  JournalEntry e;       // 44 octets
+  uint32_t     crc;     // CRC32 de e
+};
+static_assert(sizeof(JournalRecord) == 48, "enregistrement de 48 octets");
+
+static const char *JOURNAL_FILE = "/journal.bin";
+
+static bool     gFsOk   = false;
+static uint32_t gNextSeq = 1;        // prochain numero a ecrire
+
+// index RAM : seq des JOURNAL_INDEX derniers enregistrements valides
+static uint32_t gIndex[JOURNAL_INDEX];
+static uint8_t  gIndexHead  = 0;
+static uint8_t  gIndexCount = 0;
+
+// la verification OTA ecrit depuis sa propre tache : un seul acces au
+// fichier et a l'index a la fois
+static SemaphoreHandle_t gLock = nullptr;
+
+struct JournalLock {
+  JournalLock()  { if (gLock) xSemaphoreTake(gLock, portMAX_DELAY); }
+  ~JournalLock() { if (gLock) xSemaphoreGive(gLock); }
+};
+
+static uint32_t crc32(const uint8_t *p, size_t n) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (n--) {
+    crc ^= *p++;
+    for (uint8_t k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static bool recordValid(const JournalRecord &r) {
+  return r.e.seq != 0 && r.crc == crc32((const uint8_t *)&r.e, sizeof(r.e));
+}
+
+static bool ensureFile() {
+  const size_t size = (size_t)JOURNAL_CAPACITY * sizeof(JournalRecord);
+  if (LittleFS.exists(JOURNAL_FILE)) {
+    File f = LittleFS.open(JOURNAL_FILE, FILE_READ);
+    bool ok = f && f.size() == size;
+    f.close();
+    if (ok) return true;
+    LittleFS.remove(JOURNAL_FILE);
+  }
+
+  File f = LittleFS.open(JOURNAL_FILE, FILE_WRITE);
+  if (!f) return false;
+  uint8_t zero[512];
+  memset(zero, 0, sizeof(zero));
+  for (size_t done = 0; done < size; done += sizeof(zero)) {
+    size_t n = size - done < sizeof(zero) ? size - done : sizeof(zero);
+    if (f.write(zero, n) != n) {
+      f.close();
+      return false;
+    }
+  }
+  f.close();
+  return true;
+}
+
+static bool readSeq(File &f, uint32_t seq, JournalEntry &out) {
+  JournalRecord r;
+  f.seek((seq % JOURNAL_CAPACITY) * sizeof(JournalRecord));
+  if (f.read((uint8_t *)&r, sizeof(r)) != sizeof(r)) return false;
+  if (!recordValid(r) || r.e.seq != seq) return false;
+  out = r.e;
+  return true;
+}
+
+static void indexPush(uint32_t seq) {
+  gIndex[gIndexHead] = seq;
+  gIndexHead = (gIndexHead + 1) % JOURNAL_INDEX;
+  if (gIndexCount < JOURNAL_INDEX) gIndexCount++;
+}
+
+static uint32_t oldestSeq() {
+  return gNextSeq > JOURNAL_CAPACITY ? gNextSeq - JOURNAL_CAPACITY : 1;
+}
+
+// une passe sur le fichier : dernier seq valide, puis index des plus recents
+static void scanFile() {
+  File f = LittleFS.open(JOURNAL_FILE, FILE_READ);
+  if (!f) return;
+
+  uint32_t maxSeq = 0;
+  JournalRecord buf[8];
+  size_t got;
+  while ((got = f.read((uint8_t *)buf, sizeof(buf)) / sizeof(JournalRecord)) > 0) {
+    for (size_t i = 0; i < got; i++) {
+      if (recordValid(buf[i]) && buf[i].e.seq > maxSeq) maxSeq = buf[i].e.seq;
+    }
+  }
+  gNextSeq = maxSeq + 1;
+
+  // index : on redescend depuis le plus recent (les seq illisibles sont sautes)
+  uint32_t found[JOURNAL_INDEX];
+  uint8_t  n = 0;
+  JournalEntry e;
+  for (uint32_t s = maxSeq; s >= oldestSeq() && s > 0 && n < JOURNAL_INDEX; s--) {
+    if (readSeq(f, s, e)) found[n++] = s;
+  }
+  f.close();
+
+  gIndexHead = gIndexCount = 0;
+  while (n > 0) indexPush(found[--n]);
+}
+
+// =======================
+// API publique
+// =======================
+
+void journalInit() {
+  if (!gLock) gLock = xSemaphoreCreateMutex();
+  gFsOk = LittleFS.begin(true) && ensureFile();
+  if (!gFsOk) {
+    LOG_E("journal", "LittleFS indisponible");
+    return;
+  }
+  scanFile();
+  LOG_I("journal", "%u evenement(s) indexe(s), prochain #%u",
+                (unsigned)gIndexCount, (unsigned)gNextSeq);
+}
+
+void journalLog(JournalEvent type, JournalSource source, int16_t value, const char *text) {
+  JournalRecord r;
+  memset(&r, 0, sizeof(r));
+  time_t t = time(nullptr);
+  r.e.seq     = gNextSeq;
+  r.e.epoch   = t > 1600000000 ? (uint32_t)t : 0;
+  r.e.uptimeS = millis() / 1000;
+  r.e.type    = type;
+  r.e.source  = source;
+  r.e.value   = value;
+  if (text) strncpy(r.e.text, text, sizeof(r.e.text) - 1);
+  r.crc = crc32((const uint8_t *)&r.e, sizeof(r.e));
+
+  LOG_I("journal", "#%u %s (%s) %d %s", (unsigned)r.e.seq, journalEventLabel(type),
+                journalSourceLabel(source), value, r.e.text);
+  if (!gFsOk) return;
+
+  TRACE_SCOPE("journal write");
+  JournalLock lock;
+  r.e.seq = gNextSeq;   // une autre tache a pu ecrire entre-temps
+  r.crc   = crc32((const uint8_t *)&r.e, sizeof(r.e));
+  File f = LittleFS.open(JOURNAL_FILE, "r+");
+  if (!f) return;
+  f.seek((r.e.seq % JOURNAL_CAPACITY) * sizeof(JournalRecord));
+  size_t w = f.write((const uint8_t *)&r, sizeof(r));
+  f.close();
+  if (w != sizeof(r)) return;
+
+  gNextSeq++;
+  indexPush(r.e.seq);
+}
+
+uint8_t journalPage(uint16_t page, uint8_t n, JournalEntry *out) {
+  if (!gFsOk || n == 0) return 0;
+  JournalLock lock;
+  File f = LittleFS.open(JOURNAL_FILE, FILE_READ);
+  if (!f) return 0;
+
+  uint32_t skip = (uint32_t)page * n;
+  uint8_t  filled = 0;
+
+  if (skip < gIndexCount) {
+    // page dans l'index RAM : acces direct aux emplacements
+    for (uint32_t i = skip; i < gIndexCount && filled < n; i++) {
+      uint32_t seq = gIndex[(gIndexHead + JOURNAL_INDEX - 1 - i) % JOURNAL_INDEX];
+      if (readSeq(f, seq, out[filled])) filled++;
+    }
+  }
+  if (filled < n) {
+    // au-dela de l'index : on redescend dans le fichier
+    uint32_t seq = gIndexCount ? gIndex[(gIndexHead + JOURNAL_INDEX - gIndexCount) % JOURNAL_INDEX] - 1
+                               : gNextSeq - 1;
+    uint32_t seen = gIndexCount;
+    for (; seq >= oldestSeq() && seq > 0 && filled < n; seq--) {
+      JournalEntry e;
+      if (!readSeq(f, seq, e)) continue;
+      if (seen++ < skip) continue;
+      out[filled++] = e;
+    }
+  }
+
+  f.close();
+  return filled;
+}
+
+uint32_t journalCount() {
+  return gNextSeq - oldestSeq();
+}
+
+void journalSeek(JournalCursor &c, uint32_t from) {
+  JournalLock lock;
+  c.end = gNextSeq;
+  c.seq = oldestSeq();
+  if (!gFsOk) {
+    c.seq = c.end;
+    return;
+  }
+
+  // recherche dichotomique sur l'epoch : les seq sont chronologiques
+  File f = LittleFS.open(JOURNAL_FILE, FILE_READ);
+  if (!f) {
+    c.seq = c.end;
+    return;
+  }
+  // Seuls les evenements dates sont ordonnes : un emplacement illisible ou
+  // sans heure (boot avant NTP) prend l'epoch du prochain evenement date.
+  // S'il n'y en a plus jusqu'a hi, rien a perdre : on reste a gauche.
+  uint32_t lo = c.seq, hi = c.end;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t j = mid;
+    JournalEntry e;
+    while (j < hi && (!readSeq(f, j, e) || e.epoch == 0)) j++;
+    if (j < hi && e.epoch < from) lo = j + 1;
+    else hi = mid;
+  }
+  f.close();
+  c.seq = lo;
+}
+
+bool journalNext(JournalCursor &c, uint32_t to, JournalEntry &out) {
+  if (!gFsOk) return false;
+  JournalLock lock;
+  File f = LittleFS.open(JOURNAL_FILE, FILE_READ);
+  if (!f) return false;
+
+  bool found = false;
+  for (; c.seq < c.end && !found; c.seq++) {
+    if (!readSeq(f, c.seq, out) || out.epoch == 0) continue;
+    if (out.epoch >= to) {
+      c.seq = c.end;
+      break;
+    }
+    found = true;
+  }
+  f.close();
+  return found;
+}
+
+const char* journalEventLabel(uint8_t type) {
+  switch (type) {
+    case JE_BOOT:          return "demarrage";
+    case JE_CMD_SUBMIT:    return "commande";
+    case JE_CMD_DONE:      return "resultat";
+    case JE_FACTORY_RESET: return "reset usine";
+    case JE_OTA:           return "mise a jour";
+    case JE_MINER_DOWN:    return "miner injoignable";
+    case JE_MINER_UP:      return "miner joignable";
+    case JE_POOL_SWITCH:   return "bascule pool";
+    case JE_FAN_SAFETY:    return "ventilation securite";
+    case JE_ALERT:         return "alerte";
+    case JE_WATCHDOG:      return "reset watchdog";
+    case JE_WIFI_DOWN:     return "wifi perdu";
+    case JE_WIFI_UP:       return "wifi retabli";
+  }
+  return "?";
+}
+
+const char* journalSourceLabel(uint8_t source) {
+  switch (source) {
+    case JSRC_SYSTEM:     return "systeme";
+    case JSRC_WEB:        return "web";
+    case JSRC_SCHEDULE:   return "planning";
+    case JSRC_THERMOSTAT: return "thermostat";
+    case JSRC_GOVERNOR:   return "limite puissance";
+    case JSRC_AUTOTUNE:   return "autotune";
+    case JSRC_POOLS:      return "pools";
+    case JSRC_FAN:        return "ventilation";
+    case JSRC_ALERTS:     return "alertes";
+  }
+  return "?";
+}
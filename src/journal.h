@@ -0,0 +1,70 @@
+#pragma once
+#include <Arduino.h>
+
+// Journal d'evenements sur LittleFS : enregistrements de 48 octets proteges
+// par CRC32, ecrits dans un anneau a emplacement fixe (seq % capacite).
+// Les derniers enregistrements sont indexes en RAM pour la pagination.
+// Ecriture immediate : le journal doit survivre a un plantage.
+
+enum JournalEvent : uint8_t {
+  JE_BOOT = 0,          // value = raison du reset, text = version
+  JE_CMD_SUBMIT,        // value = CmdType, text = argument
+  JE_CMD_DONE,          // value = CmdState, text = detail
+  JE_FACTORY_RESET,
+  JE_OTA,               // value : 0 = debut, 1 = succes, -1 = echec
+  JE_MINER_DOWN,        // disjoncteur ouvert, text = derniere erreur
+  JE_MINER_UP,
+  JE_POOL_SWITCH,       // value = pool vise
+  JE_FAN_SAFETY,        // value = TMax puces
+  JE_ALERT,             // value : 1 = declenchee, 0 = resolue, text = regle
+  JE_WATCHDOG,          // value = raison du reset, text = section bloquee
+  JE_WIFI_DOWN,         // value = raison de la deconnexion, text = SSID
+  JE_WIFI_UP,           // value = duree de la coupure en s, text = SSID
+  JE_EVENT_COUNT
+};
+
+enum JournalSource : uint8_t {
+  JSRC_SYSTEM = 0,
+  JSRC_WEB,
+  JSRC_SCHEDULE,
+  JSRC_THERMOSTAT,
+  JSRC_GOVERNOR,
+  JSRC_AUTOTUNE,
+  JSRC_POOLS,
+  JSRC_FAN,
+  JSRC_ALERTS,
+  JSRC_COUNT
+};
+
+struct JournalEntry {
+  uint32_t seq;         // croissant depuis la creation du journal
+  uint32_t epoch;       // 0 = heure inconnue
+  uint32_t uptimeS;
+  uint8_t  type;        // JournalEvent
+  uint8_t  source;      // JournalSource
+  int16_t  value;
+  char     text[28];    // termine par '\0'
+};
+
+const uint16_t JOURNAL_CAPACITY = 1024;   // 48 Ko
+const uint8_t  JOURNAL_INDEX    = 64;     // plus recents, en RAM
+
+void journalInit();
+void journalLog(JournalEvent type, JournalSource source, int16_t value, const char *text);
+
+// Page p (0 = plus recente) de n evenements, du plus recent au plus ancien.
+// Renvoie le nombre d'entrees remplies.
+uint8_t journalPage(uint16_t page, uint8_t n, JournalEntry *out);
+uint32_t journalCount();   // evenements encore lisibles
+
+// Parcours chronologique a partir du premier evenement d'epoch >= from.
+// Les evenements sans heure (epoch 0) sont sautes.
+struct JournalCursor {
+  uint32_t seq;
+  uint32_t end;         // dernier seq + 1 au moment de l'ouverture
+};
+void journalSeek(JournalCursor &c, uint32_t from);
+bool journalNext(JournalCursor &c, uint32_t to, JournalEntry &out);
+
+const char* journalEventLabel(uint8_t type);
+const char* journalSourceLabel(uint8_t source);
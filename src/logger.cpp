@@ -0,0 +1,122 @@
+#include "logger.h"
+
+#include <stdarg.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// =======================
+// Etat interne
+// =======================
+
+const uint32_t LOG_TASK_STACK  = 3072;
+const uint32_t LOG_IDLE_MS     = 100;   // reveil de secours si aucune notification
+
+struct LogSlot {
+  uint32_t seq;                // index + 1 une fois publiee, 0 = en cours d'ecriture
+  uint8_t  level;
+  char     line[LOG_LINE_LEN];
+};
+
+static LogSlot      gSlots[LOG_SLOTS];
+static uint32_t     gHead    = 0;   // prochain index a reserver
+static uint32_t     gTail    = 0;   // prochain index a envoyer sur Serial (tache)
+static uint32_t     gDropped = 0;
+static TaskHandle_t gTask    = nullptr;
+
+// Envoie sur Serial tout ce qui est publie, dans l'ordre
+static void drain() {
+  static char line[LOG_LINE_LEN];
+  for (;;) {
+    uint32_t head = __atomic_load_n(&gHead, __ATOMIC_ACQUIRE);
+    if (head - gTail > LOG_SLOTS) {
+      // l'anneau a fait le tour : les plus anciennes sont perdues
+      __atomic_fetch_add(&gDropped, head - LOG_SLOTS - gTail, __ATOMIC_RELAXED);
+      gTail = head - LOG_SLOTS;
+    }
+    if (gTail == head) return;
+
+    LogSlot &s = gSlots[gTail % LOG_SLOTS];
+    uint32_t seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+    if (seq != gTail + 1) {
+      if (seq > gTail + 1) continue;   // deja reecrite : le test du haut rattrape
+      return;                          // pas encore publiee
+    }
+    memcpy(line, s.line, sizeof(line));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s.seq, __ATOMIC_RELAXED) != seq) continue;   // reecrite pendant la copie
+
+    Serial.println(line);
+    gTail++;
+  }
+}
+
+static void logTask(void *) {
+  for (;;) {
+    drain();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_IDLE_MS));
+  }
+}
+
+// =======================
+// API publique
+// =======================
+
+void logInit() {
+  if (gTask) return;
+  // coeur 0, priorite minimale : ne vole pas de temps a loop() (coeur 1)
+  xTaskCreatePinnedToCore(logTask, "logger", LOG_TASK_STACK, nullptr, 1, &gTask, 0);
+}
+
+void logWrite(uint8_t level, const char *tag, const char *fmt, ...) {
+  uint32_t i = __atomic_fetch_add(&gHead, 1, __ATOMIC_RELAXED);
+  LogSlot &s = gSlots[i % LOG_SLOTS];
+
+  __atomic_store_n(&s.seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  uint32_t ms = millis();
+  int n = snprintf(s.line, sizeof(s.line), "%5lu.%03lu %c %s: ", (unsigned long)(ms / 1000),
+                   (unsigned long)(ms % 1000), logLevelLetter(level), tag);
+  if (n < 0) n = 0;
+  if ((size_t)n < sizeof(s.line)) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(s.line + n, sizeof(s.line) - n, fmt, ap);
+    va_end(ap);
+  }
+  s.level = level;
+  __atomic_store_n(&s.seq, i + 1, __ATOMIC_RELEASE);
+
+  if (gTask) xTaskNotifyGive(gTask);
+}
+
+void logForEach(uint8_t maxLevel, LogSink sink, void *ctx) {
+  static char line[LOG_LINE_LEN];
+  uint32_t head  = __atomic_load_n(&gHead, __ATOMIC_ACQUIRE);
+  uint32_t first = head > LOG_SLOTS ? head - LOG_SLOTS : 0;
+
+  for (uint32_t i = first; i < head; i++) {
+    const LogSlot &s = gSlots[i % LOG_SLOTS];
+    if (__atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) != i + 1) continue;
+    uint8_t level = s.level;
+    memcpy(line, s.line, sizeof(line));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s.seq, __ATOMIC_RELAXED) != i + 1) continue;
+    if (level > maxLevel) continue;
+    if (!sink(ctx, level, line)) return;
+  }
+}
+
+uint32_t logDropped() {
+  return __atomic_load_n(&gDropped, __ATOMIC_RELAXED);
+}
+
+char logLevelLetter(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_ERROR: return 'E';
+    case LOG_LEVEL_WARN:  return 'W';
+    case LOG_LEVEL_INFO:  return 'I';
+    case LOG_LEVEL_DEBUG: return 'D';
+  }
+  return '?';
+}
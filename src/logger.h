@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+
+// Journal texte asynchrone : LOG_x formate la ligne directement dans un
+// anneau de lignes fixes (reservation atomique, sans verrou) et rend la
+// main ; une tache basse priorite vide l'anneau vers Serial. Si l'UART ne
+// suit pas, les lignes les plus anciennes sont perdues (et comptees),
+// l'appelant n'est jamais bloque. /log relit les dernieres lignes.
+//
+//   LOG_I("miner", "Interrogation @ %s", ip.c_str());
+//
+// Filtrage a la compilation : -DLOG_LEVEL=LOG_LEVEL_DEBUG pour tout voir,
+// les appels au-dessus du niveau sont elimines (mais leur format reste verifie).
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+const uint8_t LOG_SLOTS    = 48;
+const uint8_t LOG_LINE_LEN = 96;   // texte tronque au-dela
+
+void logInit();   // tout debut de setup(), apres Serial.begin()
+void logWrite(uint8_t level, const char *tag, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(tag, ...) logWrite(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#else
+#define LOG_E(tag, ...) do { if (0) logWrite(0, tag, __VA_ARGS__); } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(tag, ...) logWrite(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define LOG_W(tag, ...) do { if (0) logWrite(0, tag, __VA_ARGS__); } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(tag, ...) logWrite(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define LOG_I(tag, ...) do { if (0) logWrite(0, tag, __VA_ARGS__); } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(tag, ...) logWrite(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_D(tag, ...) do { if (0) logWrite(0, tag, __VA_ARGS__); } while (0)
+#endif
+
+// Dernieres lignes encore dans l'anneau, de la plus ancienne a la plus
+// recente, deja formatees ("   12.345 I miner: ..."). sink renvoie false pour arreter.
+typedef bool (*LogSink)(void *ctx, uint8_t level, const char *line);
+void logForEach(uint8_t maxLevel, LogSink sink, void *ctx);   // niveaux <= maxLevel
+uint32_t logDropped();   // lignes perdues avant d'atteindre Serial
+char logLevelLetter(uint8_t level);
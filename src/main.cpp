@@ -5,6 +5,23 @@
 #include "display.h"
 #include "portal.h"
 #include "miner.h"
+#include "cmdqueue.h"
+#include "schedule.h"
+#include "thermostat.h"
+#include "governor.h"
+#include "autotune.h"
+#include "analytics.h"
+#include "pools.h"
+#include "fan.h"
+#include "alerts.h"
+#include "history.h"
+#include "journal.h"
+#include "perf.h"
+#include "stall.h"
+#include "logger.h"
+#include "wifisup.h"
+#include "ota.h"
+#include "version.h"
 #include "DHT.h"
 #include <Preferences.h>
 
@@ -32,6 +49,13 @@ const uint8_t BUTTON_PREV_PIN = 0;    // bouton gauche -> page précédente
 const uint8_t NUM_PAGES = 4;          // 0=WiFi, 1=Miner, 2=Horloge, 3=Climat
 static uint8_t currentPage = 0;
 
+// Page cachee (hors cycle) : instrumentation, bouton droit maintenu 2 s
+const uint8_t  PAGE_PERF          = NUM_PAGES;
+const uint32_t PERF_PAGE_HOLD_MS  = 2000;
+const uint32_t PERF_PAGE_EVERY_MS = 2000;   // rafraichissement
+static uint32_t nextHeldSinceMs   = 0;      // 0 = bouton droit relache
+static uint32_t lastPerfPageMs    = 0;
+
 const uint32_t SCREEN_TIMEOUT_MS = 30000; // 30s avant extinction
 static uint32_t lastInteractionMs = 0;
 static bool backlightOn = true;
@@ -84,26 +108,79 @@ static void updateDht() {
   if (now - lastDhtRead < DHT_INTERVAL_MS) return;
   lastDhtRead = now;
 
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
+  static int8_t sProbe = perfProbe(PERF_SENSOR, "dht");
+  float h, t;
+  {
+    PerfScope ps(sProbe);   // protocole 1 fil : plusieurs ms bloquantes
+    h = dht.readHumidity();
+    t = dht.readTemperature();
+  }
 
   if (isnan(h) || isnan(t)) {
-    Serial.println("Erreur lecture DHT/AM2302");
+    LOG_W("dht", "Erreur lecture DHT/AM2302");
     return;
   }
 
   gHum   = h;
   gTempC = t;
 
-  Serial.print("DHT OK  Temp: ");
-  Serial.print(gTempC, 1);
-  Serial.print(" C  Hum: ");
-  Serial.print(gHum, 1);
-  Serial.println(" %");
+  LOG_D("dht", "Temp %.1f C, hum %.1f %%", gTempC, gHum);
 }
+// Page cachee : tas, pile de loop et sondes les plus lentes (p95)
+static void showPerfPage() {
+  const uint8_t TOP = 8;
+  String lines[4 + TOP];
+  uint8_t n = 0;
+
+  PerfHeap hp = perfGetHeap();
+  lines[n++] = "Tas " + String(hp.freeHeap / 1024) + "k (min " + String(hp.minFreeHeap / 1024) +
+               "k) bloc " + String(hp.largestBlock / 1024) + "k";
+  for (uint8_t i = 0; i < hp.taskCount; i++) {
+    if (strcmp(hp.tasks[i].name, "loopTask") == 0) {
+      lines[n++] = "Pile loop libre " + String(hp.tasks[i].stackFree) + " o";
+    }
+  }
+  PerfBoot boot = perfGetBoot();
+  lines[n++] = "Boot WiFi " + String(boot.ms[BOOT_WIFI]) + (boot.fastWifi ? " (cache)" : "") +
+               " donnees " + String(boot.ms[BOOT_FIRST_DATA]) + " ms";
+  lines[n++] = "sonde          p50   p95   max ms";
+
+  // selection des TOP plus grands p95 (peu de sondes : tri par insertion)
+  PerfSummary top[TOP];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < perfProbeCount(); i++) {
+    PerfSummary ps;
+    if (!perfGet(i, ps) || ps.count == 0) continue;
+    uint8_t j = count < TOP ? count++ : TOP;
+    if (j == TOP && ps.p95Us <= top[TOP - 1].p95Us) continue;
+    if (j == TOP) j = TOP - 1;
+    while (j > 0 && top[j - 1].p95Us < ps.p95Us) {
+      top[j] = top[j - 1];
+      j--;
+    }
+    top[j] = ps;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%-13.13s %5.1f %5.1f %5.0f", top[i].name,
+             top[i].p50Us / 1000.0f, top[i].p95Us / 1000.0f, top[i].maxUs / 1000.0f);
+    lines[n++] = buf;
+  }
+
+  displayShowDebugPage("Perf", lines, n);
+}
+
 static void showCurrentPage() {
   if (!backlightOn) return;
 
+  static int8_t sProbes[NUM_PAGES + 1] = {
+    perfProbe(PERF_DISPLAY, "wifi"), perfProbe(PERF_DISPLAY, "miner"),
+    perfProbe(PERF_DISPLAY, "horloge"), perfProbe(PERF_DISPLAY, "climat"),
+    perfProbe(PERF_DISPLAY, "perf")
+  };
+  PerfScope ps(sProbes[currentPage <= PAGE_PERF ? currentPage : 0]);
+  perfBootMark(BOOT_FIRST_PAGE);   // sans effet apres le premier appel
+
     // 👉 Si on est en mode AP/config, on force l’affichage config
   if (portalIsConfigMode()) {
     // Affiche les infos AP (SSID TTGO_Config + IP AP)
@@ -120,13 +197,16 @@ static void showCurrentPage() {
     }
   }
   else if (currentPage == 1) {
-    // Page Miner
-    bool minerOk = minerUpdate();
+    // Page Miner (dernier status connu, l'interrogation est faite par minerPollLoop)
+    MinerPollState ps = minerGetPollState();
     MinerStatus st = minerGetStatus();
+    bool minerOk = (ps.lastOkMs != 0 && ps.failures == 0);
 
     if (minerOk && st.ip.length() > 0) {
+      // hashrate lisse sur 1 min plutot que la moyenne depuis le demarrage du miner
+      AnalyticsSnapshot an = analyticsGet();
       double mhs_av = st.sum.mhs_av.toDouble();
-      float ths = mhs_av / 1000000.0f;  // MH/s -> TH/s
+      float ths = an.samples > 0 ? an.ths1m : mhs_av / 1000000.0f;  // MH/s -> TH/s
       float powerW = st.power.toFloat();
 
       String modeLabel;
@@ -143,6 +223,10 @@ static void showCurrentPage() {
       displayShowMinerPage("N/A", "Inconnu", 0.0f, 0.0f);
     }
   }
+  else if (currentPage == PAGE_PERF) {
+    lastPerfPageMs = millis();
+    showPerfPage();
+  }
   else if (currentPage == 2) {
     // Page Horloge
     String d, t;
@@ -160,13 +244,22 @@ static void showCurrentPage() {
 
 void setup() {
   Serial.begin(115200);
-  delay(500);
+  logInit();       // les LOG_x passent par la tache logger, jamais bloquants
+
+  // association WiFi lancee d'abord : elle avance (canal / BSSID en cache)
+  // pendant l'init de l'ecran, du capteur et du journal
+  portalBeginWiFi();
 
   displayInit();
   displayShowBoot();
 
   dht.begin();     // init capteur
 
+  // journal en premier : le demarrage doit y figurer meme si la suite plante
+  journalInit();
+  journalLog(JE_BOOT, JSRC_SYSTEM, (int16_t)esp_reset_reason(), "v" FW_VERSION);
+  stallInit();     // section bloquee au boot precedent, watchdog
+
   pinMode(BUTTON_NEXT_PIN, INPUT_PULLUP);
   pinMode(BUTTON_PREV_PIN, INPUT_PULLUP);
 
@@ -182,9 +275,58 @@ void setup() {
 }
 
 void loop() {
+  static int8_t sLoopProbe = perfProbe(PERF_LOOP, "loop");
+  PerfScope loopScope(sLoopProbe);
+  stallLoop();      // watchdog + sauvegarde des blocages
+
+  // Limite de puissance : chemin rapide, avant tout le reste
+  // (chaque stallSection() cloture la precedente et lui attribue son temps)
+  stallSection("governor");
+  governorLoop();
+  stallSection("cmdqueue");
+  cmdQueueLoop();   // execute les commandes mode / veille / reveil
+
+  stallSection("portal");
   portalLoop();    // HTTP, WiFi, etc.
+  stallSection("wifi");
+  wifiSupLoop();   // reconnexion / bascule de point d'acces, non bloquant
+  String otaL1, otaL2;
+  if (otaPollMessage(otaL1, otaL2)) displayShowOtaStatus(otaL1, otaL2);   // tache OTA
+  stallSection("dht");
   updateDht();     // met à jour gTempC/gHum
 
+  // Page Miner affichee : on veut des donnees fraiches
+  bool minerPageShown = backlightOn && currentPage == 1 && !portalIsConfigMode();
+  if (minerPageShown) minerPollDemand();
+  stallSection("minerPoll");
+  if (minerPollLoop()) {
+    if (minerGetPollState().lastOkMs != 0) perfBootMark(BOOT_FIRST_DATA);
+    stallSection("analytics");
+    analyticsLoop();     // EWMA / energie, ignore les echecs (lastOkMs inchange)
+    if (minerPageShown && !resetInProgress) {
+      stallSection("display");
+      showCurrentPage(); // nouveau status ou erreur -> rafraichit la page Miner
+    }
+  }
+  stallSection("schedule");
+  scheduleLoop();   // planning hebdomadaire -> file de commandes
+  stallSection("thermostat");
+  thermostatLoop(); // consigne d'ambiance -> file de commandes
+  stallSection("autotune");
+  autotuneLoop();   // mesure J/TH par mode
+  stallSection("pools");
+  poolsLoop();      // sante des pools, bascule auto
+  stallSection("fan");
+  fanLoop();        // courbe de ventilation
+  stallSection("alerts");
+  alertsLoop();     // regles d'alerte -> webhook
+  stallSection("history");
+  historyLoop();    // une ligne par minute sur LittleFS
+  stallSection("perf");
+  perfLoop();       // echantillonne tas et piles
+
+  // boutons, pages TFT, veille ecran (delay(3000) compris)
+  stallSection("ui");
   uint32_t now = millis();
 
   // Lecture boutons (INPUT_PULLUP ⇒ appui = LOW)
@@ -198,6 +340,10 @@ void loop() {
   lastNextState = nextState;
   lastPrevState = prevState;
 
+  // appui long sur le bouton droit seul (ecran deja allume) -> page cachee
+  if (pressedNext && backlightOn) nextHeldSinceMs = now | 1;
+  if (nextState == HIGH || prevState == LOW) nextHeldSinceMs = 0;
+
   // === 1) GESTION RESET : les 2 boutons enfoncés ===
   if (bothPressed) {
     if (!resetInProgress) {
@@ -221,6 +367,19 @@ void loop() {
 
       portalFactoryReset();
       minerFactoryReset();
+      scheduleFactoryReset();
+      thermostatFactoryReset();
+      governorFactoryReset();
+      autotuneFactoryReset();
+      analyticsFactoryReset();
+      poolsFactoryReset();
+      fanFactoryReset();
+      alertsFactoryReset();
+      historyFactoryReset();
+      stallFactoryReset();
+      otaFactoryReset();
+      // le journal survit au reset : il doit justement en garder la trace
+      journalLog(JE_FACTORY_RESET, JSRC_SYSTEM, 0, "bouton");
       // Pose un flag pour forcer le mode AP au prochain boot
       Preferences p;
       p.begin("sys", false);
@@ -280,6 +439,15 @@ void loop() {
   }
 }
 
+  if (nextHeldSinceMs && now - nextHeldSinceMs >= PERF_PAGE_HOLD_MS && !portalIsConfigMode()) {
+    nextHeldSinceMs   = 0;
+    currentPage       = PAGE_PERF;
+    lastInteractionMs = now;
+    showCurrentPage();
+  } else if (backlightOn && currentPage == PAGE_PERF && now - lastPerfPageMs >= PERF_PAGE_EVERY_MS) {
+    showCurrentPage();
+  }
+
   // === 3) Veille auto de l'écran ===
   if (backlightOn && (now - lastInteractionMs > SCREEN_TIMEOUT_MS)) {
     displayShowBoot();   // logo 3s
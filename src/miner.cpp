@@ -1,7 +1,12 @@
 #include "miner.h"
+#include "cgapi.h"
+#include "journal.h"
+#include "perf.h"
+#include "logger.h"
 
 #include <WiFi.h>
 #include <Preferences.h>
+#include <lwip/sockets.h>
 
 // =======================
 // NVS / Etat interne
@@ -15,6 +20,8 @@ static String gCurrentMode;   // "eco"/"standard"/"super"/""
 static String gPower;         // puissance instantanée en W (depuis PS[])
 static String gWorkState;     // "In Work" / "In Idle" / ...
 static bool   gIsActive = false;
+static float  gTempMax  = NAN;   // TMax[] (puces)
+static float  gTempAvg  = NAN;   // TAvg[]
 
 
 
@@ -22,176 +29,369 @@ static MinerVersionInfo gVerInfo;
 static MinerSummaryInfo gSumInfo;
 
 // =======================
-// Helpers parsing
+// Ordonnanceur d'interrogation
+// =======================
+
+const uint32_t POLL_FAST_MS        = 2000;    // quelqu'un regarde
+const uint32_t POLL_IDLE_MS        = 30000;   // personne ne regarde
+const uint32_t POLL_DEMAND_HOLD_MS = 60000;   // duree du rythme rapide apres une demande
+const uint32_t POLL_BACKOFF_MAX_MS = 60000;   // plafond du backoff
+const uint16_t CIRCUIT_TRIP_FAILS  = 5;       // echecs consecutifs avant ouverture
+const uint32_t CIRCUIT_OPEN_MS     = 300000;  // 5 min avant nouvel essai
+
+static MinerPollState gPoll = {};
+static uint32_t gLastDemandMs = 0;
+static bool     gHasDemand    = false;
+
+// =======================
+// Cache par commande
 // =======================
 
-static String getBlock(const String &src, const String &tag) {
-  int start = src.indexOf(tag);
-  if (start < 0) return "";
-  int end = src.indexOf('|', start);
-  if (end < 0) end = src.length();
-  return src.substring(start, end);
-}
-
-static String getValueFromBlock(const String &block, const String &key) {
-  String pattern = key + "=";
-  int idx = block.indexOf(pattern);
-  if (idx < 0) return "";
-  idx += pattern.length();
-  int end = block.indexOf(',', idx);
-  if (end < 0) end = block.length();
-  return block.substring(idx, end);
-}
-
-static MinerVersionInfo parseMinerVersion(const String &resp) {
-  MinerVersionInfo info;
-  String block = getBlock(resp, "VERSION,");
-  if (block.length() == 0) return info;
-
-  info.cgminer = getValueFromBlock(block, "CGMiner");
-  info.api     = getValueFromBlock(block, "API");
-  info.prod    = getValueFromBlock(block, "PROD");
-  info.model   = getValueFromBlock(block, "MODEL");
-  info.mac     = getValueFromBlock(block, "MAC");
-  return info;
-}
-
-static MinerSummaryInfo parseMinerSummary(const String &resp) {
-  MinerSummaryInfo info;
-  String block = getBlock(resp, "SUMMARY,");
-  Serial.println("SUMMARY block: " + block);
-  if (block.length() == 0) return info;
-
-  info.elapsed   = getValueFromBlock(block, "Elapsed");
-  info.mhs_av    = getValueFromBlock(block, "MHS av");
-  info.mhs_5s    = getValueFromBlock(block, "MHS 5s");
-  info.accepted  = getValueFromBlock(block, "Accepted");
-  info.rejected  = getValueFromBlock(block, "Rejected");
-  info.hw_errors = getValueFromBlock(block, "Hardware Errors");
-  return info;
-}
-
-// extrait WORKMODE[n] depuis la reponse estats
-static String getWorkModeFromEstats(const String &resp) {
-  int idx = resp.indexOf("WORKMODE[");
-  if (idx < 0) return "";
-  idx += String("WORKMODE[").length();
-  int end = resp.indexOf(']', idx);
-  if (end < 0) return "";
-  String val = resp.substring(idx, end);
-  val.trim();
-  return val;  // "0", "1", "2", ...
+// Fraicheur par commande : on ne redemande que ce qui peut avoir change.
+// ttlMs = 0 : a chaque cycle ; CACHE_UNTIL_REBOOT : jusqu'a ce qu'Elapsed recule.
+// "stats" n'est plus demande : sur les Avalon il repete estats et la
+// reponse n'etait pas exploitee.
+const uint32_t CACHE_UNTIL_REBOOT = 0xFFFFFFFF;
+
+struct PollCommand {
+  const char *cmd;
+  uint32_t    ttlMs;
+  uint32_t    fetchedMs;
+  bool        valid;
+};
+
+enum { PC_SUMMARY = 0, PC_VERSION, PC_ESTATS, PC_COUNT };
+
+static PollCommand gPollCmds[PC_COUNT] = {
+  { "summary", 0,                  0, false },   // compteurs, Elapsed
+  { "version", CACHE_UNTIL_REBOOT, 0, false },   // CGMiner/API/PROD/MODEL/MAC
+  { "estats",  0,                  0, false },   // WORKMODE, PS[], SYSTEMSTATU, temperatures
+};
+
+static long gLastElapsed = -1;
+
+static bool isFresh(const PollCommand &pc, uint32_t now) {
+  if (!pc.valid || pc.ttlMs == 0)      return false;
+  if (pc.ttlMs == CACHE_UNTIL_REBOOT)  return true;
+  return now - pc.fetchedMs < pc.ttlMs;
+}
+
+static void invalidateCache() {
+  for (uint8_t i = 0; i < PC_COUNT; i++) gPollCmds[i].valid = false;
+  gLastElapsed = -1;
 }
-// extrait power depuis la reponse estats
 
-static String getPowerFromEstats(const String &resp) {
-  int idx = resp.indexOf("PS[");
-  if (idx < 0) return "";
-  idx += 3; // saute "PS["
+// =======================
+// Tampon de reception
+// =======================
 
-  int end = resp.indexOf(']', idx);
-  if (end < 0) return "";
+// Les reponses estats des Avalon font plusieurs Ko : un seul tampon fixe,
+// reutilise par toutes les commandes, evite toute allocation en reception.
+// Valable jusqu'a la commande suivante.
+const size_t   RX_BUF_SIZE       = 8192;
+const uint32_t MINER_CONNECT_MS  = 2000;
+const uint32_t MINER_REPLY_MS    = 3000;
 
-  String block = resp.substring(idx, end); // ex: "0 1209 2349 55 1306 2350 1364"
-  block.trim();
+static char     gRxBuf[RX_BUF_SIZE];
+static size_t   gRxLen = 0;
 
-  // Dernier nombre après le dernier espace
-  int lastSpace = block.lastIndexOf(' ');
-  if (lastSpace < 0) return block; // si un seul nombre
+static IPAddress gMinerAddr;          // gMinerIP resolue une fois
+static bool      gMinerAddrOk = false;
 
-  String val = block.substring(lastSpace + 1);
-  val.trim();
-  return val;  // "1364"
+// copie [p, p+n) dans un String existant sans realloc si la capacite suffit
+static void setField(String &dst, const char *p, size_t n) {
+  dst = "";
+  if (n > 0) dst.concat(p, n);
 }
 
-// extrait Work depuis SYSTEMSTATU[...] dans la reponse estats
-// extrait Work depuis SYSTEMSTATU[...] dans la reponse estats
-// extrait "Work: In Work" ou "Work: In Idle" depuis SYSTEMSTATU[...]
-static String getWorkStateFromEstats(const String &resp) {
-  //Serial.println("=== getWorkStateFromEstats() ===");
-  //Serial.println("Reponse ESTATS brute :");
-  //Serial.println(resp);
+// =======================
+// Helpers parsing
+// =======================
 
-  // On isole le bloc SYSTEMSTATU[ ... ]
-  int idx = resp.indexOf("SYSTEMSTATU[");
-  if (idx < 0) {
-    Serial.println("Pas de SYSTEMSTATU[ trouvé");
-    return "";
+// Bloc "TAG...|" dans la reponse : [start, end)
+static bool findBlock(const char *resp, const char *tag, const char *&start, const char *&end) {
+  start = strstr(resp, tag);
+  if (!start) return false;
+  end = strchr(start, '|');
+  if (!end) end = start + strlen(start);
+  return true;
+}
+
+// Valeur de "key=" dans un bloc, uniquement en debut de champ
+static bool blockValue(const char *start, const char *end, const char *key,
+                       const char *&val, size_t &len) {
+  size_t klen = strlen(key);
+  const char *p = start;
+  while ((p = strstr(p, key)) != nullptr && p < end) {
+    bool atField = (p == start || p[-1] == ',');
+    if (atField && p + klen < end && p[klen] == '=') {
+      val = p + klen + 1;
+      const char *stop = val;
+      while (stop < end && *stop != ',') stop++;
+      len = stop - val;
+      return true;
+    }
+    p += klen;
   }
+  return false;
+}
 
-  int end = resp.indexOf(']', idx);
-  if (end < 0) {
-    Serial.println("Pas de ']' pour SYSTEMSTATU");
-    return "";
+static void readField(const char *start, const char *end, const char *key, String &dst) {
+  const char *val;
+  size_t len;
+  if (blockValue(start, end, key, val, len)) setField(dst, val, len);
+  else                                       setField(dst, "", 0);
+}
+
+static void parseMinerVersion(const char *resp, MinerVersionInfo &info) {
+  const char *start, *end;
+  if (!findBlock(resp, "VERSION,", start, end)) return;
+
+  readField(start, end, "CGMiner", info.cgminer);
+  readField(start, end, "API",     info.api);
+  readField(start, end, "PROD",    info.prod);
+  readField(start, end, "MODEL",   info.model);
+  readField(start, end, "MAC",     info.mac);
+}
+
+static void parseMinerSummary(const char *resp, MinerSummaryInfo &info) {
+  const char *start, *end;
+  if (!findBlock(resp, "SUMMARY,", start, end)) return;
+
+  LOG_D("miner", "SUMMARY %.*s", (int)(end - start), start);
+
+  readField(start, end, "Elapsed",         info.elapsed);
+  readField(start, end, "MHS av",          info.mhs_av);
+  readField(start, end, "MHS 5s",          info.mhs_5s);
+  readField(start, end, "Accepted",        info.accepted);
+  readField(start, end, "Rejected",        info.rejected);
+  readField(start, end, "Hardware Errors", info.hw_errors);
+}
+
+// Contenu de "TAG[...]" dans la reponse estats : [start, end)
+static bool findBracket(const char *resp, const char *tag, const char *&start, const char *&end) {
+  const char *p = strstr(resp, tag);
+  if (!p) return false;
+  start = p + strlen(tag);
+  end = strchr(start, ']');
+  return end != nullptr;
+}
+
+// extrait WORKMODE[n] depuis la reponse estats -> "eco"/"standard"/"super" ou nullptr
+static const char *getWorkModeFromEstats(const char *resp) {
+  const char *start, *end;
+  if (!findBracket(resp, "WORKMODE[", start, end)) return nullptr;
+  switch (strtol(start, nullptr, 10)) {
+    case 0: return "eco";
+    case 1: return "standard";
+    case 2: return "super";
   }
+  return nullptr;
+}
+
+// extrait power depuis la reponse estats
+// ex: PS[0 1209 2349 55 1306 2350 1364] -> dernier nombre "1364"
+static bool getPowerFromEstats(const char *resp, String &out) {
+  const char *start, *end;
+  if (!findBracket(resp, "PS[", start, end)) return false;
+
+  while (end > start && end[-1] == ' ') end--;
+  const char *p = end;
+  while (p > start && p[-1] != ' ') p--;
+  setField(out, p, end - p);
+  return end > p;
+}
 
-  String block = resp.substring(idx, end);
-  //Serial.println("Bloc SYSTEMSTATU :");
-  //Serial.println(block);
+// extrait une valeur numerique "TAG[xx]" de la reponse estats (NAN si absent)
+static float getBracketFloatFromEstats(const char *resp, const char *tag) {
+  const char *start, *end;
+  if (!findBracket(resp, tag, start, end) || end == start) return NAN;
+  return strtof(start, nullptr);
+}
+
+// extrait "Work: In Work" ou "Work: In Idle" depuis SYSTEMSTATU[...]
+static bool getWorkStateFromEstats(const char *resp, String &out) {
+  // On isole le bloc SYSTEMSTATU[ ... ]
+  const char *start, *end;
+  if (!findBracket(resp, "SYSTEMSTATU[", start, end)) {
+    LOG_D("miner", "Pas de SYSTEMSTATU[ trouve");
+    return false;
+  }
 
   // Cherche "Work:"
-  int w = block.indexOf("Work:");
-  if (w < 0) {
-    Serial.println("Pas de 'Work:' dans SYSTEMSTATU");
-    return "";
+  const char *w = strstr(start, "Work:");
+  if (!w || w >= end) {
+    LOG_D("miner", "Pas de 'Work:' dans SYSTEMSTATU");
+    return false;
   }
 
   w += 5; // saute "Work:"
-  // saute les espaces
-  while (w < (int)block.length() && (block[w] == ' ' || block[w] == '\t')) {
-    w++;
-  }
+  while (w < end && (*w == ' ' || *w == '\t')) w++;
 
   // fin = virgule ou fin du bloc
-  int stop = block.indexOf(',', w);
-  if (stop < 0) stop = block.length();
+  const char *stop = w;
+  while (stop < end && *stop != ',') stop++;
+  while (stop > w && stop[-1] == ' ') stop--;
 
-  String val = block.substring(w, stop);
-  val.trim();
-
-  //Serial.println("WorkState parse : " + val);
-  //Serial.println("===============================");
-
-  return val;   // ex: "In Work" ou "In Idle"
+  setField(out, w, stop - w);
+  return stop > w;   // ex: "In Work" ou "In Idle"
 }
 
 // =======================
 // Communication bas niveau
 // =======================
 
-static String avalonSendCommand(const char* ip, uint16_t port, const String& cmd) {
-  WiFiClient client;
-  String response;
+static bool resolveMiner() {
+  if (gMinerAddrOk) return true;
+  if (gMinerAddr.fromString(gMinerIP) || WiFi.hostByName(gMinerIP.c_str(), gMinerAddr) == 1) {
+    gMinerAddrOk = true;
+  }
+  return gMinerAddrOk;
+}
 
-  if (!client.connect(ip, port)) {
-    Serial.println("Connexion au miner impossible");
-    return "";
+// Socket lwIP brute : WiFiClient alloue poignee et tampon a chaque connexion
+static int openMinerSocket(uint16_t port) {
+  int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return -1;
+
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family      = AF_INET;
+  sa.sin_port        = htons(port);
+  sa.sin_addr.s_addr = (uint32_t)gMinerAddr;
+
+  // connexion non bloquante, bornee a MINER_CONNECT_MS
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  int r = lwip_connect(fd, (struct sockaddr *)&sa, sizeof(sa));
+  if (r < 0 && errno != EINPROGRESS) {
+    lwip_close(fd);
+    return -1;
+  }
+
+  fd_set wfds;
+  FD_ZERO(&wfds);
+  FD_SET(fd, &wfds);
+  struct timeval tv = { MINER_CONNECT_MS / 1000, (MINER_CONNECT_MS % 1000) * 1000 };
+  int err = 0;
+  socklen_t elen = sizeof(err);
+  if (lwip_select(fd + 1, nullptr, &wfds, nullptr, &tv) <= 0 ||
+      lwip_getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0 || err != 0) {
+    lwip_close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+
+  struct timeval rt = { 0, 200000 };   // recv rend la main toutes les 200 ms
+  lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rt, sizeof(rt));
+  return fd;
+}
+
+// Nom de la commande pour les histogrammes : "summary", "ascset|0,..." -> "ascset",
+// {"command":"pools",...} -> "pools"
+static int8_t commandProbe(const char *cmd) {
+  const char *p = cmd;
+  const char *key = strstr(cmd, "\"command\":\"");
+  if (key) p = key + 11;
+  char name[PERF_NAME_LEN];
+  size_t n = 0;
+  while (p[n] && p[n] != '|' && p[n] != '"' && n < sizeof(name) - 1) {
+    name[n] = p[n];
+    n++;
+  }
+  name[n] = '\0';
+  return perfProbe(PERF_MINER, name);
+}
+
+// Envoie cmd et passe la reponse par morceaux a sink jusqu'au '\0' final,
+// la fermeture cote miner ou l'echeance. false si rien n'a pu etre echange.
+static bool apiExchange(uint16_t port, const char *cmd, MinerRxSink sink, void *ctx) {
+  PerfScope ps(commandProbe(cmd));   // connexion comprise : c'est ce que voit l'appelant
+  if (!resolveMiner()) {
+    LOG_W("miner", "Adresse du miner invalide");
+    return false;
+  }
+
+  int fd = openMinerSocket(port);
+  if (fd < 0) {
+    LOG_W("miner", "Connexion au miner impossible");
+    return false;
   }
 
   // Comme "echo -n" : pas de \n
-  client.print(cmd);
-  client.flush();
-
-  unsigned long deadline = millis() + 3000; // timeout 3s
-  while (client.connected() && millis() < deadline) {
-    while (client.available()) {
-      char c = client.read();
-      response += c;
+  size_t clen = strlen(cmd);
+  if (lwip_send(fd, cmd, clen, 0) != (int)clen) {
+    lwip_close(fd);
+    return false;
+  }
+
+  static char chunk[256];
+  size_t total = 0;
+  uint32_t deadline = millis() + MINER_REPLY_MS;
+  while ((int32_t)(millis() - deadline) < 0) {
+    int n = lwip_recv(fd, chunk, sizeof(chunk), 0);
+    if (n > 0) {
+      // cgminer termine par un '\0'
+      const char *nul = (const char *)memchr(chunk, '\0', n);
+      size_t len = nul ? (size_t)(nul - chunk) : (size_t)n;
+      total += len;
+      if (len > 0 && !sink(ctx, chunk, len)) break;
+      if (nul) break;
+    } else if (n == 0) {
+      break;                                   // fermeture cote miner
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      break;
     }
   }
+  lwip_close(fd);
+
+  gPoll.commands++;
+  gPoll.lastPollBytes += total;
+  if (total > gPoll.rxHighWater) gPoll.rxHighWater = total;
+  return total > 0;
+}
+
+static bool rxBufSink(void *ctx, const char *data, size_t len) {
+  bool *truncated = (bool *)ctx;
+  size_t room = RX_BUF_SIZE - 1 - gRxLen;
+  if (len > room) {
+    len = room;
+    *truncated = true;
+  }
+  memcpy(gRxBuf + gRxLen, data, len);
+  gRxLen += len;
+  return !*truncated;
+}
+
+// Reponse dans gRxBuf (terminee par '\0'), renvoie sa longueur (0 = echec)
+static size_t avalonSendCommand(uint16_t port, const char *cmd) {
+  gRxLen = 0;
+  gRxBuf[0] = '\0';
+
+  bool truncated = false;
+  apiExchange(port, cmd, rxBufSink, &truncated);
+  gRxBuf[gRxLen] = '\0';
+
+  if (truncated) {
+    gPoll.rxTruncated++;
+    LOG_W("miner", "Reponse '%s' tronquee a %u octets", cmd, (unsigned)gRxLen);
+  }
+  return gRxLen;
+}
 
-  client.stop();
-  return response;
+bool minerApiRequest(const char *request, MinerRxSink sink, void *ctx) {
+  if (gMinerIP.length() == 0) return false;
+  const uint16_t port = 4028;
+  return apiExchange(port, request, sink, ctx);
 }
 
 // Commande officielle : ascset|0,workmode,set,<mode>
 // <mode> : 0=eco, 1=standard, 2=super
-static String makeModeCommand(const String &mode) {
-  if (mode == "eco")         return "ascset|0,workmode,set,0";
+static int8_t modeIndex(const String &mode) {
+  if (mode == "eco")         return 0;
   if (mode == "standard"
-   || mode == "normal")      return "ascset|0,workmode,set,1";  // compat "normal"
-  if (mode == "super")       return "ascset|0,workmode,set,2";
-  return "";
+   || mode == "normal")      return 1;  // compat "normal"
+  if (mode == "super")       return 2;
+  return -1;
 }
 
 // =======================
@@ -208,74 +408,102 @@ void minerInit() {
 
 void minerSetIP(const String &ip) {
   gMinerIP = ip;
+  gMinerAddrOk = false;
+  invalidateCache();   // autre miner, autres infos statiques
   minerPrefs.begin("miner", false);
   minerPrefs.putString("ip", ip);
   minerPrefs.end();
+
+  // nouvelle IP : on repart de zero
+  gPoll.failures    = 0;
+  gPoll.circuitOpen = false;
+  minerPollNow();
 }
 
 String minerGetIP() {
   return gMinerIP;
 }
 
+// Envoie la commande si elle n'est plus fraiche.
+// resp = gRxBuf, ou nullptr si servie par le cache.
+static bool fetchIfStale(PollCommand &pc, const char *&resp) {
+  uint32_t now = millis();
+  resp = nullptr;
+  if (isFresh(pc, now)) {
+    gPoll.cacheHits++;
+    return true;
+  }
+
+  const uint16_t port = 4028;
+  if (avalonSendCommand(port, pc.cmd) == 0) return false;
+
+  pc.valid     = true;
+  pc.fetchedMs = now;
+  resp = gRxBuf;
+  return true;
+}
+
+static void clearSummary() {
+  setField(gSumInfo.elapsed, "", 0);
+  setField(gSumInfo.mhs_av, "", 0);
+  setField(gSumInfo.mhs_5s, "", 0);
+  setField(gSumInfo.accepted, "", 0);
+  setField(gSumInfo.rejected, "", 0);
+  setField(gSumInfo.hw_errors, "", 0);
+}
+
 bool minerUpdate() {
   gLastError = "";
-  gVerInfo = MinerVersionInfo();
-  gSumInfo = MinerSummaryInfo();
-  gWorkState = "";
+  clearSummary();
+  setField(gWorkState, "", 0);
   gIsActive  = false;
-
+  gTempMax   = NAN;
+  gTempAvg   = NAN;
+  gPoll.lastPollBytes = 0;
 
   if (gMinerIP.length() == 0) {
     gLastError = "IP du miner non configuree.";
     return false;
   }
 
-  const uint16_t port = 4028;
-  Serial.print("Interrogation miner Avalon @ ");
-  Serial.println(gMinerIP);
+  LOG_D("miner", "Interrogation miner Avalon @ %s", gMinerIP.c_str());
 
-  // ----- VERSION -----
-  String v = avalonSendCommand(gMinerIP.c_str(), port, "version");
-  if (v.length() == 0) {
-    gLastError = "Aucune reponse (version).";
-    return false;
-  }
-  gVerInfo = parseMinerVersion(v);
+  const char *resp;
 
-  // ----- SUMMARY -----
-  String s = avalonSendCommand(gMinerIP.c_str(), port, "summary");
-  if (s.length() == 0) {
+  // ----- SUMMARY (en premier : Elapsed dit si le miner a redemarre) -----
+  if (!fetchIfStale(gPollCmds[PC_SUMMARY], resp)) {
     gLastError = "Aucune reponse (summary).";
     return false;
   }
-  gSumInfo = parseMinerSummary(s);
+  parseMinerSummary(resp, gSumInfo);
 
-  // ----- STATS (pour l'instant on verifie juste qu'il repond) -----
-  String st = avalonSendCommand(gMinerIP.c_str(), port, "stats");
-  if (st.length() == 0) {
-    gLastError = "Aucune reponse (stats).";
+  long elapsed = gSumInfo.elapsed.toInt();
+  if (gLastElapsed >= 0 && elapsed < gLastElapsed) {
+    LOG_I("miner", "Elapsed a recule : miner redemarre, cache invalide");
+    invalidateCache();
+    gPollCmds[PC_SUMMARY].valid = true;
+  }
+  gLastElapsed = elapsed;
+
+  // ----- VERSION (statique) -----
+  if (!fetchIfStale(gPollCmds[PC_VERSION], resp)) {
+    gLastError = "Aucune reponse (version).";
     return false;
   }
+  if (resp) parseMinerVersion(resp, gVerInfo);
 
   // ----- ESTATS : WORKMODE / puissance etc. -----
-  String es = avalonSendCommand(gMinerIP.c_str(), port, "estats");
-  if (es.length() > 0) {
-    String wm = getWorkModeFromEstats(es);   // "0", "1", "2", ...
-    if (wm == "0")      gCurrentMode = "eco";
-    else if (wm == "1") gCurrentMode = "standard";
-    else if (wm == "2") gCurrentMode = "super";
-    gPower = getPowerFromEstats(es);         // ex: "1364"
-  }
-
-  String ws = getWorkStateFromEstats(es);
-    if (ws.length() > 0) {
-      gWorkState = ws;
-      if (ws.indexOf("In Work") >= 0) {
-        gIsActive = true;
-      } else if (ws.indexOf("In Idle") >= 0) {
-        gIsActive = false;
-      }
+  if (fetchIfStale(gPollCmds[PC_ESTATS], resp) && resp) {
+    const char *wm = getWorkModeFromEstats(resp);
+    if (wm) gCurrentMode = wm;
+    if (!getPowerFromEstats(resp, gPower)) setField(gPower, "", 0);
+    gTempMax = getBracketFloatFromEstats(resp, "TMax[");
+    gTempAvg = getBracketFloatFromEstats(resp, "TAvg[");
+
+    if (getWorkStateFromEstats(resp, gWorkState)) {
+      gIsActive = strstr(gWorkState.c_str(), "In Work") != nullptr;
     }
+  }
 
   return true;
 }
@@ -290,9 +518,142 @@ MinerStatus minerGetStatus() {
   st.lastError = gLastError;
   st.workState = gWorkState;
   st.isActive  = gIsActive;
+  st.tempMax   = gTempMax;
+  st.tempAvg   = gTempAvg;
   return st;
 }
 
+int8_t minerStatusLevel(const MinerStatus &st) {
+  if (st.workState.length() > 0 && !st.isActive)           return 0;
+  if (st.workMode == "eco")                                 return 1;
+  if (st.workMode == "standard" || st.workMode == "normal") return 2;
+  if (st.workMode == "super")                               return 3;
+  return -1;
+}
+
+const char* minerLevelMode(int8_t level) {
+  switch (level) {
+    case 1: return "eco";
+    case 2: return "standard";
+    case 3: return "super";
+  }
+  return "";
+}
+
+bool minerReadState(String &mode, bool &active, bool &stateKnown) {
+  mode = "";
+  active = false;
+  stateKnown = false;
+  if (gMinerIP.length() == 0) return false;
+
+  const uint16_t port = 4028;
+  if (avalonSendCommand(port, "estats") == 0) return false;
+
+  const char *wm = getWorkModeFromEstats(gRxBuf);
+  bool hasState  = getWorkStateFromEstats(gRxBuf, gWorkState);
+  if (!wm && !hasState) return false;
+
+  // au passage, on rafraichit le status en cache
+  if (wm) {
+    mode = wm;
+    gCurrentMode = wm;
+  }
+  if (hasState) {
+    gIsActive = strstr(gWorkState.c_str(), "In Work") != nullptr;
+    active     = gIsActive;
+    stateKnown = true;
+  }
+  return true;
+}
+
+// ---- Ordonnanceur ----
+
+static bool pollIsFast(uint32_t now) {
+  return gHasDemand && (now - gLastDemandMs < POLL_DEMAND_HOLD_MS);
+}
+
+// Delai avant la prochaine interrogation apres un echec
+static uint32_t pollBackoffMs() {
+  uint32_t d = gPoll.intervalMs;
+  for (uint16_t i = 1; i < gPoll.failures && d < POLL_BACKOFF_MAX_MS; i++) {
+    d *= 2;
+  }
+  if (d > POLL_BACKOFF_MAX_MS) d = POLL_BACKOFF_MAX_MS;
+  return d;
+}
+
+bool minerPollLoop() {
+  uint32_t now = millis();
+
+  bool fast = pollIsFast(now);
+  if (fast != gPoll.fast) {
+    gPoll.fast       = fast;
+    gPoll.intervalMs = fast ? POLL_FAST_MS : POLL_IDLE_MS;
+    // passage en rapide : on n'attend pas la fin de l'intervalle lent
+    if (fast && !gPoll.circuitOpen && gPoll.failures == 0) {
+      uint32_t due = gPoll.lastPollMs + POLL_FAST_MS;
+      if ((int32_t)(gPoll.nextPollMs - due) > 0) gPoll.nextPollMs = due;
+    }
+  }
+  if (gPoll.intervalMs == 0) gPoll.intervalMs = POLL_IDLE_MS;
+
+  if (gMinerIP.length() == 0) return false;
+  if (gPoll.paused)           return false;   // lien coupe : pas la faute du miner
+  if (!WiFi.isConnected())    return false;
+  if (gPoll.lastPollMs != 0 && (int32_t)(now - gPoll.nextPollMs) < 0) return false;
+
+  gPoll.polls++;
+  gPoll.lastPollMs = now;
+  bool ok = minerUpdate();
+  now = millis();
+
+  if (ok) {
+    if (gPoll.circuitOpen) {
+      LOG_I("miner", "Miner de nouveau joignable, disjoncteur referme");
+      journalLog(JE_MINER_UP, JSRC_SYSTEM, 0, gMinerIP.c_str());
+    }
+    gPoll.failures    = 0;
+    gPoll.circuitOpen = false;
+    gPoll.lastOkMs    = now;
+    gPoll.nextPollMs  = now + gPoll.intervalMs;
+  } else {
+    gPoll.pollErrors++;
+    if (gPoll.failures < 0xFFFF) gPoll.failures++;
+
+    if (gPoll.failures >= CIRCUIT_TRIP_FAILS) {
+      // ouvert (ou demi-ouvert rate) : on laisse le miner tranquille
+      if (!gPoll.circuitOpen) {
+        LOG_W("miner", "Miner injoignable, disjoncteur ouvert");
+        journalLog(JE_MINER_DOWN, JSRC_SYSTEM, gPoll.failures, gLastError.c_str());
+      }
+      gPoll.circuitOpen = true;
+      gPoll.nextPollMs  = now + CIRCUIT_OPEN_MS;
+    } else {
+      gPoll.nextPollMs  = now + pollBackoffMs();
+    }
+  }
+  return true;
+}
+
+void minerPollDemand() {
+  gLastDemandMs = millis();
+  gHasDemand    = true;
+}
+
+void minerPollNow() {
+  gPoll.nextPollMs = millis();
+}
+
+void minerPollPause(bool paused) {
+  if (paused == gPoll.paused) return;
+  gPoll.paused = paused;
+  if (!paused) minerPollNow();   // donnees perimees pendant la coupure
+}
+
+MinerPollState minerGetPollState() {
+  return gPoll;
+}
+
 String minerSendMode(const String &mode, bool &ok) {
   ok = false;
   if (gMinerIP.length() == 0) {
@@ -300,29 +661,34 @@ String minerSendMode(const String &mode, bool &ok) {
     return "";
   }
 
-  String cmd = makeModeCommand(mode);
-  if (cmd.length() == 0) {
+  int8_t idx = modeIndex(mode);
+  if (idx < 0) {
     gLastError = "Mode inconnu.";
     return "";
   }
 
-  const uint16_t port = 4028;
-  String resp = avalonSendCommand(gMinerIP.c_str(), port, cmd);
+  CgStatus st;
+  ok = cgAscsetWorkMode(idx, st);
+  if (st.code == 0 && st.msg[0] == '\0') {
+    gLastError = "Aucune reponse (ascset).";
+    return "";
+  }
 
-  if (resp.indexOf("STATUS=S") >= 0) {
-    ok = true;
+  if (ok) {
     gCurrentMode = mode;
     minerPrefs.begin("miner", false);
     minerPrefs.putString("mode", mode);
     minerPrefs.end();
   } else {
-    gLastError = "Reponse miner : " + resp;
+    gLastError = "Reponse miner : ";
+    gLastError += st.msg;
   }
 
-  return resp;
+  return st.msg;
 }
 
-String minerSetStandby(uint32_t ts, bool &ok) {
+// ascset|0,softoff,1:<ts> / ascset|0,softon,1:<ts>
+static String sendSoftCommand(bool on, uint32_t ts, bool &ok) {
   ok = false;
   gLastError = "";
 
@@ -331,41 +697,26 @@ String minerSetStandby(uint32_t ts, bool &ok) {
     return "";
   }
 
-  const uint16_t port = 4028;
-  String cmd = "ascset|0,softoff,1:" + String(ts);
-  String resp = avalonSendCommand(gMinerIP.c_str(), port, cmd);
-
-  if (resp.indexOf("STATUS=I") >= 0 &&
-      resp.indexOf("success softoff:") >= 0) {
-    ok = true;
-  } else {
-    gLastError = "Reponse miner : " + resp;
-  }
-
-  return resp;
-}
-
-String minerSetWakeup(uint32_t ts, bool &ok) {
-  ok = false;
-  gLastError = "";
-
-  if (gMinerIP.length() == 0) {
-    gLastError = "IP du miner non configuree.";
+  CgStatus st;
+  ok = cgAscsetSoft(on, ts, st);
+  if (st.code == 0 && st.msg[0] == '\0') {
+    gLastError = "Aucune reponse (ascset).";
     return "";
   }
+  if (!ok) {
+    gLastError = "Reponse miner : ";
+    gLastError += st.msg;
+  }
 
-  const uint16_t port = 4028;
-  String cmd = "ascset|0,softon,1:" + String(ts);
-  String resp = avalonSendCommand(gMinerIP.c_str(), port, cmd);
+  return st.msg;
+}
 
-  if (resp.indexOf("STATUS=I") >= 0 &&
-      resp.indexOf("success softon:") >= 0) {
-    ok = true;
-  } else {
-    gLastError = "Reponse miner : " + resp;
-  }
+String minerSetStandby(uint32_t ts, bool &ok) {
+  return sendSoftCommand(false, ts, ok);
+}
 
-  return resp;
+String minerSetWakeup(uint32_t ts, bool &ok) {
+  return sendSoftCommand(true, ts, ok);
 }
 
 void minerFactoryReset() {
@@ -374,6 +725,9 @@ void minerFactoryReset() {
   minerPrefs.end();
 
   gMinerIP     = "";
+  gMinerAddrOk = false;
+  gVerInfo     = MinerVersionInfo();
+  invalidateCache();
   gCurrentMode = "";
   gPower       = "";
   gLastError   = "";
@@ -27,21 +27,81 @@ struct MinerStatus {
   String lastError;       // vide si OK
   String workState;       // texte brut venant de SYSTEMSTATU[Work: ...]
   bool   isActive;        // true = In Work, false = In Idle
+  float  tempMax;         // TMax[] des puces en C (NAN si absent)
+  float  tempAvg;         // TAvg[] des puces en C (NAN si absent)
+};
+
+// Delta d'un compteur cumulatif du miner (Accepted, Rejected...) depuis la
+// lecture precedente ; prev < 0 = premiere lecture, un compteur qui recule
+// = miner redemarre. Met prev a jour.
+inline long counterDelta(long cur, long &prev) {
+  long d;
+  if (prev < 0)        d = 0;
+  else if (cur < prev) d = cur;
+  else                 d = cur - prev;
+  prev = cur;
+  return d;
+}
+
+// Etat de l'ordonnanceur d'interrogation (pour supervision)
+struct MinerPollState {
+  uint32_t nextPollMs;    // millis() de la prochaine interrogation
+  uint32_t intervalMs;    // intervalle nominal courant (rapide / lent)
+  uint32_t lastPollMs;    // millis() de la derniere interrogation (0 = jamais)
+  uint32_t lastOkMs;      // millis() du dernier succes (0 = jamais)
+  uint16_t failures;      // echecs consecutifs
+  bool     circuitOpen;   // disjoncteur ouvert : plus d'interrogation avant nextPollMs
+  bool     fast;          // true = un client regarde (dashboard / page TFT)
+  bool     paused;        // lien WiFi coupe : interrogations suspendues
+  uint32_t polls;         // nombre total d'interrogations
+  uint32_t pollErrors;    // nombre total d'echecs
+  uint32_t lastPollBytes; // octets recus lors de la derniere interrogation
+  uint32_t commands;      // commandes envoyees (cumul)
+  uint32_t cacheHits;     // commandes evitees grace au cache (cumul)
+  uint32_t rxHighWater;   // plus grosse reponse recue (octets)
+  uint32_t rxTruncated;   // reponses tronquees (tampon de reception plein)
 };
 
 void minerInit();                      // charge IP + mode depuis NVS
 void minerSetIP(const String &ip);     // set + sauvegarde IP du miner
 String minerGetIP();                   // IP actuelle
 
-bool minerUpdate();                    // interroge version/summary/stats/estats
+bool minerUpdate();                    // interroge summary/estats (+ version si cache perime)
 MinerStatus minerGetStatus();          // dernier status connu
 
-// Envoie ascset|0,workmode,set,<mode>
+// Ordonnanceur : rapide si quelqu'un regarde, lent sinon,
+// backoff exponentiel + disjoncteur apres des echecs consecutifs.
+bool minerPollLoop();                  // a appeler dans loop(), true si une interrogation a eu lieu (meme ratee)
+void minerPollDemand();                // un client regarde -> rythme rapide
+void minerPollNow();                   // force une interrogation au prochain tour
+// Suspend les interrogations (WiFi coupe) ; la reprise interroge aussitot.
+void minerPollPause(bool paused);
+MinerPollState minerGetPollState();
+
+// Relit uniquement estats : mode ("eco"/"standard"/"super") et In Work / In Idle.
+// Sert a confirmer les commandes. false si pas de reponse exploitable ;
+// mode = "" si WORKMODE absent, stateKnown = false si SYSTEMSTATU absent
+// (active n'a alors pas de sens).
+bool minerReadState(String &mode, bool &active, bool &stateKnown);
+
+// Echange brut sur le port API : envoie request et passe la reponse par
+// morceaux a sink (false = arreter la lecture). Sert au client JSON (cgapi).
+typedef bool (*MinerRxSink)(void *ctx, const char *data, size_t len);
+bool minerApiRequest(const char *request, MinerRxSink sink, void *ctx);
+
+// Envoie ascset|0,workmode,set,<mode> (API JSON, cf. cgapi.h)
 // mode : "eco" / "standard" / "super"
+// Renvoie le Msg du bloc STATUS de la reponse (tronque a 80 caracteres).
 String minerSendMode(const String &mode, bool &ok);
 
+// ascset|0,softoff|softon,1:<ts> ; meme valeur de retour
 String minerSetStandby(uint32_t ts, bool &ok);
 String minerSetWakeup(uint32_t ts, bool &ok);
 
+// Echelle commune aux automatismes :
+// 0 = veille, 1 = eco, 2 = standard, 3 = super, -1 = inconnu
+int8_t minerStatusLevel(const MinerStatus &st);
+const char* minerLevelMode(int8_t level);   // 1..3 -> "eco"/"standard"/"super"
+
 // Reset complet de la config miner (IP, mode, etc.)
 void minerFactoryReset();
\ No newline at end of file
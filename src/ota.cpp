@@ -0,0 +1,532 @@
+#include "ota.h"
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <Preferences.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/version.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <time.h>
+
+#include "journal.h"
+#include "logger.h"
+#include "ota_roots.h"
+#include "version.h"
+
+// mbedTLS 3 (IDF 5) a supprime les variantes _ret
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+#define sha256Starts mbedtls_sha256_starts
+#define sha256Update mbedtls_sha256_update
+#define sha256Finish mbedtls_sha256_finish
+#else
+#define sha256Starts mbedtls_sha256_starts_ret
+#define sha256Update mbedtls_sha256_update_ret
+#define sha256Finish mbedtls_sha256_finish_ret
+#endif
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences otaPrefs;
+
+static const char *OTA_DEFAULT_MANIFEST_URL =
+  "https://raw.githubusercontent.com/Rastafouille/Avalon_home_controler/main/firmware/manifest.json";
+
+const uint32_t OTA_TASK_STACK      = 10240;   // mbedTLS
+const uint32_t OTA_CHECK_DELAY_MS  = 5000;    // laisse passer la premiere interrogation du miner
+const size_t   OTA_CHUNK           = 4096;    // un secteur flash par ecriture
+const uint16_t OTA_READ_TIMEOUT_MS = 15000;   // plus rien recu -> coupure
+const uint8_t  OTA_MAX_RESUMES     = 5;
+const uint32_t OTA_RESUME_DELAY_MS = 2000;    // x numero de la reprise
+
+struct OtaManifest {
+  String   version;
+  String   url;
+  uint32_t size;
+  String   sha256;   // 64 hex minuscules
+};
+
+static TaskHandle_t gTask = nullptr;
+static String gManifestUrl;
+static String gCaPem;
+static bool   gInsecure = false;
+
+// ecrits par la tache OTA, lus par loop() et le serveur web
+static portMUX_TYPE gMux = portMUX_INITIALIZER_UNLOCKED;
+static OtaStatus gStatus = {};
+static char      gLine1[24];
+static char      gLine2[40];
+static uint32_t  gMsgSeq = 0;
+
+static void otaMessage(const char *line1, const String &line2) {
+  portENTER_CRITICAL(&gMux);
+  strncpy(gLine1, line1, sizeof(gLine1) - 1);
+  strncpy(gLine2, line2.c_str(), sizeof(gLine2) - 1);
+  gMsgSeq++;
+  portEXIT_CRITICAL(&gMux);
+}
+
+static void setState(OtaState state, const char *error = nullptr) {
+  portENTER_CRITICAL(&gMux);
+  gStatus.state = state;
+  if (error) strncpy(gStatus.error, error, sizeof(gStatus.error) - 1);
+  portEXIT_CRITICAL(&gMux);
+}
+
+static void setProgress(uint32_t written, uint8_t resumes) {
+  portENTER_CRITICAL(&gMux);
+  gStatus.written = written;
+  gStatus.resumes = resumes;
+  portEXIT_CRITICAL(&gMux);
+}
+
+static void loadConfig() {
+  otaPrefs.begin("ota", true);
+  gManifestUrl = otaPrefs.getString("url", "");
+  gCaPem       = otaPrefs.getString("ca", "");
+  gInsecure    = otaPrefs.getBool("insecure", false);
+  otaPrefs.end();
+  if (gManifestUrl.length() == 0) gManifestUrl = OTA_DEFAULT_MANIFEST_URL;
+}
+
+// =======================
+// Semver
+// =======================
+
+struct SemVer {
+  unsigned long num[3];
+  const char   *pre;      // nullptr = version finale
+  size_t        preLen;
+};
+
+static void parseSemver(const char *s, SemVer &v) {
+  memset(&v, 0, sizeof(v));
+  if (*s == 'v' || *s == 'V') s++;
+  for (uint8_t i = 0; i < 3; i++) {
+    char *end;
+    v.num[i] = strtoul(s, &end, 10);
+    s = end;
+    if (*s != '.') break;
+    s++;
+  }
+  if (*s == '-') {
+    v.pre    = s + 1;
+    v.preLen = strcspn(v.pre, "+");   // les metadonnees de build ne comptent pas
+  }
+}
+
+static bool allDigits(const char *s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (!isdigit((unsigned char)s[i])) return false;
+  }
+  return n > 0;
+}
+
+// identifiants separes par '.' : numeriques compares en nombre et places
+// avant les alphanumeriques ; a prefixe egal, le plus court precede
+static int comparePre(const char *a, size_t na, const char *b, size_t nb) {
+  while (na && nb) {
+    size_t la = 0, lb = 0;
+    while (la < na && a[la] != '.') la++;
+    while (lb < nb && b[lb] != '.') lb++;
+
+    bool da = allDigits(a, la), db = allDigits(b, lb);
+    int c;
+    if (da && db) {
+      unsigned long x = strtoul(a, nullptr, 10), y = strtoul(b, nullptr, 10);
+      c = x < y ? -1 : x > y ? 1 : 0;
+    } else if (da || db) {
+      c = da ? -1 : 1;
+    } else {
+      c = strncmp(a, b, la < lb ? la : lb);
+      if (c == 0) c = la < lb ? -1 : la > lb ? 1 : 0;
+    }
+    if (c) return c;
+
+    a += la; na -= la;
+    b += lb; nb -= lb;
+    if (na) { a++; na--; }
+    if (nb) { b++; nb--; }
+  }
+  return na ? 1 : nb ? -1 : 0;
+}
+
+int otaSemverCompare(const char *a, const char *b) {
+  SemVer va, vb;
+  parseSemver(a, va);
+  parseSemver(b, vb);
+  for (uint8_t i = 0; i < 3; i++) {
+    if (va.num[i] != vb.num[i]) return va.num[i] < vb.num[i] ? -1 : 1;
+  }
+  if (!va.pre || !vb.pre) return (va.pre ? -1 : 0) + (vb.pre ? 1 : 0);
+  return comparePre(va.pre, va.preLen, vb.pre, vb.preLen);
+}
+
+// =======================
+// Manifeste
+// =======================
+
+// Valeur d'une cle de premier niveau : chaine (sans echappement) ou nombre
+static bool jsonField(const String &body, const char *key, String &out) {
+  int k = body.indexOf("\"" + String(key) + "\"");
+  if (k < 0) return false;
+  int i = body.indexOf(':', k);
+  if (i < 0) return false;
+  i++;
+  while (i < (int)body.length() && isspace((unsigned char)body[i])) i++;
+  if (i >= (int)body.length()) return false;
+
+  if (body[i] == '"') {
+    int end = body.indexOf('"', i + 1);
+    if (end < 0) return false;
+    out = body.substring(i + 1, end);
+  } else {
+    int end = i;
+    while (end < (int)body.length() && body[end] != ',' && body[end] != '}' && !isspace((unsigned char)body[end])) end++;
+    out = body.substring(i, end);
+  }
+  return out.length() > 0;
+}
+
+static bool parseManifest(const String &body, OtaManifest &m) {
+  String size;
+  if (!jsonField(body, "version", m.version) || !jsonField(body, "url", m.url) ||
+      !jsonField(body, "size", size) || !jsonField(body, "sha256", m.sha256)) {
+    return false;
+  }
+  m.size = strtoul(size.c_str(), nullptr, 10);
+  m.sha256.toLowerCase();
+  if (m.size == 0 || m.sha256.length() != 64) return false;
+  for (size_t i = 0; i < 64; i++) {
+    if (!isxdigit((unsigned char)m.sha256[i])) return false;
+  }
+
+  // URL relative : meme dossier que le manifeste
+  if (m.url.indexOf("://") < 0) {
+    m.url = gManifestUrl.substring(0, gManifestUrl.lastIndexOf('/') + 1) + m.url;
+  }
+  return true;
+}
+
+static void setupClient(WiFiClientSecure &client) {
+  if (gInsecure) {
+    // choix explicite (serveur de test) : seul le SHA-256 du manifeste
+    // protege l'image, et un manifeste falsifie le fournit
+    client.setInsecure();
+  } else if (gCaPem.length() > 0) {
+    client.setCACert(gCaPem.c_str());
+  } else {
+    client.setCACert(OTA_ROOT_CAS);
+  }
+}
+
+static bool fetchManifest(OtaManifest &m) {
+  WiFiClientSecure client;
+  setupClient(client);
+  HTTPClient https;
+
+  if (!https.begin(client, gManifestUrl)) {
+    setState(OTA_FAILED, "manifeste : begin");
+    return false;
+  }
+  https.setTimeout(OTA_READ_TIMEOUT_MS);
+  int code = https.GET();
+  if (code != HTTP_CODE_OK) {
+    LOG_W("ota", "Manifeste : HTTP %d", code);
+    https.end();
+    setState(OTA_FAILED, ("manifeste : HTTP " + String(code)).c_str());
+    return false;
+  }
+  String body = https.getString();
+  https.end();
+
+  if (!parseManifest(body, m)) {
+    LOG_W("ota", "Manifeste invalide");
+    setState(OTA_FAILED, "manifeste invalide");
+    return false;
+  }
+  LOG_I("ota", "Manifeste : v%s, %lu octets, %s", m.version.c_str(), (unsigned long)m.size, m.url.c_str());
+  return true;
+}
+
+// =======================
+// Telechargement
+// =======================
+
+static String hexDigest(const uint8_t *d) {
+  char hex[65];
+  for (uint8_t i = 0; i < 32; i++) sprintf(hex + 2 * i, "%02x", d[i]);
+  return String(hex);
+}
+
+// Ecrit l'image par blocs en hachant au passage ; une coupure reprend a
+// l'octet suivant (Range). false = Update annule, partition inchangee.
+static bool download(const OtaManifest &m) {
+  if (!Update.begin(m.size)) {
+    setState(OTA_FAILED, Update.errorString());
+    return false;
+  }
+  uint8_t *buf = (uint8_t *)malloc(OTA_CHUNK);
+  if (!buf) {
+    Update.abort();
+    setState(OTA_FAILED, "memoire");
+    return false;
+  }
+
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  sha256Starts(&sha, 0);
+
+  WiFiClientSecure client;
+  setupClient(client);
+
+  const char *error = nullptr;
+  uint32_t done = 0;
+  uint8_t resumes = 0;
+  uint8_t lastPct = 0xFF;
+
+  while (done < m.size && !error) {
+    HTTPClient https;
+    int code = -1;
+    if (https.begin(client, m.url)) {
+      https.setTimeout(OTA_READ_TIMEOUT_MS);
+      if (done > 0) https.addHeader("Range", "bytes=" + String(done) + "-");
+      code = https.GET();
+    }
+
+    if (done > 0 && code == HTTP_CODE_OK) {
+      error = "serveur sans Range";   // renverrait tout depuis le debut
+    } else if (code == (done > 0 ? HTTP_CODE_PARTIAL_CONTENT : HTTP_CODE_OK)) {
+      int len = https.getSize();
+      if (len > 0 && (uint32_t)len != m.size - done) {
+        error = "taille differente du manifeste";
+      }
+
+      WiFiClient *stream = https.getStreamPtr();
+      uint32_t lastRx = millis();
+      while (!error && done < m.size && millis() - lastRx < OTA_READ_TIMEOUT_MS) {
+        int avail = stream->available();
+        if (avail <= 0) {
+          if (!https.connected()) break;
+          delay(2);
+          continue;
+        }
+        size_t want = (size_t)avail < OTA_CHUNK ? (size_t)avail : OTA_CHUNK;
+        if (want > m.size - done) want = m.size - done;
+        int rd = stream->readBytes(buf, want);
+        if (rd <= 0) break;
+
+        if (Update.write(buf, rd) != (size_t)rd) {
+          error = Update.errorString();
+          break;
+        }
+        sha256Update(&sha, buf, rd);
+        done  += rd;
+        lastRx = millis();
+
+        uint8_t pct = (uint64_t)done * 100 / m.size;
+        if (pct / 10 != lastPct / 10) {
+          lastPct = pct;
+          otaMessage("Telechargement", String(pct) + "% (" + String(done / 1024) + " ko)");
+        }
+        setProgress(done, resumes);
+      }
+    }
+    https.end();
+
+    if (!error && done < m.size) {
+      if (++resumes > OTA_MAX_RESUMES) {
+        error = "trop de coupures";
+        break;
+      }
+      LOG_W("ota", "Coupure a %lu / %lu octets (HTTP %d), reprise %u", (unsigned long)done,
+            (unsigned long)m.size, code, (unsigned)resumes);
+      setProgress(done, resumes);
+      delay(OTA_RESUME_DELAY_MS * resumes);
+    }
+  }
+  free(buf);
+
+  uint8_t digest[32];
+  sha256Finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+
+  if (!error) {
+    setState(OTA_VERIFYING);
+    String got = hexDigest(digest);
+    if (got != m.sha256) {
+      LOG_E("ota", "SHA-256 %s, attendu %s", got.c_str(), m.sha256.c_str());
+      error = "SHA-256 incorrect";
+    }
+  }
+  if (error) {
+    Update.abort();   // la partition de boot ne change pas
+    setState(OTA_FAILED, error);
+    return false;
+  }
+
+  // image complete et verifiee : seulement maintenant on bascule
+  if (!Update.end() || !Update.isFinished()) {
+    setState(OTA_FAILED, Update.errorString());
+    return false;
+  }
+  return true;
+}
+
+static void runCheck() {
+  setState(OTA_CHECKING, "");
+  time_t t = time(nullptr);
+  portENTER_CRITICAL(&gMux);
+  gStatus.lastCheckEpoch = t > 1600000000 ? (uint32_t)t : 0;
+  portEXIT_CRITICAL(&gMux);
+
+  LOG_I("ota", "Verification de %s", gManifestUrl.c_str());
+  OtaManifest m;
+  if (!fetchManifest(m)) return;
+
+  portENTER_CRITICAL(&gMux);
+  strncpy(gStatus.remoteVersion, m.version.c_str(), sizeof(gStatus.remoteVersion) - 1);
+  gStatus.size    = m.size;
+  gStatus.written = 0;
+  gStatus.resumes = 0;
+  portEXIT_CRITICAL(&gMux);
+
+  if (otaSemverCompare(m.version.c_str(), FW_VERSION) <= 0) {
+    LOG_I("ota", "Firmware a jour (v" FW_VERSION ", distant v%s)", m.version.c_str());
+    setState(OTA_UP_TO_DATE);
+    return;
+  }
+
+  otaMessage("Mise a jour dispo", "v" FW_VERSION " -> v" + m.version);
+  journalLog(JE_OTA, JSRC_SYSTEM, 0, ("v" + m.version).c_str());
+  setState(OTA_DOWNLOADING);
+
+  if (!download(m)) {
+    OtaStatus st = otaGetStatus();
+    LOG_E("ota", "Echec : %s", st.error);
+    journalLog(JE_OTA, JSRC_SYSTEM, -1, st.error);
+    otaMessage("Echec mise a jour", st.error);
+    return;
+  }
+
+  LOG_I("ota", "Mise a jour OK, reboot...");
+  journalLog(JE_OTA, JSRC_SYSTEM, 1, ("v" + m.version).c_str());
+  setState(OTA_REBOOTING);
+  otaMessage("Mise a jour OK", "Redemarrage...");
+  delay(1500);   // le temps que loop() affiche le message
+  ESP.restart();
+}
+
+static void otaTask(void *arg) {
+  if (arg) delay(OTA_CHECK_DELAY_MS);   // verification du boot : apres les premieres donnees
+  runCheck();
+  portENTER_CRITICAL(&gMux);
+  gStatus.running = false;
+  gTask = nullptr;
+  portEXIT_CRITICAL(&gMux);
+  vTaskDelete(nullptr);
+}
+
+// =======================
+// API publique
+// =======================
+
+void otaStart() {
+  static bool sBoot = true;
+  portENTER_CRITICAL(&gMux);
+  bool running = gStatus.running;
+  gStatus.running = true;
+  portEXIT_CRITICAL(&gMux);
+  if (running) return;
+
+  loadConfig();
+  void *delayed = sBoot ? (void *)1 : nullptr;
+  sBoot = false;
+  if (xTaskCreatePinnedToCore(otaTask, "ota", OTA_TASK_STACK, delayed, 1, &gTask, 0) != pdPASS) {
+    gStatus.running = false;
+    setState(OTA_FAILED, "tache");
+  }
+}
+
+OtaStatus otaGetStatus() {
+  portENTER_CRITICAL(&gMux);
+  OtaStatus st = gStatus;
+  portEXIT_CRITICAL(&gMux);
+  return st;
+}
+
+const char* otaStateLabel(uint8_t state) {
+  switch (state) {
+    case OTA_IDLE:        return "inactif";
+    case OTA_CHECKING:    return "verification";
+    case OTA_UP_TO_DATE:  return "a jour";
+    case OTA_DOWNLOADING: return "telechargement";
+    case OTA_VERIFYING:   return "verification SHA-256";
+    case OTA_REBOOTING:   return "redemarrage";
+    case OTA_FAILED:      return "echec";
+  }
+  return "?";
+}
+
+bool otaPollMessage(String &line1, String &line2) {
+  static uint32_t seen = 0;
+  if (gMsgSeq == seen) return false;
+  portENTER_CRITICAL(&gMux);
+  line1 = gLine1;
+  line2 = gLine2;
+  seen  = gMsgSeq;
+  portEXIT_CRITICAL(&gMux);
+  return true;
+}
+
+String otaGetManifestUrl() {
+  otaPrefs.begin("ota", true);
+  String url = otaPrefs.getString("url", "");
+  otaPrefs.end();
+  return url.length() ? url : String(OTA_DEFAULT_MANIFEST_URL);
+}
+
+void otaSetManifestUrl(const String &url) {
+  otaPrefs.begin("ota", false);
+  if (url.length() && url != OTA_DEFAULT_MANIFEST_URL) otaPrefs.putString("url", url);
+  else otaPrefs.remove("url");
+  otaPrefs.end();
+}
+
+bool otaHasCaCert() {
+  otaPrefs.begin("ota", true);
+  bool has = otaPrefs.isKey("ca");
+  otaPrefs.end();
+  return has;
+}
+
+void otaSetCaCert(const String &pem) {
+  otaPrefs.begin("ota", false);
+  if (pem.length()) otaPrefs.putString("ca", pem);
+  else otaPrefs.remove("ca");
+  otaPrefs.end();
+}
+
+bool otaIsInsecure() {
+  otaPrefs.begin("ota", true);
+  bool insecure = otaPrefs.getBool("insecure", false);
+  otaPrefs.end();
+  return insecure;
+}
+
+void otaSetInsecure(bool insecure) {
+  otaPrefs.begin("ota", false);
+  if (insecure) otaPrefs.putBool("insecure", true);
+  else otaPrefs.remove("insecure");
+  otaPrefs.end();
+}
+
+void otaFactoryReset() {
+  otaPrefs.begin("ota", false);
+  otaPrefs.clear();
+  otaPrefs.end();
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <Arduino.h>
+
+// Mise a jour du firmware par manifeste JSON :
+//   { "version": "0.3.0", "url": "firmware.bin", "size": 944480,
+//     "sha256": "<64 hex>" }
+// "url" est absolue ou relative au manifeste. La version est comparee en
+// semver a FW_VERSION ; l'image est ecrite par blocs, reprise par requete
+// Range apres une coupure, et son SHA-256 verifie avant la bascule de
+// partition. Tout se passe dans une tache dediee.
+//
+// Le serveur est authentifie par les racines integrees (ota_roots.h).
+// L'URL du manifeste et un certificat racine (PEM) sont reglables (NVS
+// "ota") : un serveur HTTPS local de test peut remplacer GitHub.
+
+enum OtaState : uint8_t {
+  OTA_IDLE = 0,
+  OTA_CHECKING,
+  OTA_UP_TO_DATE,
+  OTA_DOWNLOADING,
+  OTA_VERIFYING,
+  OTA_REBOOTING,
+  OTA_FAILED
+};
+
+struct OtaStatus {
+  OtaState state;
+  bool     running;            // tache en cours
+  char     remoteVersion[24];  // "" = manifeste pas encore lu
+  uint32_t size;               // octets annonces par le manifeste
+  uint32_t written;            // octets ecrits en flash
+  uint8_t  resumes;            // reprises Range pendant le telechargement
+  char     error[48];          // derniere erreur ("" = aucune)
+  uint32_t lastCheckEpoch;     // 0 = jamais
+};
+
+void otaStart();               // lance la verification (tache de fond)
+OtaStatus otaGetStatus();
+const char* otaStateLabel(uint8_t state);
+
+// Nouveau message a afficher sur le TFT (une fois chacun), lu par loop()
+bool otaPollMessage(String &line1, String &line2);
+
+String otaGetManifestUrl();
+void otaSetManifestUrl(const String &url);   // "" = URL par defaut
+bool otaHasCaCert();
+void otaSetCaCert(const String &pem);        // "" = racines integrees
+bool otaIsInsecure();
+void otaSetInsecure(bool insecure);          // true = TLS sans verification (test)
+
+// <0, 0, >0 comme strcmp ; "0.2" vaut "0.2.0", une pre-version
+// ("1.0.0-rc.1") precede la version finale
+int otaSemverCompare(const char *a, const char *b);
+
+void otaFactoryReset();
@@ -0,0 +1,205 @@
+#include "perf.h"
+
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "trace.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+// seau : 0..1 = 0..1 us, puis 2 seaux par octave [2^k, 1.5*2^k[ et [1.5*2^k, 2^(k+1)[
+const uint8_t  PERF_BUCKETS      = 56;        // jusqu'a ~2^28 us (4 min)
+const uint32_t PERF_HEAP_EVERY_MS = 1000;
+
+struct PerfHist {
+  char     name[PERF_NAME_LEN];
+  uint8_t  kind;
+  uint16_t buckets[PERF_BUCKETS];   // divises par 2 a saturation
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+};
+
+static PerfHist gHists[PERF_MAX_PROBES];
+static uint8_t  gHistCount = 0;
+
+static PerfHeap gHeap = {};
+static PerfBoot gBoot = {};
+static uint32_t gLastHeapMs = 0;
+
+// taches suivies si elles existent (handles resolus au premier echantillon)
+static const char *TASK_NAMES[PERF_MAX_TASKS] = {
+  "loopTask", "tiT", "wifi", "sys_evt", "esp_timer", "IDLE0", "IDLE1", "arduino_events"
+};
+static TaskHandle_t gTaskHandles[PERF_MAX_TASKS];
+
+static uint8_t bucketOf(uint32_t us) {
+  if (us < 2) return us;
+  uint8_t oct = 31 - __builtin_clz(us);               // >= 1
+  uint8_t idx = oct * 2 + ((us >> (oct - 1)) & 1);    // 2..
+  return idx < PERF_BUCKETS ? idx : PERF_BUCKETS - 1;
+}
+
+// milieu du seau : erreur bornee a +-25 % quelle que soit la valeur
+static uint32_t bucketMid(uint8_t idx) {
+  if (idx < 2) return idx;
+  uint8_t oct = idx / 2;
+  uint32_t half = 1UL << (oct - 1);
+  return (1UL << oct) + (idx & 1) * half + half / 2;
+}
+
+static uint32_t percentile(const PerfHist &h, uint32_t total, uint16_t perMille) {
+  uint32_t want = (total * perMille + 999) / 1000;
+  if (want == 0) want = 1;
+  uint32_t acc = 0;
+  for (uint8_t i = 0; i < PERF_BUCKETS; i++) {
+    acc += h.buckets[i];
+    if (acc >= want) {
+      uint32_t mid = bucketMid(i);
+      return mid < h.maxUs ? mid : h.maxUs;
+    }
+  }
+  return h.maxUs;
+}
+
+static void sampleHeap(uint32_t now) {
+  gHeap.sampledMs    = now;
+  gHeap.freeHeap     = ESP.getFreeHeap();
+  gHeap.minFreeHeap  = ESP.getMinFreeHeap();
+  gHeap.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  if (gHeap.minLargestBlock == 0 || gHeap.largestBlock < gHeap.minLargestBlock) {
+    gHeap.minLargestBlock = gHeap.largestBlock;
+  }
+
+  gHeap.taskCount = 0;
+  for (uint8_t i = 0; i < PERF_MAX_TASKS; i++) {
+    if (!gTaskHandles[i]) gTaskHandles[i] = xTaskGetHandle(TASK_NAMES[i]);
+    if (!gTaskHandles[i]) continue;
+    PerfTask &t = gHeap.tasks[gHeap.taskCount++];
+    t.name      = TASK_NAMES[i];
+    t.stackFree = uxTaskGetStackHighWaterMark(gTaskHandles[i]);   // octets sous ESP-IDF
+  }
+}
+
+// =======================
+// API publique
+// =======================
+
+int8_t perfProbe(PerfKind kind, const char *name) {
+  for (uint8_t i = 0; i < gHistCount; i++) {
+    if (gHists[i].kind == kind && strncmp(gHists[i].name, name, PERF_NAME_LEN - 1) == 0) return i;
+  }
+  if (gHistCount >= PERF_MAX_PROBES) return -1;
+
+  PerfHist &h = gHists[gHistCount];
+  memset(&h, 0, sizeof(h));
+  strncpy(h.name, name, PERF_NAME_LEN - 1);
+  h.kind = kind;
+  return gHistCount++;
+}
+
+void perfRecord(int8_t probe, uint32_t us) {
+  if (probe < 0 || probe >= gHistCount) return;
+  PerfHist &h = gHists[probe];
+
+  uint8_t b = bucketOf(us);
+  if (h.buckets[b] == 0xFFFF) {
+    // saturation : on divise tout par 2, les proportions restent justes
+    for (uint8_t i = 0; i < PERF_BUCKETS; i++) h.buckets[i] >>= 1;
+  }
+  h.buckets[b]++;
+  h.count++;
+  h.sumUs += us;
+  if (us > h.maxUs) h.maxUs = us;
+}
+
+void perfSpan(int8_t probe, uint32_t startUs, uint32_t us) {
+  if (probe < 0 || probe >= gHistCount) return;
+  perfRecord(probe, us);
+  const PerfHist &h = gHists[probe];
+  if (h.kind != PERF_LOOP || us >= PERF_TRACE_LOOP_MIN_US) traceComplete(h.name, h.kind, startUs, us);
+}
+
+void perfBootMark(PerfBootStage stage) {
+  if (stage >= BOOT_STAGE_COUNT || gBoot.ms[stage] != 0) return;
+  gBoot.ms[stage] = millis();
+  LOG_I("boot", "%s a %lu ms", perfBootStageLabel(stage), (unsigned long)gBoot.ms[stage]);
+}
+
+void perfBootSetFastWifi(bool fast) {
+  gBoot.fastWifi = fast;
+}
+
+PerfBoot perfGetBoot() {
+  return gBoot;
+}
+
+const char* perfBootStageLabel(uint8_t stage) {
+  switch (stage) {
+    case BOOT_WIFI:       return "wifi";
+    case BOOT_FIRST_PAGE: return "first_page";
+    case BOOT_FIRST_DATA: return "first_data";
+  }
+  return "?";
+}
+
+void perfLoop() {
+  uint32_t now = millis();
+  if (gLastHeapMs != 0 && now - gLastHeapMs < PERF_HEAP_EVERY_MS) return;
+  gLastHeapMs = now;
+  sampleHeap(now);
+}
+
+uint8_t perfProbeCount() {
+  return gHistCount;
+}
+
+bool perfGet(uint8_t i, PerfSummary &out) {
+  if (i >= gHistCount) return false;
+  const PerfHist &h = gHists[i];
+
+  memcpy(out.name, h.name, sizeof(out.name));
+  out.kind  = h.kind;
+  out.count = h.count;
+  out.avgUs = h.count ? (uint32_t)(h.sumUs / h.count) : 0;
+  out.maxUs = h.maxUs;
+
+  uint32_t total = 0;
+  for (uint8_t b = 0; b < PERF_BUCKETS; b++) total += h.buckets[b];
+  out.p50Us = total ? percentile(h, total, 500) : 0;
+  out.p95Us = total ? percentile(h, total, 950) : 0;
+  out.p99Us = total ? percentile(h, total, 990) : 0;
+  return true;
+}
+
+PerfHeap perfGetHeap() {
+  return gHeap;
+}
+
+void perfReset() {
+  for (uint8_t i = 0; i < gHistCount; i++) {
+    PerfHist &h = gHists[i];
+    memset(h.buckets, 0, sizeof(h.buckets));
+    h.count = 0;
+    h.sumUs = 0;
+    h.maxUs = 0;
+  }
+  gHeap.minLargestBlock = 0;
+}
+
+const char* perfKindLabel(uint8_t kind) {
+  switch (kind) {
+    case PERF_MINER:   return "miner";
+    case PERF_HTTP:    return "http";
+    case PERF_HTML:    return "html";
+    case PERF_NET:     return "net";
+    case PERF_SENSOR:  return "sensor";
+    case PERF_DISPLAY: return "display";
+    case PERF_LOOP:    return "loop";
+  }
+  return "?";
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <Arduino.h>
+
+// Instrumentation : temps d'execution ranges dans des histogrammes a
+// seaux fixes (2 seaux par octave de microsecondes, percentiles a +-25 %),
+// plus echantillonnage du tas et des piles des taches.
+// Tout tourne dans la tache loop : pas de verrou.
+//
+//   static int8_t sProbe = perfProbe(PERF_SENSOR, "dht");
+//   PerfScope ps(sProbe);   // mesure jusqu'a la fin du bloc
+
+enum PerfKind : uint8_t {
+  PERF_MINER = 0,   // commande cgminer (connexion + envoi + reponse)
+  PERF_HTTP,        // handler HTTP complet
+  PERF_HTML,        // construction d'une page
+  PERF_NET,         // envoi d'une reponse (WiFi)
+  PERF_SENSOR,      // lecture DHT
+  PERF_DISPLAY,     // dessin TFT
+  PERF_LOOP,        // tour de loop()
+  PERF_KIND_COUNT
+};
+
+const uint8_t PERF_MAX_PROBES = 64;
+const uint8_t PERF_NAME_LEN   = 20;
+const uint8_t PERF_MAX_TASKS  = 8;
+
+// Cree (ou retrouve) une sonde ; -1 si la table est pleine
+int8_t perfProbe(PerfKind kind, const char *name);
+void perfRecord(int8_t probe, uint32_t us);
+// perfRecord + span dans la trace (cf. trace.h) ; les tours de loop()
+// ne sont traces qu'au-dela de PERF_TRACE_LOOP_MIN_US
+void perfSpan(int8_t probe, uint32_t startUs, uint32_t us);
+const uint32_t PERF_TRACE_LOOP_MIN_US = 2000;
+
+struct PerfScope {
+  int8_t   probe;
+  uint32_t t0;
+  explicit PerfScope(int8_t p) : probe(p), t0(micros()) {}
+  ~PerfScope() { perfSpan(probe, t0, micros() - t0); }
+};
+
+struct PerfSummary {
+  char     name[PERF_NAME_LEN];
+  uint8_t  kind;
+  uint32_t count;       // mesures depuis le dernier reset
+  uint32_t avgUs;
+  uint32_t p50Us;       // milieu du seau, plafonne au max
+  uint32_t p95Us;
+  uint32_t p99Us;
+  uint32_t maxUs;
+};
+
+struct PerfTask {
+  const char *name;
+  uint32_t stackFree;   // plus bas niveau de pile libre (octets)
+};
+
+struct PerfHeap {
+  uint32_t sampledMs;   // 0 = jamais
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;     // depuis le boot
+  uint32_t largestBlock;
+  uint32_t minLargestBlock; // depuis le dernier reset
+  uint8_t  taskCount;
+  PerfTask tasks[PERF_MAX_TASKS];
+};
+
+// Jalons du demarrage (millis() depuis le reset), chacun note une seule fois
+enum PerfBootStage : uint8_t {
+  BOOT_WIFI = 0,      // WiFi connecte
+  BOOT_FIRST_PAGE,    // premiere page TFT affichee apres setup()
+  BOOT_FIRST_DATA,    // premier status miner recu
+  BOOT_STAGE_COUNT
+};
+
+struct PerfBoot {
+  uint32_t ms[BOOT_STAGE_COUNT];   // 0 = pas encore atteint
+  bool     fastWifi;               // reconnexion par BSSID / canal en cache
+};
+
+void perfBootMark(PerfBootStage stage);
+void perfBootSetFastWifi(bool fast);
+PerfBoot perfGetBoot();
+const char* perfBootStageLabel(uint8_t stage);
+
+void perfLoop();            // a appeler dans loop() : echantillonne le tas
+uint8_t perfProbeCount();
+bool perfGet(uint8_t i, PerfSummary &out);
+PerfHeap perfGetHeap();
+void perfReset();           // remet les histogrammes a zero
+const char* perfKindLabel(uint8_t kind);
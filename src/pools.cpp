@@ -0,0 +1,281 @@
+#include "pools.h"
+
+#include <WiFi.h>
+#include <Preferences.h>
+#include <time.h>
+
+#include "miner.h"
+#include "journal.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences poolsPrefs;
+
+static PoolsConfig gCfg   = { false, 30, 5.0f, 600, 20, 600 };
+static PoolsStats  gStats = {};
+
+const float    POOL_TAU_S         = 600.0f;   // fenetre glissante des taux
+const uint32_t POOL_CONFIRM_MS    = 5000;     // interrogation rapide apres switchpool
+const uint32_t POOL_SWITCH_MAX_MS = 120000;   // au-dela, bascule non confirmee
+
+// compteurs precedents par slot (un autre URL dans le slot = on repart de zero)
+struct PoolCounters {
+  char     url[sizeof(((CgPool *)0)->url)];
+  long     acc;
+  long     rej;
+  long     stale;
+  float    wAcc;     // sommes amorties (decroissance exp. de constante POOL_TAU_S)
+  float    wRej;
+  float    wStale;
+};
+
+static PoolCounters gPrev[CG_MAX_POOLS];
+static uint32_t gNextPollMs    = 0;
+static uint32_t gPrevPollMs    = 0;
+static uint32_t gLastHealthyMs = 0;   // derniere lecture ou le pool actif etait sain
+static bool     gActiveDegraded = false;
+
+static int8_t   gSwitchTarget  = -1;  // POOL vise par le switchpool en cours
+static uint32_t gSwitchSentMs  = 0;
+static uint32_t gLastSwitchMs  = 0;   // pour le delai entre deux bascules
+
+static void updateRates(uint8_t i, PoolHealth &h, float dtS) {
+  PoolCounters &pc = gPrev[i];
+  if (strcmp(pc.url, h.pool.url) != 0) {
+    memset(&pc, 0, sizeof(pc));
+    strncpy(pc.url, h.pool.url, sizeof(pc.url) - 1);
+    pc.acc = pc.rej = pc.stale = -1;
+  }
+
+  long dAcc   = counterDelta(h.pool.accepted, pc.acc);
+  long dRej   = counterDelta(h.pool.rejected, pc.rej);
+  long dStale = counterDelta(h.pool.stale, pc.stale);
+
+  float decay = dtS > 0 ? expf(-dtS / POOL_TAU_S) : 1.0f;
+  pc.wAcc   = pc.wAcc * decay + dAcc;
+  pc.wRej   = pc.wRej * decay + dRej;
+  pc.wStale = pc.wStale * decay + dStale;
+
+  float total = pc.wAcc + pc.wRej + pc.wStale;
+  h.acceptPerMin = pc.wAcc / (POOL_TAU_S / 60.0f);
+  h.rejectPct    = total > 0 ? 100.0f * pc.wRej / total : 0;
+  h.stalePct     = total > 0 ? 100.0f * pc.wStale / total : 0;
+}
+
+static float windowShares(uint8_t i) {
+  return gPrev[i].wAcc + gPrev[i].wRej + gPrev[i].wStale;
+}
+
+static void evaluate(uint8_t i, PoolHealth &h, bool isActive, bool minerWorking, time_t nowEpoch) {
+  h.degraded = false;
+  h.reason   = "";
+  h.shareAgeSec = 0;
+  if (nowEpoch > 1600000000 && h.pool.lastShareTime > 0 && (time_t)h.pool.lastShareTime <= nowEpoch) {
+    h.shareAgeSec = (uint32_t)(nowEpoch - h.pool.lastShareTime);
+  }
+
+  if (strcmp(h.pool.status, "Alive") != 0) {
+    h.degraded = true;
+    h.reason   = "injoignable";
+  } else if (windowShares(i) >= gCfg.minShares &&
+             h.rejectPct + h.stalePct > gCfg.maxRejectPct) {
+    h.degraded = true;
+    h.reason   = "rejets";
+  } else if (isActive && minerWorking && gCfg.maxShareAgeSec > 0 &&
+             h.shareAgeSec > gCfg.maxShareAgeSec) {
+    h.degraded = true;
+    h.reason   = "pas de share";
+  }
+}
+
+static int8_t findActive() {
+  int8_t best = -1;
+  for (uint8_t i = 0; i < gStats.count; i++) {
+    if (gStats.pools[i].pool.stratumActive) return i;
+  }
+  // pas de stratum actif (getwork / pool en cours de connexion) :
+  // cgminer mine sur le pool vivant de plus haute priorite
+  for (uint8_t i = 0; i < gStats.count; i++) {
+    const CgPool &p = gStats.pools[i].pool;
+    if (strcmp(p.status, "Alive") != 0) continue;
+    if (best < 0 || p.priority < gStats.pools[best].pool.priority) best = i;
+  }
+  return best;
+}
+
+static int8_t findFailoverTarget(int8_t active) {
+  int8_t best = -1;
+  for (uint8_t i = 0; i < gStats.count; i++) {
+    if (i == active || gStats.pools[i].degraded) continue;
+    if (best < 0 || gStats.pools[i].pool.priority < gStats.pools[best].pool.priority) best = i;
+  }
+  return best;
+}
+
+// Delai entre le debut (estime) de la degradation et sa detection
+static uint32_t detectLatency(const PoolHealth &h, uint32_t now) {
+  if (strcmp(h.reason, "pas de share") == 0) {
+    return (h.shareAgeSec - gCfg.maxShareAgeSec) * 1000UL;
+  }
+  return gLastHealthyMs ? now - gLastHealthyMs : 0;
+}
+
+static void tryFailover(int8_t active, uint32_t now) {
+  const PoolHealth &cur = gStats.pools[active];
+  int8_t target = findFailoverTarget(active);
+  if (target < 0) return;   // rien de mieux
+
+  const CgPool &to = gStats.pools[target].pool;
+  CgStatus st;
+  bool ok = cgSwitchPool((uint8_t)to.index, st);
+
+  gStats.failovers++;
+  gLastSwitchMs = now;
+  gStats.lastFailoverEpoch = (uint32_t)time(nullptr);
+  gStats.lastFailoverInfo  = "pool " + String(cur.pool.index) + " -> " + String(to.index) +
+                             " (" + cur.reason;
+  if (strcmp(cur.reason, "rejets") == 0) {
+    gStats.lastFailoverInfo += " " + String(cur.rejectPct + cur.stalePct, 1) + "%";
+  }
+  gStats.lastFailoverInfo += ")";
+  journalLog(JE_POOL_SWITCH, JSRC_POOLS, ok ? to.index : -1, gStats.lastFailoverInfo.c_str());
+
+  if (ok) {
+    gSwitchTarget = to.index;
+    gSwitchSentMs = now;
+    LOG_I("pools", "Bascule %s", gStats.lastFailoverInfo.c_str());
+  } else {
+    gStats.failoverFailures++;
+    gStats.lastFailoverInfo += " refusee : ";
+    gStats.lastFailoverInfo += st.msg;
+    LOG_W("pools", "switchpool refuse (%s)", st.msg);
+  }
+}
+
+static void pollPools(uint32_t now) {
+  CgPool raw[CG_MAX_POOLS];
+  uint8_t count = 0;
+  CgStatus st;
+  if (!cgPools(raw, CG_MAX_POOLS, count, st)) {
+    gStats.pollErrors++;
+    return;
+  }
+
+  float dtS = gPrevPollMs ? (now - gPrevPollMs) / 1000.0f : 0;
+  gPrevPollMs = now;
+  gStats.lastPollMs = now;
+  gStats.count = count;
+
+  for (uint8_t i = 0; i < count; i++) {
+    gStats.pools[i].pool = raw[i];
+    updateRates(i, gStats.pools[i], dtS);
+  }
+
+  int8_t active = findActive();
+  gStats.active = active;
+
+  bool   working  = minerGetStatus().isActive;
+  time_t nowEpoch = time(nullptr);
+  for (uint8_t i = 0; i < count; i++) {
+    evaluate(i, gStats.pools[i], i == active, working, nowEpoch);
+  }
+
+  // bascule en cours : confirmee quand le pool vise devient actif
+  if (gSwitchTarget >= 0) {
+    if (active >= 0 && gStats.pools[active].pool.index == gSwitchTarget) {
+      gStats.lastSwitchMs = now - gSwitchSentMs;
+      if (gStats.lastSwitchMs > gStats.maxSwitchMs) gStats.maxSwitchMs = gStats.lastSwitchMs;
+      gSwitchTarget = -1;
+    } else if (now - gSwitchSentMs > POOL_SWITCH_MAX_MS) {
+      gStats.failoverFailures++;
+      gSwitchTarget = -1;
+    }
+  }
+
+  if (active < 0) return;
+  const PoolHealth &h = gStats.pools[active];
+
+  if (!h.degraded) {
+    gActiveDegraded = false;
+    gLastHealthyMs  = now;
+    return;
+  }
+
+  if (!gActiveDegraded) {
+    gActiveDegraded = true;
+    gStats.lastDetectMs = detectLatency(h, now);
+    if (gStats.lastDetectMs > gStats.maxDetectMs) gStats.maxDetectMs = gStats.lastDetectMs;
+    LOG_W("pools", "Pool %d degrade (%s)", h.pool.index, h.reason);
+  }
+
+  if (gCfg.autoFailover && gSwitchTarget < 0 &&
+      (gLastSwitchMs == 0 || now - gLastSwitchMs >= gCfg.cooldownSec * 1000UL)) {
+    tryFailover(active, now);
+  }
+}
+
+// =======================
+// API publique
+// =======================
+
+void poolsInit() {
+  poolsPrefs.begin("pools", true);
+  gCfg.autoFailover   = poolsPrefs.getBool("auto", false);
+  gCfg.pollSec        = poolsPrefs.getUShort("poll", 30);
+  gCfg.maxRejectPct   = poolsPrefs.getFloat("maxRej", 5.0f);
+  gCfg.maxShareAgeSec = poolsPrefs.getUShort("maxAge", 600);
+  gCfg.minShares      = poolsPrefs.getUShort("minShares", 20);
+  gCfg.cooldownSec    = poolsPrefs.getUShort("cooldown", 600);
+  poolsPrefs.end();
+
+  for (uint8_t i = 0; i < CG_MAX_POOLS; i++) gPrev[i].url[0] = '\0';
+  gStats.active = -1;
+}
+
+void poolsLoop() {
+  uint32_t now = millis();
+  if ((int32_t)(now - gNextPollMs) < 0) return;
+
+  if (minerGetIP().length() == 0 || !WiFi.isConnected()) return;
+  if (minerGetPollState().circuitOpen) return;   // miner injoignable, inutile d'insister
+
+  pollPools(now);
+
+  // apres un switchpool, on relit vite pour mesurer la bascule
+  uint32_t period = gSwitchTarget >= 0 ? POOL_CONFIRM_MS : gCfg.pollSec * 1000UL;
+  gNextPollMs = millis() + period;
+}
+
+PoolsConfig poolsGetConfig() {
+  return gCfg;
+}
+
+void poolsSetConfig(const PoolsConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.pollSec < 5) gCfg.pollSec = 5;
+
+  poolsPrefs.begin("pools", false);
+  poolsPrefs.putBool("auto", gCfg.autoFailover);
+  poolsPrefs.putUShort("poll", gCfg.pollSec);
+  poolsPrefs.putFloat("maxRej", gCfg.maxRejectPct);
+  poolsPrefs.putUShort("maxAge", gCfg.maxShareAgeSec);
+  poolsPrefs.putUShort("minShares", gCfg.minShares);
+  poolsPrefs.putUShort("cooldown", gCfg.cooldownSec);
+  poolsPrefs.end();
+
+  gNextPollMs = millis();
+}
+
+PoolsStats poolsGetStats() {
+  return gStats;
+}
+
+void poolsFactoryReset() {
+  poolsPrefs.begin("pools", false);
+  poolsPrefs.clear();
+  poolsPrefs.end();
+  poolsInit();
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <Arduino.h>
+#include "cgapi.h"
+
+// Surveillance des pools : interroge "pools" periodiquement, calcule par
+// pool des taux rejet / stale glissants (EWMA sur les deltas de compteurs)
+// et l'age du dernier share. Si le pool actif se degrade, bascule sur le
+// meilleur pool sain (switchpool) et mesure le temps de bascule.
+
+struct PoolsConfig {
+  bool     autoFailover;
+  uint16_t pollSec;         // periode d'interrogation
+  float    maxRejectPct;    // rejets + stale au-dela -> degrade
+  uint16_t maxShareAgeSec;  // aucun share accepte depuis -> degrade
+  uint16_t minShares;       // parts mini dans la fenetre avant de juger les taux
+  uint16_t cooldownSec;     // pas de nouvelle bascule avant
+};
+
+struct PoolHealth {
+  CgPool   pool;            // derniere lecture brute
+  float    acceptPerMin;    // EWMA 10 min
+  float    rejectPct;       // rejetes / total (EWMA)
+  float    stalePct;        // stale / total (EWMA)
+  uint32_t shareAgeSec;     // age du dernier share (0 = inconnu)
+  bool     degraded;
+  const char *reason;       // "" si sain
+};
+
+struct PoolsStats {
+  uint8_t  count;
+  int8_t   active;                // index dans pools[] du pool actif (-1 = aucun)
+  uint32_t lastPollMs;            // 0 = jamais
+  uint32_t pollErrors;
+  uint32_t failovers;             // switchpool envoyes
+  uint32_t failoverFailures;      // refuses ou jamais confirmes
+  uint32_t lastDetectMs;          // derniere lecture saine -> degradation constatee
+  uint32_t maxDetectMs;
+  uint32_t lastSwitchMs;          // switchpool envoye -> nouveau pool actif lu
+  uint32_t maxSwitchMs;
+  uint32_t lastFailoverEpoch;     // 0 = jamais
+  String   lastFailoverInfo;      // "pool 0 -> 1 (rejets 12.3%)"
+  PoolHealth pools[CG_MAX_POOLS];
+};
+
+void poolsInit();
+void poolsLoop();             // a appeler dans loop()
+
+PoolsConfig poolsGetConfig();
+void poolsSetConfig(const PoolsConfig &cfg);
+PoolsStats poolsGetStats();
+
+void poolsFactoryReset();
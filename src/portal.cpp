@@ -2,22 +2,31 @@
 
 #include <WiFi.h>
 #include <WebServer.h>
+#include <DNSServer.h>
 #include <Preferences.h>
 
 #include "display.h"
 #include "miner.h"
+#include "cmdqueue.h"
+#include "schedule.h"
+#include "thermostat.h"
+#include "governor.h"
+#include "autotune.h"
+#include "analytics.h"
+#include "pools.h"
+#include "fan.h"
+#include "alerts.h"
+#include "history.h"
+#include "journal.h"
+#include "perf.h"
+#include "stall.h"
+#include "trace.h"
+#include "logger.h"
+#include "wifisup.h"
+#include "ota.h"
 #include <time.h>   // pour getLocalTime, configTime
 
-#include <WiFiClientSecure.h>
-#include <HTTPClient.h>
-#include <Update.h>
 #include "version.h"  // si FW_VERSION n'est pas visible, mieux vaut le mettre dans un version.h
-static void checkGithubUpdateAtBoot();
-const char* GITHUB_VERSION_URL =
-  "https://raw.githubusercontent.com/Rastafouille/Avalon_home_controler/refs/heads/main/firmware/version.txt";
-
-const char* GITHUB_FIRMWARE_BASE_URL =
-  "https://raw.githubusercontent.com/Rastafouille/Avalon_home_controler/main/firmware/";
 
 
 // Décalage UTC en heures (-12 .. +12), par défaut 1 (Europe/Paris)
@@ -42,7 +51,26 @@ static bool configMode = false;
 static const char* apSSID = "KON8_Config";
 static const char* apPASS = "12345678";
 
-static String ssidOptionsHTML;
+// ---- Mode AP : portail captif ----
+// Toute resolution DNS renvoie l'IP de l'AP et toute URL inconnue redirige
+// vers "/" : les telephones ouvrent d'eux-memes la page de configuration.
+// Les reseaux visibles sont rafraichis par scans asynchrones.
+const uint8_t  AP_SCAN_MAX      = 20;
+const uint32_t AP_SCAN_EVERY_MS = 30000;
+const uint32_t AP_SCAN_MAX_MS   = 10000;   // scan sans reponse -> abandonne
+
+struct ApNetwork {
+  String  ssid;
+  int32_t rssi;
+  bool    open;
+};
+
+static DNSServer dnsServer;
+static ApNetwork gApNets[AP_SCAN_MAX];
+static uint8_t   gApNetCount = 0;
+static bool      gApScanning = false;
+static bool      gApScanned  = false;   // au moins un scan termine
+static uint32_t  gApScanMs   = 0;       // debut du dernier scan
 
 // ---- Timezone / horloge ----
 static String gTimezone = "Europe/Paris";
@@ -76,6 +104,51 @@ static String formatElapsed(const String &elapsedSecStr) {
 
 
 
+// echappe une chaine pour l'inclure dans du JSON
+static String jsonEscape(const String &in) {
+  String out = in;
+  out.replace("\\", "\\\\");
+  out.replace("\"", "\\\"");
+  out.replace("\r", " ");
+  out.replace("\n", " ");
+  return out;
+}
+
+// echappe une chaine pour l'inclure dans du HTML (regles d'alerte : "<", ">")
+static String htmlEscape(const String &in) {
+  String out = in;
+  out.replace("&", "&amp;");
+  out.replace("<", "&lt;");
+  out.replace(">", "&gt;");
+  out.replace("\"", "&quot;");
+  return out;
+}
+
+// etat de l'ordonnanceur miner -> "toutes les 2s, il y a 1s" / "disjoncteur ouvert..."
+static String formatPollState(const MinerPollState &ps) {
+  uint32_t now = millis();
+  String out;
+  if (ps.lastPollMs == 0) {
+    out = "en attente";
+  } else {
+    out = "il y a " + String((now - ps.lastPollMs) / 1000) + "s";
+  }
+  if (ps.circuitOpen) {
+    out += ", disjoncteur ouvert";
+  } else {
+    out += ", toutes les " + String(ps.intervalMs / 1000) + "s";
+  }
+  if (ps.failures > 0) {
+    out += ", " + String(ps.failures) + " echec(s) consecutif(s)";
+  }
+  if (ps.lastPollMs != 0) {
+    int32_t next = (int32_t)(ps.nextPollMs - now);
+    if (next < 0) next = 0;
+    out += ", prochaine dans " + String(next / 1000) + "s";
+  }
+  return out;
+}
+
 static String formatModeLabel(const String &mode) {
   if (mode == "eco")                 return "Eco 🌿";
   if (mode == "standard"
@@ -107,8 +180,7 @@ static void applyTimeConfig() {
   long gmtOffsetSec   = offset * 3600;
   long daylightOffset = 0;  // tu ne gères plus l’heure d’été ici, juste un décalage brut
 
-  Serial.print("Apply UTC offset = ");
-  Serial.println(offset);
+  LOG_I("portal", "Decalage UTC applique : %d h", offset);
 
   configTime(gmtOffsetSec, daylightOffset,
              "pool.ntp.org", "time.nist.gov");
@@ -128,6 +200,82 @@ static String getTimeString() {
 
 
 
+// =======================
+// Mode AP : scan des reseaux
+// =======================
+
+static void apScanStart() {
+  gApScanMs = millis();   // un echec attend aussi AP_SCAN_EVERY_MS
+  if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED) return;
+  gApScanning = true;
+}
+
+// Resultats du scan : un SSID une seule fois (le plus fort de ses points
+// d'acces), tries par RSSI decroissant
+static void apScanCollect(int16_t n) {
+  gApNetCount = 0;
+  for (int16_t i = 0; i < n; i++) {
+    String ssid = WiFi.SSID(i);
+    if (ssid.length() == 0) continue;   // reseau cache
+    int32_t rssi = WiFi.RSSI(i);
+
+    uint8_t j = 0;
+    while (j < gApNetCount && gApNets[j].ssid != ssid) j++;
+    if (j < gApNetCount) {
+      if (rssi <= gApNets[j].rssi) continue;
+    } else if (gApNetCount < AP_SCAN_MAX) {
+      j = gApNetCount++;
+    } else if (rssi > gApNets[AP_SCAN_MAX - 1].rssi) {
+      j = AP_SCAN_MAX - 1;   // remplace le plus faible
+    } else {
+      continue;
+    }
+    gApNets[j].ssid = ssid;
+    gApNets[j].rssi = rssi;
+    gApNets[j].open = WiFi.encryptionType(i) == WIFI_AUTH_OPEN;
+
+    // remonte l'entree a sa place (liste deja triee)
+    while (j > 0 && gApNets[j - 1].rssi < gApNets[j].rssi) {
+      ApNetwork t = gApNets[j - 1];
+      gApNets[j - 1] = gApNets[j];
+      gApNets[j] = t;
+      j--;
+    }
+  }
+  gApScanned = true;
+}
+
+static void apScanLoop() {
+  uint32_t now = millis();
+  if (gApScanning) {
+    int16_t n = WiFi.scanComplete();
+    if (n == WIFI_SCAN_RUNNING && now - gApScanMs < AP_SCAN_MAX_MS) return;
+    if (n >= 0) {
+      apScanCollect(n);
+      LOG_I("wifi", "Scan : %u reseau(x) visible(s)", (unsigned)gApNetCount);
+    }
+    WiFi.scanDelete();
+    gApScanning = false;
+  } else if (now - gApScanMs >= AP_SCAN_EVERY_MS) {
+    apScanStart();
+  }
+}
+
+static String apOptionsHtml() {
+  if (gApNetCount == 0) {
+    return gApScanned ? "<option value=\"\">Aucun reseau trouve</option>"
+                      : "<option value=\"\">Recherche en cours...</option>";
+  }
+  String out;
+  for (uint8_t i = 0; i < gApNetCount; i++) {
+    String ssid = htmlEscape(gApNets[i].ssid);
+    out += "<option value=\"" + ssid + "\">" + ssid + " (" + String(gApNets[i].rssi) + " dBm)";
+    if (gApNets[i].open) out += " ouvert";
+    out += "</option>";
+  }
+  return out;
+}
+
 // =======================
 // HTML PAGES
 // =======================
@@ -167,10 +315,10 @@ static String htmlConfigPage() {
   <div>
     <form action="/save" method="POST">
       <h3>Réseaux détectés :</h3>
-      <select name="ssid">
+      <select name="ssid" id="ssid">
 )rawliteral";
 
-  page += ssidOptionsHTML;
+  page += apOptionsHtml();
 
   page += R"rawliteral(
       </select>
@@ -181,11 +329,35 @@ static String htmlConfigPage() {
       <h3>Mot de passe :</h3>
       <input type="password" name="pass" placeholder="password">
 
+      <h3>IP fixe (optionnel) :</h3>
+      <input type="text" name="ip" placeholder="192.168.1.50 (vide = DHCP)">
+      <input type="text" name="gw" placeholder="Passerelle 192.168.1.1">
+      <input type="text" name="mask" placeholder="Masque 255.255.255.0">
+      <input type="text" name="dns" placeholder="DNS (defaut = passerelle)">
+
       <br><br>
       <input type="submit" value="Enregistrer">
     </form>
   </div>
 
+  <script>
+  // liste des reseaux rafraichie sans recharger la page (saisie conservee)
+  setInterval(function () {
+    fetch('/api/scan').then(function (r) { return r.json(); }).then(function (j) {
+      var sel = document.getElementById('ssid'), cur = sel.value, html = '';
+      j.networks.forEach(function (n) {
+        var o = document.createElement('option');
+        o.value = n.ssid;
+        o.textContent = n.ssid + ' (' + n.rssi + ' dBm)' + (n.open ? ' ouvert' : '');
+        html += o.outerHTML;
+      });
+      if (!html) html = '<option value="">' + (j.scanning ? 'Recherche en cours...' : 'Aucun reseau trouve') + '</option>';
+      sel.innerHTML = html;
+      if (cur) sel.value = cur;
+    }).catch(function () {});
+  }, 5000);
+  </script>
+
 </body>
 </html>
 )rawliteral";
@@ -193,12 +365,636 @@ static String htmlConfigPage() {
   return page;
 }
 
+// ---- Section analyse (EWMA, efficacite, energie) ----
+static String htmlAnalyticsSection() {
+  AnalyticsSnapshot a = analyticsGet();
+  AnalyticsConfig   c = analyticsGetConfig();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>📈 Analyse</h2>
+)rawliteral";
+
+  if (a.samples == 0) {
+    page += "<p>Pas encore de mesure.</p>";
+  } else {
+    page += "<p><b>Hashrate :</b> " + String(a.ths1m, 2) + " TH/s (1 min) &nbsp; " +
+            String(a.ths15m, 2) + " (15 min) &nbsp; " + String(a.ths60m, 2) + " (1 h)</p>";
+    if (a.jth > 0) {
+      page += "<p><b>Efficacite :</b> " + String(a.jth, 1) + " J/TH (" +
+              String(a.watts15m, 0) + " W)</p>";
+    }
+    page += "<p><b>Rejets :</b> " + String(a.rejectPct, 2) + " % &nbsp; <b>Erreurs HW :</b> " +
+            String(a.hwPerMin, 2) + " /min</p>";
+  }
+
+  page += "<p><b>Energie :</b> " + String(a.kwhTotal, 2) + " kWh (HP " +
+          String(a.kwh[TARIFF_HP], 2) + ", HC " + String(a.kwh[TARIFF_HC], 2) + ")";
+  if (a.sinceEpoch > 0) {
+    time_t t = (time_t)a.sinceEpoch;
+    struct tm lt;
+    localtime_r(&t, &lt);
+    char buf[16];
+    strftime(buf, sizeof(buf), "%d/%m/%Y", &lt);
+    page += " depuis le " + String(buf);
+  }
+  page += "</p>";
+
+  page += "<form action=\"/analytics\" method=\"POST\">";
+  page += "<label>Heures creuses de / a (h) :</label><br>";
+  page += "<input type=\"text\" name=\"hcStart\" style=\"width:30%\" value=\"" + String(c.hcStartHour) + "\">";
+  page += "<input type=\"text\" name=\"hcEnd\" style=\"width:30%\" value=\"" + String(c.hcEndHour) + "\">";
+  page += R"rawliteral(
+      <br><br>
+      <input type="submit" name="save" value="Enregistrer">
+      <input type="submit" name="reset" value="Remettre les kWh a zero">
+    </form>
+  </div>
+)rawliteral";
+  return page;
+}
+
+// ---- Section planning hebdomadaire ----
+static String htmlScheduleSection() {
+  static const char* dayNames[7] = { "Lu", "Ma", "Me", "Je", "Ve", "Sa", "Di" };
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>📅 Planning</h2>
+)rawliteral";
+
+  page += "<form action=\"/sched_enable\" method=\"POST\">";
+  page += "<label><input type=\"checkbox\" name=\"enabled\"";
+  if (scheduleIsEnabled()) page += " checked";
+  page += "> Planning actif</label> ";
+  page += "<input type=\"submit\" value=\"Appliquer\"></form>";
+
+  uint32_t nextEpoch;
+  SchedRule nextRule;
+  if (scheduleNext(nextEpoch, nextRule)) {
+    time_t t = (time_t)nextEpoch;
+    struct tm lt;
+    localtime_r(&t, &lt);
+    char buf[24];
+    strftime(buf, sizeof(buf), "%d/%m %H:%M", &lt);
+    page += "<p><b>Prochaine transition :</b> " + String(scheduleActionLabel(nextRule.action)) +
+            " le " + String(buf) + "</p>";
+  }
+
+  SchedRule rules[SCHED_MAX_RULES];
+  uint8_t n = scheduleGetRules(rules, SCHED_MAX_RULES);
+  if (n == 0) {
+    page += "<p><i>Aucune regle.</i></p>";
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    const SchedRule &r = rules[i];
+    char hhmm[8];
+    snprintf(hhmm, sizeof(hhmm), "%02u:%02u", r.hour, r.minute);
+
+    page += "<form action=\"/sched_del\" method=\"POST\"><p>";
+    for (uint8_t d = 0; d < 7; d++) {
+      if (r.days & (1 << d)) { page += dayNames[d]; page += " "; }
+    }
+    page += "<b>" + String(hhmm) + "</b> &rarr; " + scheduleActionLabel(r.action);
+    page += " <input type=\"hidden\" name=\"idx\" value=\"" + String(i) + "\">";
+    page += "<input type=\"submit\" value=\"Supprimer\"></p></form>";
+  }
+
+  if (n < SCHED_MAX_RULES) {
+    page += "<h3>Ajouter une regle</h3><form action=\"/sched_add\" method=\"POST\"><p>";
+    for (uint8_t d = 0; d < 7; d++) {
+      page += "<label><input type=\"checkbox\" name=\"d" + String(d) + "\" checked>";
+      page += dayNames[d];
+      page += "</label> ";
+    }
+    page += R"rawliteral(</p>
+      <input type="time" name="at" value="22:00" required>
+      <select name="action">
+        <option value="0">Eco 🌿</option>
+        <option value="1">Standard ⚙️</option>
+        <option value="2">Super 🚀</option>
+        <option value="3">Veille (softoff)</option>
+        <option value="4">Reveil (softon)</option>
+      </select>
+      <br><br>
+      <input type="submit" value="Ajouter">
+    </form>
+)rawliteral";
+  }
+
+  page += "</div>";
+  return page;
+}
+
+// ---- Section thermostat ----
+static String htmlThermostatSection() {
+  ThermoConfig c = thermostatGetConfig();
+  ThermoStats  st = thermostatGetStats();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>🔥 Thermostat</h2>
+    <form action="/thermo" method="POST">
+)rawliteral";
+
+  page += "<label><input type=\"checkbox\" name=\"enabled\"";
+  if (c.enabled) page += " checked";
+  page += "> Piloter le miner selon la temperature ambiante</label><br>";
+  page += "<label>Consigne (&deg;C) :</label><br><input type=\"text\" name=\"setpoint\" value=\"" + String(c.setpointC, 1) + "\"><br>";
+  page += "<label>Hysteresis (&plusmn; &deg;C) :</label><br><input type=\"text\" name=\"hyst\" value=\"" + String(c.hysteresisC, 1) + "\"><br>";
+  page += "<label>Duree mini entre deux changements (min) :</label><br><input type=\"text\" name=\"dwell\" value=\"" + String(c.dwellSec / 60) + "\"><br>";
+
+  page += "<label>Niveau mini / maxi :</label><br><select name=\"minLvl\">";
+  for (int8_t l = 0; l <= 3; l++) {
+    page += "<option value=\"" + String(l) + "\"";
+    if (l == c.minLevel) page += " selected";
+    page += ">" + String(thermostatLevelLabel(l)) + "</option>";
+  }
+  page += "</select><select name=\"maxLvl\">";
+  for (int8_t l = 0; l <= 3; l++) {
+    page += "<option value=\"" + String(l) + "\"";
+    if (l == c.maxLevel) page += " selected";
+    page += ">" + String(thermostatLevelLabel(l)) + "</option>";
+  }
+  page += R"rawliteral(</select>
+      <br><br>
+      <input type="submit" value="Enregistrer">
+    </form>
+)rawliteral";
+
+  page += "<p><b>Niveau actuel :</b> " + String(thermostatLevelLabel(st.level));
+  if (st.demand > 0) page += " (trop froid)";
+  if (st.demand < 0) page += " (trop chaud)";
+  page += "</p>";
+  page += "<p><b>Changements :</b> " + String(st.switches) + " depuis le demarrage, " +
+          String(st.switchesLastHour) + " sur la derniere heure</p>";
+  if (st.switches > 0) {
+    page += "<p><b>Latence de decision :</b> derniere " + String(st.lastLatencyMs / 1000) +
+            "s, moyenne " + String(st.avgLatencyMs / 1000) +
+            "s, max " + String(st.maxLatencyMs / 1000) + "s</p>";
+  }
+
+  page += "</div>";
+  return page;
+}
+
+// ---- Section gouverneur de puissance ----
+static String htmlGovernorSection() {
+  GovConfig c  = governorGetConfig();
+  GovStats  st = governorGetStats();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>⚡ Limite de puissance du foyer</h2>
+)rawliteral";
+
+  if (c.enabled) {
+    if (isnan(st.houseW)) {
+      page += "<p>Pas encore de lecture du compteur.</p>";
+    } else {
+      page += "<p><b>Consommation foyer :</b> " + String(st.houseW, 0) + " W / " +
+              String(c.limitW) + " W";
+      if (st.overload) page += " <b style='color:#ff5252'>DEPASSEMENT</b>";
+      page += "</p>";
+    }
+    page += "<p><b>Bridage :</b> " + String(thermostatLevelLabel(st.cap)) +
+            " &nbsp; <b>Delestages :</b> " + String(st.sheds) +
+            " &nbsp; <b>Remontees :</b> " + String(st.restores) + "</p>";
+    page += "<p><b>Lecture compteur :</b> " + String(st.readLatencyMs) + " ms (max " +
+            String(st.maxReadLatencyMs) + " ms), " + String(st.readErrors) + " erreur(s)</p>";
+    if (st.sheds > 0) {
+      page += "<p><b>Temps de reaction :</b> dernier " + String(st.lastReactionMs) +
+              " ms, max " + String(st.maxReactionMs) + " ms, " +
+              String(st.missedTarget) + " hors objectif</p>";
+    }
+  }
+
+  page += "<form action=\"/governor\" method=\"POST\">";
+  page += "<label><input type=\"checkbox\" name=\"enabled\"";
+  if (c.enabled) page += " checked";
+  page += "> Activer</label><br>";
+  page += "<label>Limite (W) :</label><br><input type=\"text\" name=\"limit\" value=\"" + String(c.limitW) + "\"><br>";
+  page += "<label>Marge avant remontee (W) :</label><br><input type=\"text\" name=\"margin\" value=\"" + String(c.marginW) + "\"><br>";
+  page += "<label>Periode de lecture (ms) :</label><br><input type=\"text\" name=\"pollMs\" value=\"" + String(c.pollMs) + "\"><br>";
+  page += "<label>Objectif de reaction (ms) :</label><br><input type=\"text\" name=\"target\" value=\"" + String(c.targetMs) + "\"><br>";
+
+  page += "<label>Source :</label><br><select name=\"source\">";
+  page += "<option value=\"0\"";
+  if (c.source == GOV_SRC_HTTP) page += " selected";
+  page += ">HTTP</option><option value=\"1\"";
+  if (c.source == GOV_SRC_MODBUS) page += " selected";
+  page += ">Modbus-TCP</option></select><br>";
+
+  page += "<label>URL HTTP :</label><br><input type=\"text\" name=\"url\" placeholder=\"http://192.168.1.x/power\" value=\"" + c.url + "\"><br>";
+  page += "<label>Champ JSON (vide = nombre brut) :</label><br><input type=\"text\" name=\"jsonKey\" value=\"" + c.jsonKey + "\"><br>";
+  page += "<label>Hote Modbus :</label><br><input type=\"text\" name=\"host\" value=\"" + c.host + "\"><br>";
+  page += "<label>Port / unite / fonction (3|4) / registre :</label><br>";
+  page += "<input type=\"text\" name=\"port\" style=\"width:18%\" value=\"" + String(c.port) + "\">";
+  page += "<input type=\"text\" name=\"unit\" style=\"width:18%\" value=\"" + String(c.unitId) + "\">";
+  page += "<input type=\"text\" name=\"fc\" style=\"width:18%\" value=\"" + String(c.function) + "\">";
+  page += "<input type=\"text\" name=\"reg\" style=\"width:18%\" value=\"" + String(c.reg) + "\"><br>";
+
+  static const char* formats[] = { "int16", "uint16", "int32", "float32" };
+  page += "<label>Format / echelle :</label><br><select name=\"format\" style=\"width:40%\">";
+  for (uint8_t i = 0; i < 4; i++) {
+    page += "<option value=\"" + String(i) + "\"";
+    if (c.format == i) page += " selected";
+    page += ">" + String(formats[i]) + "</option>";
+  }
+  page += "</select><input type=\"text\" name=\"scale\" style=\"width:38%\" value=\"" + String(c.scale, 3) + "\">";
+
+  page += R"rawliteral(
+      <br><br>
+      <input type="submit" value="Enregistrer">
+    </form>
+  </div>
+)rawliteral";
+  return page;
+}
+
+// ---- Section autotune ----
+static String htmlAutotuneSection() {
+  AutotuneConfig c  = autotuneGetConfig();
+  AutotuneStatus st = autotuneGetStatus();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>🧪 Autotune J/TH</h2>
+)rawliteral";
+
+  if (st.detail.length() > 0) {
+    page += "<p><b>Etat :</b> " + st.detail;
+    if (st.phase == AT_MEASURING) {
+      page += " (" + String(st.samples) + " echantillons, " + String(st.batches) + " lots, " +
+              String((millis() - st.phaseStartMs) / 60000) + " min)";
+    }
+    page += "</p>";
+  }
+
+  page += "<table><tr><th>Mode</th><th>TH/s</th><th>W</th><th>J/TH</th><th>TMax</th><th>&plusmn;</th></tr>";
+  for (uint8_t i = 0; i < AUTOTUNE_MODES; i++) {
+    AutotuneResult r;
+    page += "<tr><td>" + String(minerLevelMode(i + 1));
+    if (i == st.bestIndex) page += " ✅";
+    page += "</td>";
+    if (autotuneGetResult(i, r)) {
+      page += "<td>" + String(r.ths, 2) + "</td><td>" + String(r.watts, 0) +
+              "</td><td>" + String(r.jth, 1) + "</td><td>" +
+              (isnan(r.tempMax) ? String("-") : String(r.tempMax, 0)) +
+              "</td><td>" + String(r.relErr * 100.0f, 1) + "%</td>";
+    } else {
+      page += "<td colspan=\"5\">non mesure</td>";
+    }
+    page += "</tr>";
+  }
+  page += "</table>";
+
+  if (autotuneIsRunning()) {
+    page += "<form action=\"/autotune\" method=\"POST\"><input type=\"hidden\" name=\"abort\" value=\"1\">"
+            "<input type=\"submit\" value=\"Interrompre\"></form>";
+  } else {
+    page += "<form action=\"/autotune\" method=\"POST\">";
+    page += "<label>Stabilisation / mesure mini / maxi (min) :</label><br>";
+    page += "<input type=\"text\" name=\"settle\" style=\"width:25%\" value=\"" + String(c.settleMin) + "\">";
+    page += "<input type=\"text\" name=\"minWin\" style=\"width:25%\" value=\"" + String(c.minWindowMin) + "\">";
+    page += "<input type=\"text\" name=\"maxWin\" style=\"width:25%\" value=\"" + String(c.maxWindowMin) + "\"><br>";
+    page += "<label>Plafond puissance (W, 0 = aucun) :</label><br><input type=\"text\" name=\"powerCeil\" value=\"" + String(c.powerCeilW) + "\"><br>";
+    page += "<label>Plafond TMax puces (&deg;C, 0 = aucun) :</label><br><input type=\"text\" name=\"tempCeil\" value=\"" + String(c.tempCeilC) + "\"><br>";
+    page += R"rawliteral(
+      <br>
+      <input type="submit" name="save" value="Enregistrer">
+      <input type="submit" name="start" value="Lancer l'autotune">
+    </form>
+)rawliteral";
+  }
+
+  page += "</div>";
+  return page;
+}
+
+// ---- Section pools ----
+static String htmlPoolsSection() {
+  PoolsConfig c  = poolsGetConfig();
+  PoolsStats  st = poolsGetStats();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>🌊 Pools</h2>
+)rawliteral";
+
+  if (st.lastPollMs == 0) {
+    page += "<p>Pas encore de lecture des pools.</p>";
+  } else {
+    page += "<table><tr><th>#</th><th>URL</th><th>Etat</th><th>Parts/min</th><th>Rejets</th><th>Stale</th><th>Dernier share</th></tr>";
+    for (uint8_t i = 0; i < st.count; i++) {
+      const PoolHealth &h = st.pools[i];
+      page += "<tr><td>" + String(h.pool.index);
+      if (i == st.active) page += " ▶";
+      page += "</td><td>" + String(h.pool.url) + "</td><td>" + String(h.pool.status);
+      if (h.degraded) page += " <b style='color:#ff5252'>" + String(h.reason) + "</b>";
+      page += "</td><td>" + String(h.acceptPerMin, 1) + "</td><td>" + String(h.rejectPct, 1) +
+              "%</td><td>" + String(h.stalePct, 1) + "%</td><td>" +
+              (h.shareAgeSec ? String(h.shareAgeSec) + " s" : String("-")) + "</td></tr>";
+    }
+    page += "</table>";
+  }
+
+  if (st.failovers > 0) {
+    page += "<p><b>Bascules :</b> " + String(st.failovers) + " (" + String(st.failoverFailures) +
+            " echec(s)), derniere : " + st.lastFailoverInfo + "</p>";
+    page += "<p><b>Detection :</b> derniere " + String(st.lastDetectMs / 1000) + " s, max " +
+            String(st.maxDetectMs / 1000) + " s &nbsp; <b>Bascule :</b> derniere " +
+            String(st.lastSwitchMs / 1000.0f, 1) + " s, max " + String(st.maxSwitchMs / 1000.0f, 1) + " s</p>";
+  }
+
+  page += "<form action=\"/pools\" method=\"POST\">";
+  page += "<label><input type=\"checkbox\" name=\"auto\"";
+  if (c.autoFailover) page += " checked";
+  page += "> Bascule automatique</label><br>";
+  page += "<label>Periode d'interrogation (s) :</label><br><input type=\"text\" name=\"poll\" value=\"" + String(c.pollSec) + "\"><br>";
+  page += "<label>Rejets + stale maxi (%) :</label><br><input type=\"text\" name=\"maxRej\" value=\"" + String(c.maxRejectPct, 1) + "\"><br>";
+  page += "<label>Age maxi du dernier share (s, 0 = ignore) :</label><br><input type=\"text\" name=\"maxAge\" value=\"" + String(c.maxShareAgeSec) + "\"><br>";
+  page += "<label>Parts mini avant de juger les taux :</label><br><input type=\"text\" name=\"minShares\" value=\"" + String(c.minShares) + "\"><br>";
+  page += "<label>Delai mini entre deux bascules (s) :</label><br><input type=\"text\" name=\"cooldown\" value=\"" + String(c.cooldownSec) + "\"><br>";
+  page += R"rawliteral(
+      <br>
+      <input type="submit" value="Enregistrer">
+    </form>
+)rawliteral";
+
+  page += "</div>";
+  return page;
+}
+
+// ---- Section ventilation ----
+static String htmlFanSection() {
+  FanConfig c  = fanGetConfig();
+  FanStats  st = fanGetStats();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>🌀 Ventilation</h2>
+)rawliteral";
+
+  if (c.enabled) {
+    page += "<p><b>Vitesse :</b> " + (st.pct < 0 ? String("auto miner") : String(st.pct) + "%");
+    if (st.targetPct >= 0 && st.targetPct != st.pct) page += " (cible " + String(st.targetPct) + "%)";
+    if (st.safety) page += " <b style='color:#ff5252'>SECURITE</b>";
+    page += " &nbsp; <b>Changements :</b> " + String(st.changes) + ", " + String(st.errors) + " refus</p>";
+  }
+
+  uint8_t n = fanLogCount();
+  if (n > 0) {
+    page += "<table><tr><th>Heure</th><th>Vitesse</th><th>Ambiance</th><th>Puces</th><th>Motif</th></tr>";
+    for (uint8_t i = 0; i < n; i++) {
+      FanLogEntry e;
+      if (!fanLogGet(i, e)) break;
+      String when = "-";
+      if (e.epoch) {
+        time_t t = e.epoch;
+        struct tm lt;
+        localtime_r(&t, &lt);
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%02d/%02d %02d:%02d", lt.tm_mday, lt.tm_mon + 1, lt.tm_hour, lt.tm_min);
+        when = buf;
+      }
+      page += "<tr><td>" + when + "</td><td>" + (e.pct < 0 ? String("auto") : String(e.pct) + "%") +
+              "</td><td>" + (isnan(e.ambientC) ? String("-") : String(e.ambientC, 1)) +
+              "</td><td>" + (isnan(e.chipC) ? String("-") : String(e.chipC, 0)) +
+              "</td><td>" + String(fanReasonLabel(e.reason));
+      if (!e.ok) page += " (refuse)";
+      page += "</td></tr>";
+    }
+    page += "</table>";
+  }
+
+  page += "<form action=\"/fan\" method=\"POST\">";
+  page += "<label><input type=\"checkbox\" name=\"enabled\"";
+  if (c.enabled) page += " checked";
+  page += "> Activer la courbe</label><br>";
+  page += "<label>Ambiance basse / haute (&deg;C) :</label><br>";
+  page += "<input type=\"text\" name=\"ambLow\" style=\"width:40%\" value=\"" + String(c.ambLowC, 1) + "\">";
+  page += "<input type=\"text\" name=\"ambHigh\" style=\"width:40%\" value=\"" + String(c.ambHighC, 1) + "\"><br>";
+  page += "<label>Puces TMax bas / haut / securite (&deg;C) :</label><br>";
+  page += "<input type=\"text\" name=\"chipLow\" style=\"width:25%\" value=\"" + String(c.chipLowC, 0) + "\">";
+  page += "<input type=\"text\" name=\"chipHigh\" style=\"width:25%\" value=\"" + String(c.chipHighC, 0) + "\">";
+  page += "<input type=\"text\" name=\"safety\" style=\"width:25%\" value=\"" + String(c.safetyC, 0) + "\"><br>";
+  page += "<label>Vitesse mini / maxi (%) :</label><br>";
+  page += "<input type=\"text\" name=\"minPct\" style=\"width:40%\" value=\"" + String(c.minPct) + "\">";
+  page += "<input type=\"text\" name=\"maxPct\" style=\"width:40%\" value=\"" + String(c.maxPct) + "\"><br>";
+  page += "<label>Pas maxi (%) / delai mini entre changements (s) :</label><br>";
+  page += "<input type=\"text\" name=\"step\" style=\"width:40%\" value=\"" + String(c.stepPct) + "\">";
+  page += "<input type=\"text\" name=\"interval\" style=\"width:40%\" value=\"" + String(c.minIntervalSec) + "\"><br>";
+  page += R"rawliteral(
+      <br>
+      <input type="submit" value="Enregistrer">
+    </form>
+)rawliteral";
+
+  page += "</div>";
+  return page;
+}
+
+// ---- Section alertes ----
+static String htmlAlertsSection() {
+  AlertStats st = alertsGetStats();
+
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>🚨 Alertes</h2>
+)rawliteral";
+
+  if (st.ruleCount > 0) {
+    page += "<table><tr><th>Regle</th><th>Etat</th><th>Declenchements</th></tr>";
+    for (uint8_t i = 0; i < st.ruleCount; i++) {
+      AlertRule r;
+      if (!alertsGetRule(i, r)) break;
+      page += "<tr><td>" + htmlEscape(r.name) + "</td><td>";
+      if (r.firing)               page += "<b style='color:#ff5252'>DECLENCHEE</b>";
+      else if (r.trueSinceMs)     page += "en attente (" + String((millis() - r.trueSinceMs) / 1000) + " / " + String(r.forSec) + " s)";
+      else                        page += "ok";
+      page += "</td><td>" + String(r.fireCount) + "</td></tr>";
+    }
+    page += "</table>";
+    page += "<p><b>Evaluation :</b> " + String(st.lastEvalUs) + " &micro;s (max " + String(st.maxEvalUs) +
+            " &micro;s), " + String(st.evals) + " passes</p>";
+  }
+
+  if (alertsWebhookEnabled()) {
+    page += "<p><b>Webhook :</b> " + String(st.sent) + " envoyee(s), " + String(st.queued) + " en attente";
+    if (st.dropped) page += ", " + String(st.dropped) + " perdue(s)";
+    if (st.lastHttpCode != 0) page += ", dernier code " + String(st.lastHttpCode);
+    if (st.nextRetryMs != 0) page += " <b>(reessai en cours)</b>";
+    page += "</p>";
+  }
+
+  page += "<form action=\"/alerts\" method=\"POST\">";
+  page += "<label><input type=\"checkbox\" name=\"on\"";
+  if (alertsWebhookEnabled()) page += " checked";
+  page += "> Envoyer au webhook</label><br>";
+  page += "<label>URL du webhook :</label><br><input type=\"text\" name=\"url\" placeholder=\"http://192.168.1.x:8123/api/webhook/...\" value=\"" +
+          htmlEscape(alertsGetWebhook()) + "\"><br>";
+  page += "<label>Regles (nom: expression [for 5m]) :</label><br>";
+  page += "<textarea name=\"rules\" rows=\"6\" style=\"width:100%\">" + htmlEscape(alertsGetRules()) + "</textarea><br>";
+  page += "<small>Metriques :";
+  for (uint8_t i = 0; alertsMetricName(i)[0]; i++) page += " " + String(alertsMetricName(i));
+  page += "</small><br>";
+  page += R"rawliteral(
+      <br>
+      <input type="submit" value="Enregistrer">
+    </form>
+)rawliteral";
+
+  page += "</div>";
+  return page;
+}
+
+// ---- Section journal (pagine, du plus recent au plus ancien) ----
+const uint8_t JOURNAL_PAGE_ROWS = 20;
+
+static String htmlJournalSection() {
+  uint16_t pg = server.hasArg("jpage") ? (uint16_t)server.arg("jpage").toInt() : 0;
+  uint32_t total = journalCount();
+  uint16_t pages = total ? (total + JOURNAL_PAGE_ROWS - 1) / JOURNAL_PAGE_ROWS : 1;
+  if (pg >= pages) pg = pages - 1;
+
+  String page = R"rawliteral(
+  <div class="section" id="journal">
+    <h2>📒 Journal</h2>
+)rawliteral";
+
+  static JournalEntry rows[JOURNAL_PAGE_ROWS];   // ~900 octets hors pile
+  uint8_t n = journalPage(pg, JOURNAL_PAGE_ROWS, rows);
+  if (n == 0) {
+    page += "<p>Aucun evenement.</p></div>";
+    return page;
+  }
+
+  page += "<table><tr><th>Heure</th><th>Evenement</th><th>Origine</th><th>Detail</th></tr>";
+  for (uint8_t i = 0; i < n; i++) {
+    const JournalEntry &e = rows[i];
+    char when[20];
+    if (e.epoch) {
+      time_t t = e.epoch;
+      struct tm lt;
+      localtime_r(&t, &lt);
+      snprintf(when, sizeof(when), "%02d/%02d %02d:%02d:%02d", lt.tm_mday, lt.tm_mon + 1,
+               lt.tm_hour, lt.tm_min, lt.tm_sec);
+    } else {
+      snprintf(when, sizeof(when), "boot +%lus", (unsigned long)e.uptimeS);
+    }
+    page += "<tr><td>" + String(when) + "</td><td>" + journalEventLabel(e.type);
+    if (e.type == JE_CMD_DONE) page += " " + String(cmdStateLabel((CmdState)e.value));
+    if (e.type == JE_ALERT)    page += e.value ? " declenchee" : " resolue";
+    if (e.type == JE_OTA)      page += e.value > 0 ? " ok" : e.value < 0 ? " echec" : "";
+    page += "</td><td>" + String(journalSourceLabel(e.source)) + "</td><td>" + htmlEscape(e.text) + "</td></tr>";
+  }
+  page += "</table><p>";
+  if (pg > 0) page += "<a href=\"/?jpage=" + String(pg - 1) + "#journal\">&laquo; plus recents</a> ";
+  page += "page " + String(pg + 1) + " / " + String(pages);
+  if (pg + 1 < pages) page += " <a href=\"/?jpage=" + String(pg + 1) + "#journal\">plus anciens &raquo;</a>";
+  page += "</p></div>";
+  return page;
+}
+
+// ---- Section historique (graphique cote navigateur) ----
+static String htmlHistorySection() {
+  String page = R"rawliteral(
+  <div class="section">
+    <h2>📈 Historique</h2>
+)rawliteral";
+
+  // agregats 24 h : O(log n) via l'index horaire
+  time_t t = time(nullptr);
+  HistoryAgg ths, jth;
+  if (t > 1600000000 &&
+      historyAggregate(H_THS, (uint32_t)t - 86400, (uint32_t)t, ths) && ths.count > 0) {
+    page += "<p><b>24 h :</b> " + String(ths.avg, 2) + " TH/s (min " + String(ths.min, 2) +
+            ", max " + String(ths.max, 2) + ")";
+    if (historyAggregate(H_JTH, (uint32_t)t - 86400, (uint32_t)t, jth) && jth.count > 0) {
+      page += ", " + String(jth.avg, 1) + " J/TH";
+    }
+    page += "</p>";
+  }
+
+  page += R"rawliteral(
+    <select id="hMetric" style="width:48%">
+      <option value="ths">Hashrate (TH/s)</option>
+      <option value="watts">Puissance (W)</option>
+      <option value="tchip">Temp. puces (&deg;C)</option>
+      <option value="tamb">Temp. ambiante (&deg;C)</option>
+      <option value="jth">Efficacite (J/TH)</option>
+      <option value="rej">Rejets (%)</option>
+    </select>
+    <select id="hRange" style="width:48%">
+      <option value="21600">6 h</option>
+      <option value="86400" selected>24 h</option>
+      <option value="604800">7 jours</option>
+    </select>
+    <canvas id="hChart" height="160" style="width:100%;background:#111;margin-top:8px"></canvas>
+    <p id="hInfo"></p>
+    <p>Export 24 h : <a href="/export.csv">CSV</a> &middot; <a href="/export.ndjson">NDJSON</a>
+      (parametres <code>from</code> / <code>to</code> en epoch)</p>
+    <script>
+    (function(){
+      var NO_DATA = -32768;
+      function draw(){
+        var metric = document.getElementById('hMetric').value;
+        var range = +document.getElementById('hRange').value;
+        var step = Math.max(60, Math.ceil(range / 288 / 60) * 60);
+        fetch('/api/history.bin?metric=' + metric + '&step=' + step + '&from=' + (Math.floor(Date.now() / 1000) - range))
+          .then(function(r){ if (!r.ok) throw r.status; return r.arrayBuffer(); })
+          .then(function(buf){
+            // en-tete : "KH01", from u32, step u32, count u16, scale u16, puis int16[count]
+            var dv = new DataView(buf);
+            var from = dv.getUint32(4, true), st = dv.getUint32(8, true);
+            var n = dv.getUint16(12, true), scale = dv.getUint16(14, true);
+            var v = [], lo = Infinity, hi = -Infinity;
+            for (var i = 0; i < n; i++) {
+              var x = dv.getInt16(16 + 2 * i, true);
+              if (x === NO_DATA) { v.push(null); continue; }
+              x /= scale; v.push(x);
+              if (x < lo) lo = x;
+              if (x > hi) hi = x;
+            }
+            var c = document.getElementById('hChart');
+            c.width = c.clientWidth;
+            var g = c.getContext('2d'), W = c.width, H = c.height;
+            g.clearRect(0, 0, W, H);
+            if (lo === Infinity) { document.getElementById('hInfo').textContent = 'Pas de donnees.'; return; }
+            if (hi === lo) { hi += 1; lo -= 1; }
+            g.strokeStyle = '#4caf50'; g.lineWidth = 1.5; g.beginPath();
+            var pen = false;
+            for (var i = 0; i < n; i++) {
+              if (v[i] === null) { pen = false; continue; }
+              var px = n > 1 ? i * (W - 1) / (n - 1) : 0, py = H - 4 - (v[i] - lo) * (H - 8) / (hi - lo);
+              if (pen) g.lineTo(px, py); else g.moveTo(px, py);
+              pen = true;
+            }
+            g.stroke();
+            g.fillStyle = '#aaa'; g.font = '11px sans-serif';
+            g.fillText(hi.toFixed(2), 2, 11); g.fillText(lo.toFixed(2), 2, H - 2);
+            document.getElementById('hInfo').textContent = n + ' points, pas ' + (st / 60) + ' min, ' +
+              buf.byteLength + ' octets, depuis ' + new Date(from * 1000).toLocaleString();
+          })
+          .catch(function(e){ document.getElementById('hInfo').textContent = 'Historique indisponible (' + e + ')'; });
+      }
+      document.getElementById('hMetric').onchange = draw;
+      document.getElementById('hRange').onchange = draw;
+      draw();
+    })();
+    </script>
+  </div>
+)rawliteral";
+  return page;
+}
+
 static String htmlInfoPage() {
   String ip = WiFi.localIP().toString();
 
-  // Met à jour les infos miner
-  minerUpdate();
+  // Dernier status connu (l'interrogation est faite par minerPollLoop)
   MinerStatus m = minerGetStatus();
+  MinerPollState ps = minerGetPollState();
 
   String page = R"rawliteral(
 <!DOCTYPE html>
@@ -258,9 +1054,63 @@ static String htmlInfoPage() {
 )rawliteral";
 
   page += "<p><b>IP :</b> " + ip + "</p>";
-  page += "<p><b>SSID :</b> " + wifiSSID + "</p>";
+  page += "<p><b>SSID :</b> " + htmlEscape(WiFi.SSID()) + "</p>";
   page += "<p><b>RSSI :</b> " + String(WiFi.RSSI()) + " dBm</p>";
   page += "<p><b>Firmware :</b> v" FW_VERSION "</p>";
+  OtaStatus ota = otaGetStatus();
+  page += "<p><b>Mise a jour :</b> " + String(otaStateLabel(ota.state));
+  if (ota.remoteVersion[0]) page += " (distant v" + htmlEscape(ota.remoteVersion) + ")";
+  if (ota.state == OTA_DOWNLOADING && ota.size) page += " " + String((uint64_t)ota.written * 100 / ota.size) + "%";
+  if (ota.state == OTA_FAILED) page += " : " + htmlEscape(ota.error);
+  page += "</p>";
+  PerfBoot boot = perfGetBoot();
+  if (boot.ms[BOOT_FIRST_DATA]) {
+    page += "<p><b>Demarrage :</b> donnees en " + String(boot.ms[BOOT_FIRST_DATA]) + " ms (WiFi " +
+            String(boot.ms[BOOT_WIFI]) + " ms" + (boot.fastWifi ? ", reconnexion rapide" : "") + ")</p>";
+  }
+
+  WifiSupStats ws = wifiSupGetStats();
+  page += "<p><b>Coupures :</b> " + String(ws.disconnects) + ", reconnexions " + String(ws.reconnects);
+  if (ws.reconnects) page += " (derniere " + String(ws.lastReconnectMs / 1000.0f, 1) + " s, max " +
+                             String(ws.maxReconnectMs / 1000.0f, 1) + " s)";
+  if (ws.roams) page += ", bascules AP " + String(ws.roams);
+  page += "</p>";
+
+  // reseaux enregistres : essayes par RSSI decroissant a chaque reconnexion
+  page += "<h3>Reseaux enregistres</h3>";
+  uint8_t nets = wifiNetCount();
+  for (uint8_t i = 0; i < nets; i++) {
+    String ssid, pass;
+    if (!wifiNetGet(i, ssid, pass)) break;
+    page += "<form action=\"/wifi_forget\" method=\"POST\"><p>" + htmlEscape(ssid);
+    if ((int8_t)i == ws.slot) page += " <i>(actif)</i>";
+    page += " <input type=\"hidden\" name=\"idx\" value=\"" + String(i) + "\">";
+    if (nets > 1) page += "<input type=\"submit\" value=\"Oublier\">";
+    page += "</p></form>";
+  }
+  if (nets < WIFI_MAX_NETWORKS) {
+    page += R"rawliteral(
+    <form action="/wifi_add" method="POST">
+      <input type="text" name="ssid" placeholder="SSID" required>
+      <input type="password" name="pass" placeholder="Mot de passe">
+      <input type="submit" value="Ajouter un reseau">
+    </form>
+)rawliteral";
+  }
+
+  // manifeste OTA : URL et certificat racine (serveur HTTPS local de test)
+  page += "<h3>Mise a jour firmware</h3><form action=\"/ota\" method=\"POST\">";
+  page += "<input type=\"text\" name=\"url\" value=\"" + htmlEscape(otaGetManifestUrl()) + "\">";
+  page += "<textarea name=\"ca\" rows=\"3\" placeholder=\"Certificat racine PEM (vide = inchange)\"></textarea>";
+  page += "<label><input type=\"checkbox\" name=\"clear_ca\"> Racines integrees";
+  page += otaHasCaCert() ? " (un certificat est enregistre)" : " (actuel)";
+  page += "</label><br>";
+  page += "<label><input type=\"checkbox\" name=\"insecure\"";
+  if (otaIsInsecure()) page += " checked";
+  page += "> Ne pas verifier le serveur (test uniquement)</label><br>";
+  page += "<input type=\"hidden\" name=\"tls\" value=\"1\">";
+  page += "<input type=\"submit\" name=\"save\" value=\"Enregistrer\"> ";
+  page += "<input type=\"submit\" name=\"check\" value=\"Verifier maintenant\"></form>";
 
   page += "<a class=\"button\" href=\"/reconfig\">Reconfigurer le WiFi</a>";
   page += "</div>";
@@ -334,6 +1184,7 @@ static String htmlInfoPage() {
     page += "<p><i>IP du miner non configuree.</i></p>";
   } else {
     page += "<p><b>📡 IP actuelle du miner :</b> " + m.ip + "</p>";
+    page += "<p><b>🔁 Interrogation :</b> " + formatPollState(ps) + "</p>";
     
     if (m.lastError.length() > 0) {
       page += "<p style='color:#ff5252'><b>Erreur :</b> " + m.lastError + "</p>";
@@ -419,7 +1270,20 @@ static String htmlInfoPage() {
 
   }
 
-  page += "</div></body></html>";
+  page += "</div>";
+
+  page += htmlAnalyticsSection();
+  page += htmlHistorySection();
+  page += htmlScheduleSection();
+  page += htmlThermostatSection();
+  page += htmlGovernorSection();
+  page += htmlAutotuneSection();
+  page += htmlPoolsSection();
+  page += htmlFanSection();
+  page += htmlAlertsSection();
+  page += htmlJournalSection();
+
+  page += "</body></html>";
 
   return page;
 }
@@ -433,14 +1297,73 @@ static void handleRoot() {
     // Mode AP / configuration WiFi
     server.send(200, "text/html", htmlConfigPage());
   } else {
-    // Mode normal : dashboard
-    minerUpdate();
-    String page = htmlInfoPage();
+    // Mode normal : dashboard (un client regarde -> interrogation rapide)
+    minerPollDemand();
+    static int8_t sHtml = perfProbe(PERF_HTML, "info");
+    static int8_t sNet  = perfProbe(PERF_NET, "/");
+    String page;
+    {
+      PerfScope ps(sHtml);
+      page = htmlInfoPage();
+    }
+    PerfScope ps(sNet);
     server.send(200, "text/html", page);
   }
 }
 
 
+// Etat de l'ordonnanceur miner, pour la supervision
+static void handleApiPoll() {
+  MinerPollState ps = minerGetPollState();
+  uint32_t now = millis();
+  int32_t next = (int32_t)(ps.nextPollMs - now);
+  if (next < 0) next = 0;
+
+  String json = "{";
+  json += "\"interval_ms\":" + String(ps.intervalMs);
+  json += ",\"next_poll_in_ms\":" + String(next);
+  json += ",\"last_poll_age_ms\":" + String(ps.lastPollMs ? now - ps.lastPollMs : 0);
+  json += ",\"last_ok_age_ms\":" + String(ps.lastOkMs ? now - ps.lastOkMs : 0);
+  json += ",\"failures\":" + String(ps.failures);
+  json += ",\"circuit_open\":" + String(ps.circuitOpen ? "true" : "false");
+  json += ",\"fast\":" + String(ps.fast ? "true" : "false");
+  json += ",\"polls\":" + String(ps.polls);
+  json += ",\"poll_errors\":" + String(ps.pollErrors);
+  json += ",\"last_poll_bytes\":" + String(ps.lastPollBytes);
+  json += ",\"commands\":" + String(ps.commands);
+  json += ",\"cache_hits\":" + String(ps.cacheHits);
+  json += ",\"rx_high_water\":" + String(ps.rxHighWater);
+  json += ",\"rx_truncated\":" + String(ps.rxTruncated);
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+// Liste des reseaux du dernier scan (page de config en mode AP)
+static void handleApiScan() {
+  if (server.method() != HTTP_GET) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  String json = "{\"scanning\":" + String(gApScanning || !gApScanned ? "true" : "false");
+  json += ",\"age_ms\":" + String(gApScanned ? millis() - gApScanMs : 0);
+  json += ",\"networks\":[";
+  for (uint8_t i = 0; i < gApNetCount; i++) {
+    if (i) json += ",";
+    json += "{\"ssid\":\"" + jsonEscape(gApNets[i].ssid) + "\",\"rssi\":" + String(gApNets[i].rssi);
+    json += ",\"open\":" + String(gApNets[i].open ? "true" : "false") + "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+// Portail captif : les URL de detection (generate_204, hotspot-detect.html,
+// connecttest.txt...) et tout le reste renvoient vers la page de config
+static void handleCaptiveRedirect() {
+  server.sendHeader("Location", "http://" + WiFi.softAPIP().toString() + "/", true);
+  server.send(302, "text/plain", "");
+}
+
 static void handleSave() {
   if (server.method() == HTTP_POST) {
     String ssid = server.arg("ssid");
@@ -452,10 +1375,15 @@ static void handleSave() {
     }
 
     if (ssid.length() > 0) {
-      prefs.begin("wifi", false);
-      prefs.putString("ssid", ssid);
-      prefs.putString("pass", pass);
-      prefs.end();
+      // IP fixe : les trois champs doivent etre valides, sinon DHCP
+      IPAddress ip, gw, mask, dns;
+      bool fixed = ip.fromString(server.arg("ip")) && gw.fromString(server.arg("gw")) &&
+                   mask.fromString(server.arg("mask"));
+      if (fixed && !dns.fromString(server.arg("dns"))) dns = gw;
+
+      wifiNetSave(ssid, pass);   // en tete de liste, vide le cache BSSID / canal
+
+      wifiIpSet(ssid, fixed ? ip : IPAddress((uint32_t)0), gw, mask, dns);
 
       server.send(200, "text/html",
         "<html><body><h1>OK</h1><p>Redemarrage...</p></body></html>");
@@ -479,8 +1407,99 @@ static void handleReconfig() {
   ESP.restart();
 }
 
-// Enregistrement de l'IP du miner
-static void handleMinerSave() {
+// Reseau de secours : pas de redemarrage, pris en compte a la prochaine coupure
+static void handleWifiAdd() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  String ssid = server.arg("ssid");
+  ssid.trim();
+  if (ssid.length() == 0) {
+    server.send(400, "text/html", "SSID manquant");
+    return;
+  }
+
+  // le reseau actif reste en tete : c'est lui qu'on retente au boot
+  String curSsid, curPass;
+  bool hasCur = wifiNetGet(0, curSsid, curPass) && curSsid != ssid;
+  wifiNetSave(ssid, server.arg("pass"));
+  if (hasCur) wifiNetSave(curSsid, curPass);
+
+  server.send(200, "text/html",
+    "<html><body><h1>Reseau ajoute</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
+
+static void handleWifiForget() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  // on garde toujours au moins un reseau, sinon retour au mode AP
+  if (wifiNetCount() > 1) wifiNetForget((uint8_t)server.arg("idx").toInt());
+  server.send(200, "text/html",
+    "<html><body><h1>Reseau oublie</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
+
+// GET : etat de la mise a jour (JSON). POST : URL du manifeste, certificat,
+// check = lancer une verification
+static void handleOta() {
+  if (server.method() == HTTP_GET) {
+    OtaStatus st = otaGetStatus();
+    String json = "{\"state\":\"" + String(otaStateLabel(st.state)) + "\"";
+    json += ",\"running\":" + String(st.running ? "true" : "false");
+    json += ",\"local_version\":\"" FW_VERSION "\"";
+    json += ",\"remote_version\":\"" + jsonEscape(st.remoteVersion) + "\"";
+    json += ",\"size\":" + String(st.size);
+    json += ",\"written\":" + String(st.written);
+    json += ",\"resumes\":" + String(st.resumes);
+    json += ",\"error\":\"" + jsonEscape(st.error) + "\"";
+    json += ",\"last_check\":" + String(st.lastCheckEpoch);
+    json += ",\"manifest_url\":\"" + jsonEscape(otaGetManifestUrl()) + "\"";
+    json += ",\"ca_cert\":" + String(otaHasCaCert() ? "true" : "false");
+    json += ",\"insecure\":" + String(otaIsInsecure() ? "true" : "false") + "}";
+    server.send(200, "application/json", json);
+    return;
+  }
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  if (server.hasArg("url")) {
+    String url = server.arg("url");
+    url.trim();
+    if (url.length() && !url.startsWith("https://")) {
+      server.send(400, "text/html", "URL https:// attendue");
+      return;
+    }
+    otaSetManifestUrl(url);
+  }
+  if (server.hasArg("clear_ca")) {
+    otaSetCaCert("");
+  } else if (server.arg("ca").indexOf("-----BEGIN CERTIFICATE-----") >= 0) {
+    otaSetCaCert(server.arg("ca"));
+  }
+  if (server.hasArg("tls")) {
+    otaSetInsecure(server.hasArg("insecure"));   // case decochee = absente
+  }
+
+  bool check = server.hasArg("check");
+  if (check) otaStart();
+  server.send(200, "text/html",
+    String("<html><body><h1>") + (check ? "Verification lancee" : "Reglages OTA enregistres") + "</h1>"
+    "<script>setTimeout(function(){window.location='/'},1500);</script>"
+    "</body></html>");
+}
+
+// Enregistrement de l'IP du miner
+static void handleMinerSave() {
   if (server.method() == HTTP_POST) {
     String ip = server.arg("miner_ip");
     ip.trim();
@@ -496,347 +1515,1091 @@ static void handleMinerSave() {
   }
 }
 
-// Changement de mode du miner
-static void handleMinerMode() {
+// Page de suivi d'une commande en file : interroge /api/cmd jusqu'a l'etat final
+static String htmlCmdPage(const String &title, uint32_t id) {
+  String page = "<html><head><meta charset=\"utf-8\"></head><body><h1>" + title + "</h1>";
+  page += "<p>Commande #" + String(id) + " : <b id='st'>pending</b></p>";
+  page += "<p id='dt'></p>";
+  page += R"rawliteral(
+<script>
+var id = )rawliteral";
+  page += String(id);
+  page += R"rawliteral(;
+function poll() {
+  fetch('/api/cmd?id=' + id).then(function(r){ return r.json(); }).then(function(c){
+    document.getElementById('st').textContent = c.state;
+    document.getElementById('dt').textContent = c.detail;
+    if (c.final) { setTimeout(function(){ window.location = '/'; }, 2000); }
+    else { setTimeout(poll, 1000); }
+  }).catch(function(){ setTimeout(poll, 2000); });
+}
+poll();
+</script>
+</body></html>
+)rawliteral";
+  return page;
+}
+
+// Depose la commande et repond tout de suite avec son ID
+static void submitMinerCommand(CmdType type, const String &arg, const String &title) {
   String ip = minerGetIP();
   if (ip.length() == 0) {
     server.send(400, "text/html", "IP du miner non configuree.");
     return;
   }
 
+  uint32_t id = cmdQueueSubmit(type, arg);
+  if (id == 0) {
+    server.send(503, "text/html", "File de commandes pleine, reessayer plus tard.");
+    return;
+  }
+
+  server.send(202, "text/html", htmlCmdPage(title, id));
+}
+
+// Changement de mode du miner
+static void handleMinerMode() {
   String mode = server.arg("mode");
   mode.trim();
+  int8_t level = (mode == "normal") ? 2 : 0;
+  for (int8_t l = 1; l <= 3 && level == 0; l++) {
+    if (mode == minerLevelMode(l)) level = l;
+  }
+  if (level > governorLevelCap()) {
+    server.send(409, "text/html", "Mode bride par le gouverneur de puissance.");
+    return;
+  }
+  submitMinerCommand(CMD_MODE, mode, "Mode demande : " + formatModeLabel(mode));
+}
 
-  bool ok = false;
-  String resp = minerSendMode(mode, ok);
+static void handleMinerStandby() {
+  submitMinerCommand(CMD_STANDBY, "", "Mise en veille demandee");
+}
 
-  String page = "<html><body><h1>Commande mode envoyee</h1>";
-  page += "<p>Mode demande : " + formatModeLabel(mode) + "</p>";
+static void handleMinerWakeup() {
+  if (governorLevelCap() == 0) {
+    server.send(409, "text/html", "Veille imposee par le gouverneur de puissance.");
+    return;
+  }
+  submitMinerCommand(CMD_WAKEUP, "", "Reveil demande");
+}
 
-  if (ok) {
-    page += "<p style='color:#00e676'><b>OK :</b> mode applique.</p>";
-  } else {
-    page += "<p style='color:#ff5252'><b>Erreur :</b> " + resp + "</p>";
+// Etat d'une commande : /api/cmd?id=N
+static void handleApiCmd() {
+  uint32_t id = (uint32_t)server.arg("id").toInt();
+  CmdInfo c;
+  if (!cmdQueueGet(id, c)) {
+    server.send(404, "application/json", "{\"error\":\"unknown id\"}");
+    return;
   }
 
-  page += "<h3>Reponse brute :</h3><pre>" + resp + "</pre>";
-  page += "<script>setTimeout(function(){window.location='/'},2000);</script>";
-  page += "</body></html>";
+  String json = "{";
+  json += "\"id\":" + String(c.id);
+  json += ",\"type\":\"" + String(cmdTypeLabel(c.type)) + "\"";
+  json += ",\"arg\":\"" + jsonEscape(c.arg) + "\"";
+  json += ",\"state\":\"" + String(cmdStateLabel(c.state)) + "\"";
+  json += ",\"final\":" + String(cmdStateIsFinal(c.state) ? "true" : "false");
+  json += ",\"attempts\":" + String(c.attempts);
+  json += ",\"age_ms\":" + String(millis() - c.createdMs);
+  json += ",\"detail\":\"" + jsonEscape(c.detail) + "\"";
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
 
-  server.send(200, "text/html", page);
+static void handleSchedAdd() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  SchedRule r = {};
+  for (uint8_t d = 0; d < 7; d++) {
+    if (server.hasArg("d" + String(d))) r.days |= (1 << d);
+  }
+  String at = server.arg("at");   // "HH:MM"
+  int sep = at.indexOf(':');
+  if (sep < 0) {
+    server.send(400, "text/html", "Heure invalide");
+    return;
+  }
+  r.hour   = (uint8_t)at.substring(0, sep).toInt();
+  r.minute = (uint8_t)at.substring(sep + 1).toInt();
+  r.action = (uint8_t)server.arg("action").toInt();
+
+  if (!scheduleAddRule(r)) {
+    server.send(400, "text/html", "Regle invalide ou planning plein");
+    return;
+  }
+
+  server.send(200, "text/html",
+    "<html><body><h1>Regle ajoutee</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
 }
 
-static void handleMinerStandby() {
-  String ip = minerGetIP();
-  if (ip.length() == 0) {
-    server.send(400, "text/html", "IP du miner non configuree.");
+static void handleSchedDel() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
     return;
   }
 
-  bool ok = false;
-  time_t now = time(nullptr);
-  uint32_t ts = (uint32_t)now + 5;  // dans 5 secondes
+  scheduleRemoveRule((uint8_t)server.arg("idx").toInt());
+  server.send(200, "text/html",
+    "<html><body><h1>Regle supprimee</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
 
-  String resp = minerSetStandby(ts, ok);
+static void handleSchedEnable() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
 
-  String page = "<html><body><h1>Commande standby envoyee</h1>";
-  if (ok) {
-    page += "<p>Le miner va passer en veille dans quelques secondes.</p>";
-  } else {
-    page += "<p style='color:#ff5252'><b>Erreur :</b> " + resp + "</p>";
+  scheduleSetEnabled(server.hasArg("enabled"));
+  server.send(200, "text/html",
+    "<html><body><h1>Planning mis a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
+
+static void handleThermoSave() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
   }
-  page += "<script>setTimeout(function(){window.location='/'},2000);</script>";
-  page += "</body></html>";
 
-  server.send(200, "text/html", page);
+  ThermoConfig c = thermostatGetConfig();
+  c.enabled     = server.hasArg("enabled");
+  c.setpointC   = server.arg("setpoint").toFloat();
+  c.hysteresisC = server.arg("hyst").toFloat();
+  c.dwellSec    = (uint16_t)constrain(server.arg("dwell").toInt() * 60, 0L, 65535L);
+  c.minLevel    = (uint8_t)server.arg("minLvl").toInt();
+  c.maxLevel    = (uint8_t)server.arg("maxLvl").toInt();
+  thermostatSetConfig(c);
+
+  server.send(200, "text/html",
+    "<html><body><h1>Thermostat mis a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
 }
 
-static void handleMinerWakeup() {
-  String ip = minerGetIP();
-  if (ip.length() == 0) {
-    server.send(400, "text/html", "IP du miner non configuree.");
+static void handleGovernorSave() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
     return;
   }
 
-  bool ok = false;
-  time_t now = time(nullptr);
-  uint32_t ts = (uint32_t)now + 5;  // dans 5 secondes
+  GovConfig c = governorGetConfig();
+  c.enabled  = server.hasArg("enabled");
+  c.limitW   = (uint16_t)constrain(server.arg("limit").toInt(), 0L, 65535L);
+  c.marginW  = (uint16_t)constrain(server.arg("margin").toInt(), 0L, 65535L);
+  c.pollMs   = (uint16_t)constrain(server.arg("pollMs").toInt(), 250L, 60000L);
+  c.targetMs = (uint16_t)constrain(server.arg("target").toInt(), 0L, 65535L);
+  c.source   = (uint8_t)server.arg("source").toInt();
+  c.url      = server.arg("url");
+  c.jsonKey  = server.arg("jsonKey");
+  c.host     = server.arg("host");
+  c.port     = (uint16_t)server.arg("port").toInt();
+  c.unitId   = (uint8_t)server.arg("unit").toInt();
+  c.function = (uint8_t)server.arg("fc").toInt();
+  c.reg      = (uint16_t)server.arg("reg").toInt();
+  c.format   = (uint8_t)server.arg("format").toInt();
+  c.scale    = server.arg("scale").toFloat();
+  c.url.trim();
+  c.jsonKey.trim();
+  c.host.trim();
+  governorSetConfig(c);
 
-  String resp = minerSetWakeup(ts, ok);
+  server.send(200, "text/html",
+    "<html><body><h1>Limite de puissance mise a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
 
-  String page = "<html><body><h1>Commande wake-up envoyee</h1>";
-  if (ok) {
-    page += "<p>Le miner va redevenir actif.</p>";
+static void handleAutotune() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  String msg;
+  if (server.hasArg("abort")) {
+    autotuneAbort();
+    msg = "Autotune interrompu";
   } else {
-    page += "<p style='color:#ff5252'><b>Erreur :</b> " + resp + "</p>";
+    AutotuneConfig c = autotuneGetConfig();
+    c.settleMin    = (uint16_t)constrain(server.arg("settle").toInt(), 0L, 240L);
+    c.minWindowMin = (uint16_t)constrain(server.arg("minWin").toInt(), 1L, 240L);
+    c.maxWindowMin = (uint16_t)constrain(server.arg("maxWin").toInt(), 1L, 480L);
+    c.powerCeilW   = (uint16_t)constrain(server.arg("powerCeil").toInt(), 0L, 65535L);
+    c.tempCeilC    = (uint8_t)constrain(server.arg("tempCeil").toInt(), 0L, 125L);
+    autotuneSetConfig(c);
+    msg = "Reglages enregistres";
+
+    if (server.hasArg("start")) {
+      msg = autotuneStart() ? "Autotune lance"
+                            : "Autotune impossible : miner injoignable ou en veille";
+    }
   }
-  page += "<script>setTimeout(function(){window.location='/'},2000);</script>";
-  page += "</body></html>";
 
-  server.send(200, "text/html", page);
+  server.send(200, "text/html",
+    "<html><body><h1>" + msg + "</h1>"
+    "<script>setTimeout(function(){window.location='/'},1500);</script>"
+    "</body></html>");
 }
 
+static void handleAnalytics() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
 
-static void handleTimeSave() {
-  if (server.method() == HTTP_POST) {
-    String v = server.arg("offset");
-    int offset = v.toInt();
-    if (offset < -12) offset = -12;
-    if (offset > 12) offset = 12;
+  AnalyticsConfig c = analyticsGetConfig();
+  c.hcStartHour = (uint8_t)constrain(server.arg("hcStart").toInt(), 0L, 23L);
+  c.hcEndHour   = (uint8_t)constrain(server.arg("hcEnd").toInt(), 0L, 23L);
+  analyticsSetConfig(c);
+  if (server.hasArg("reset")) analyticsResetEnergy();
 
-    saveTimeConfig(offset);
-    applyTimeConfig();   // ⚡ applique immédiatement le nouvel offset
+  server.send(200, "text/html",
+    "<html><body><h1>Analyse mise a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
 
-    server.send(200, "text/html",
-      "<html><body><h1>Fuseau mis à jour</h1>"
-      "<p>Nouveau décalage UTC : " + String(offset) + " h</p>"
-      "<script>setTimeout(function(){window.location='/'},1000);</script>"
-      "</body></html>");
-  } else {
+static void handlePoolsSave() {
+  if (server.method() != HTTP_POST) {
     server.send(405, "text/html", "Method not allowed");
+    return;
   }
-}
 
+  PoolsConfig c = poolsGetConfig();
+  c.autoFailover   = server.hasArg("auto");
+  c.pollSec        = (uint16_t)constrain(server.arg("poll").toInt(), 5L, 3600L);
+  c.maxRejectPct   = constrain(server.arg("maxRej").toFloat(), 0.1f, 100.0f);
+  c.maxShareAgeSec = (uint16_t)constrain(server.arg("maxAge").toInt(), 0L, 65535L);
+  c.minShares      = (uint16_t)constrain(server.arg("minShares").toInt(), 1L, 65535L);
+  c.cooldownSec    = (uint16_t)constrain(server.arg("cooldown").toInt(), 0L, 65535L);
+  poolsSetConfig(c);
 
-// =======================
-// OTA from GitHub
-// =======================
-static bool fetchRemoteFirmwareInfo(String &remoteVer, String &remoteFile) {
-  WiFiClientSecure client;
-  client.setInsecure(); // pour éviter la gestion des certificats
+  server.send(200, "text/html",
+    "<html><body><h1>Pools mis a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
 
-  HTTPClient https;
-  if (!https.begin(client, GITHUB_VERSION_URL)) {
-    Serial.println("[OTA] Echec https.begin(version)");
-    return false;
+// Sante des pools, pour la supervision
+static void handleApiPools() {
+  PoolsStats st = poolsGetStats();
+  uint32_t now = millis();
+
+  String json = "{";
+  json += "\"last_poll_age_ms\":" + String(st.lastPollMs ? now - st.lastPollMs : 0);
+  json += ",\"poll_errors\":" + String(st.pollErrors);
+  json += ",\"active\":" + String(st.active >= 0 ? st.pools[st.active].pool.index : -1);
+  json += ",\"failovers\":" + String(st.failovers);
+  json += ",\"failover_failures\":" + String(st.failoverFailures);
+  json += ",\"last_detect_ms\":" + String(st.lastDetectMs);
+  json += ",\"max_detect_ms\":" + String(st.maxDetectMs);
+  json += ",\"last_switch_ms\":" + String(st.lastSwitchMs);
+  json += ",\"max_switch_ms\":" + String(st.maxSwitchMs);
+  json += ",\"pools\":[";
+  for (uint8_t i = 0; i < st.count; i++) {
+    const PoolHealth &h = st.pools[i];
+    if (i) json += ",";
+    json += "{\"pool\":" + String(h.pool.index);
+    json += ",\"url\":\"" + jsonEscape(h.pool.url) + "\"";
+    json += ",\"status\":\"" + jsonEscape(h.pool.status) + "\"";
+    json += ",\"priority\":" + String(h.pool.priority);
+    json += ",\"accept_per_min\":" + String(h.acceptPerMin, 2);
+    json += ",\"reject_pct\":" + String(h.rejectPct, 2);
+    json += ",\"stale_pct\":" + String(h.stalePct, 2);
+    json += ",\"share_age_s\":" + String(h.shareAgeSec);
+    json += ",\"degraded\":" + String(h.degraded ? "true" : "false");
+    json += ",\"reason\":\"" + String(h.reason) + "\"}";
   }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
 
-  int code = https.GET();
-  if (code != HTTP_CODE_OK) {
-    Serial.printf("[OTA] HTTP version.txt code=%d\n", code);
-    https.end();
-    return false;
+static void handleFanSave() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
   }
 
-  String body = https.getString();
-  https.end();
+  FanConfig c = fanGetConfig();
+  c.enabled        = server.hasArg("enabled");
+  c.ambLowC        = server.arg("ambLow").toFloat();
+  c.ambHighC       = server.arg("ambHigh").toFloat();
+  c.chipLowC       = server.arg("chipLow").toFloat();
+  c.chipHighC      = server.arg("chipHigh").toFloat();
+  c.safetyC        = constrain(server.arg("safety").toFloat(), 50.0f, 110.0f);
+  c.minPct         = (uint8_t)constrain(server.arg("minPct").toInt(), 15L, 100L);
+  c.maxPct         = (uint8_t)constrain(server.arg("maxPct").toInt(), 15L, 100L);
+  c.stepPct        = (uint8_t)constrain(server.arg("step").toInt(), 1L, 100L);
+  c.minIntervalSec = (uint16_t)constrain(server.arg("interval").toInt(), 5L, 3600L);
+  fanSetConfig(c);
 
-  body.trim();
-  if (body.length() == 0) return false;
+  server.send(200, "text/html",
+    "<html><body><h1>Ventilation mise a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
+}
 
-  int nl = body.indexOf('\n');
-  if (nl < 0) {
-    // Une seule ligne -> version seulement
-    remoteVer = body;
-    remoteFile = "firmware-0-1.bin";  // fallback si deuxième ligne absente
-  } else {
-    remoteVer  = body.substring(0, nl);
-    remoteVer.trim();
-    remoteFile = body.substring(nl + 1);
-    remoteFile.trim();
+static void handleAlertsSave() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
   }
 
-  Serial.println("[OTA] Version distante: " + remoteVer);
-  Serial.println("[OTA] Fichier distant : " + remoteFile);
-  return (remoteVer.length() > 0);
+  String url = server.arg("url");
+  url.trim();
+  alertsSetWebhook(server.hasArg("on"), url);
+
+  String rules = server.arg("rules");
+  rules.replace("\r", "");
+  String err;
+  if (!alertsSetRules(rules, err)) {
+    server.send(400, "text/html",
+      "<html><body><h1>Regles invalides</h1><p>" + htmlEscape(err) + "</p>"
+      "<p><a href=\"/\">Retour</a></p></body></html>");
+    return;
+  }
+
+  server.send(200, "text/html",
+    "<html><body><h1>Alertes mises a jour</h1>"
+    "<script>setTimeout(function(){window.location='/'},1000);</script>"
+    "</body></html>");
 }
 
-static bool otaFromUrl(const String &url) {
-  Serial.println("[OTA] Telechargement depuis: " + url);
+// Historique brut : en-tete de 16 octets puis int16 little-endian, ecrit
+// au fil de la lecture du fichier (pas de JSON a formater)
+struct HistoryStream {
+  uint8_t  buf[512];
+  uint16_t len;
+};
+
+static void historyStreamSink(void *ctx, int16_t value) {
+  HistoryStream *hs = (HistoryStream *)ctx;
+  hs->buf[hs->len++] = (uint8_t)(value & 0xFF);
+  hs->buf[hs->len++] = (uint8_t)((value >> 8) & 0xFF);
+  if (hs->len == sizeof(hs->buf)) {
+    server.sendContent((const char *)hs->buf, hs->len);
+    hs->len = 0;
+  }
+}
 
-  WiFiClientSecure client;
-  client.setInsecure();
-  HTTPClient https;
+static void putLe(uint8_t *p, uint32_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
 
-  if (!https.begin(client, url)) {
-    Serial.println("[OTA] Echec https.begin(firmware)");
-    return false;
-  }
+static void handleApiHistory() {
+  const uint32_t MAX_POINTS = 2048;
 
-  int httpCode = https.GET();
-  if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("[OTA] HTTP code=%d\n", httpCode);
-    https.end();
-    return false;
+  int metric = historyMetricFromName(server.arg("metric"));
+  if (metric < 0) {
+    server.send(400, "text/plain", "metric inconnue");
+    return;
   }
 
-  int contentLength = https.getSize();
-  WiFiClient* stream = https.getStreamPtr();
+  time_t t = time(nullptr);
+  if (t < 1600000000) {
+    server.send(503, "text/plain", "heure non synchronisee");
+    return;
+  }
+  uint32_t now  = (uint32_t)t;
+  uint32_t to   = server.hasArg("to")   ? (uint32_t)server.arg("to").toInt()   : now;
+  uint32_t from = server.hasArg("from") ? (uint32_t)server.arg("from").toInt() : to - 86400;
+  uint32_t step = server.hasArg("step") ? (uint32_t)server.arg("step").toInt() : 300;
+  if (to > now) to = now;
+  step = step < 60 ? 60 : step - step % 60;
+  if (step > HISTORY_MINUTES * 60) step = HISTORY_MINUTES * 60;   // au-dela : rien de plus a agreger
+  from -= from % step;
+  if (to <= from) {
+    server.send(400, "text/plain", "intervalle vide");
+    return;
+  }
 
-  Serial.printf("[OTA] Taille firmware: %d octets\n", contentLength);
+  uint32_t count = (to - from + step - 1) / step;
+  if (count > MAX_POINTS) {
+    count = MAX_POINTS;
+    from  = to - count * step;
+    from -= from % step;
+    count = (to - from + step - 1) / step;
+  }
+  to = from + count * step;
+
+  uint8_t head[16] = { 'K', 'H', '0', '1' };
+  putLe(head + 4, from, 4);
+  putLe(head + 8, step, 4);
+  putLe(head + 12, count, 2);
+  putLe(head + 14, historyMetricScale(metric), 2);
+
+  server.setContentLength(sizeof(head) + 2 * count);
+  server.send(200, "application/octet-stream", "");
+  server.sendContent((const char *)head, sizeof(head));
+
+  HistoryStream hs;
+  hs.len = 0;
+  if (!historyQuery(metric, from, to, step, historyStreamSink, &hs)) {
+    // stockage indisponible : on tient quand meme la longueur annoncee
+    for (uint32_t i = 0; i < count; i++) historyStreamSink(&hs, HISTORY_NO_DATA);
+  }
+  if (hs.len > 0) server.sendContent((const char *)hs.buf, hs.len);
+}
 
-  if (!Update.begin(contentLength > 0 ? contentLength : UPDATE_SIZE_UNKNOWN)) {
-    Serial.println("[OTA] Echec Update.begin()");
-    https.end();
-    return false;
+// min / max / moyenne sur une plage (defaut : 24 h)
+static void handleApiHistoryAgg() {
+  int metric = historyMetricFromName(server.arg("metric"));
+  if (metric < 0) {
+    server.send(400, "text/plain", "metric inconnue");
+    return;
+  }
+  time_t t = time(nullptr);
+  if (t < 1600000000) {
+    server.send(503, "text/plain", "heure non synchronisee");
+    return;
   }
 
-  size_t written = Update.writeStream(*stream);
-  Serial.printf("[OTA] Ecrit %u octets\n", (unsigned)written);
+  uint32_t to   = server.hasArg("to")   ? (uint32_t)server.arg("to").toInt()   : (uint32_t)t;
+  uint32_t from = server.hasArg("from") ? (uint32_t)server.arg("from").toInt() : to - 86400;
 
-  if (contentLength > 0 && written != (size_t)contentLength) {
-    Serial.println("[OTA] Taille ecrite != taille attendue");
-    https.end();
-    return false;
+  HistoryAgg a;
+  uint32_t t0 = micros();
+  if (!historyAggregate(metric, from, to, a)) {
+    server.send(503, "text/plain", "historique indisponible");
+    return;
   }
+  uint32_t us = micros() - t0;
+
+  String json = "{";
+  json += "\"metric\":\"" + String(historyMetricName(metric)) + "\"";
+  json += ",\"from\":" + String(from);
+  json += ",\"to\":" + String(to);
+  json += ",\"count\":" + String(a.count);
+  if (a.count > 0) {
+    json += ",\"min\":" + String(a.min, 2);
+    json += ",\"max\":" + String(a.max, 2);
+    json += ",\"avg\":" + String(a.avg, 3);
+  }
+  json += ",\"query_us\":" + String(us);
+  json += "}";
+  server.send(200, "application/json", json);
+}
 
-  if (!Update.end()) {
-    Serial.printf("[OTA] Erreur Update.end(): %s\n", Update.errorString());
-    https.end();
-    return false;
+// =======================
+// Export CSV / NDJSON
+// =======================
+
+// Export en flux : chaque ligne est formatee dans un tampon fixe, envoye par
+// morceaux (Transfer-Encoding: chunked) au fil de la lecture du fichier.
+// Rien n'est accumule : un export de plusieurs jours tient en 1 Ko de RAM.
+// Les evenements du journal sont intercales par ordre chronologique.
+struct ExportStream {
+  char     buf[1024];
+  uint16_t len;
+  bool     ndjson;
+  uint32_t rows;
+  uint32_t to;
+  JournalCursor jc;
+  JournalEntry  ev;       // prochain evenement a ecrire
+  bool          evPending;
+  uint32_t      events;
+};
+
+static bool exportFlush(ExportStream &es) {
+  stallFeed();   // un export de plusieurs jours peut durer plus que le watchdog
+  if (es.len > 0) {
+    server.sendContent(es.buf, es.len);
+    es.len = 0;
   }
+  return server.client().connected();
+}
 
-  if (!Update.isFinished()) {
-    Serial.println("[OTA] Update pas termine correctement");
-    https.end();
-    return false;
+static bool exportPrintf(ExportStream &es, const char *fmt, ...) {
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(es.buf + es.len, sizeof(es.buf) - es.len, fmt, ap);
+    va_end(ap);
+    if (n >= 0 && (size_t)(es.len + n) < sizeof(es.buf)) {
+      es.len += n;
+      return true;
+    }
+    if (!exportFlush(es)) return false;   // plein : on envoie et on recommence
   }
+  return false;
+}
 
-  Serial.println("[OTA] Mise a jour OK, reboot...");
-  https.end();
-  delay(500);
-  ESP.restart();
+static void formatIsoTime(uint32_t epoch, char *out, size_t size) {
+  time_t t = epoch;
+  struct tm g;
+  gmtime_r(&t, &g);
+  strftime(out, size, "%Y-%m-%dT%H:%M:%SZ", &g);
+}
 
-  return true;  // en theorie on ne revient jamais ici
+// nombre de decimales selon l'echelle de stockage (x1, x10, x100)
+static uint8_t scaleDecimals(uint16_t scale) {
+  return scale >= 100 ? 2 : scale >= 10 ? 1 : 0;
 }
 
-static void checkGithubUpdateAtBoot() {
-  Serial.println("[OTA] Verif mise a jour GitHub...");
+// texte libre (messages du miner) : pas de guillemet ni d'antislash,
+// valable tel quel entre "" en CSV comme en JSON
+static void exportCleanText(const char *in, char *out, size_t size) {
+  size_t i = 0;
+  for (; *in && i + 1 < size; in++) {
+    char c = *in;
+    if (c == '"')       c = '\'';
+    else if (c == '\\') c = '/';
+    else if ((uint8_t)c < 0x20) c = ' ';
+    out[i++] = c;
+  }
+  out[i] = '\0';
+}
 
-  String remoteVer, remoteFile;
-  if (!fetchRemoteFirmwareInfo(remoteVer, remoteFile)) {
-    Serial.println("[OTA] Impossible de lire version distante.");
-    return;
+// ecrit les evenements anterieurs a before
+static bool exportEvents(ExportStream &es, uint32_t before) {
+  while (es.evPending && es.ev.epoch < before) {
+    const JournalEntry &e = es.ev;
+    char iso[24], text[sizeof(e.text)];
+    formatIsoTime(e.epoch, iso, sizeof(iso));
+    exportCleanText(e.text, text, sizeof(text));
+
+    bool ok;
+    if (es.ndjson) {
+      ok = exportPrintf(es, "{\"t\":%lu,\"time\":\"%s\",\"event\":\"%s\",\"source\":\"%s\",\"value\":%d,\"text\":\"%s\"}\n",
+                        (unsigned long)e.epoch, iso, journalEventLabel(e.type),
+                        journalSourceLabel(e.source), e.value, text);
+    } else {
+      // colonnes metriques vides, tout dans la colonne event
+      ok = exportPrintf(es, "%lu,%s", (unsigned long)e.epoch, iso);
+      for (uint8_t m = 0; ok && m < H_METRIC_COUNT; m++) ok = exportPrintf(es, ",");
+      if (ok) ok = exportPrintf(es, ",\"%s (%s) %d %s\"\n", journalEventLabel(e.type),
+                                journalSourceLabel(e.source), e.value, text);
+    }
+    if (!ok) return false;
+    es.events++;
+    es.evPending = journalNext(es.jc, es.to, es.ev);
   }
+  return true;
+}
 
-  float local  = atof(FW_VERSION);
-  float remote = remoteVer.toFloat();
+static bool exportHistoryRow(void *ctx, uint32_t epoch, const int16_t *v) {
+  ExportStream &es = *(ExportStream *)ctx;
+  if (!exportEvents(es, epoch)) return false;
 
-  Serial.printf("[OTA] Version locale = %.2f, distante = %.2f\n", local, remote);
+  char iso[24];
+  formatIsoTime(epoch, iso, sizeof(iso));
 
-  if (remote <= local + 0.0001f) {
-    Serial.println("[OTA] Firmware a jour.");
-    return;
-  }
+  bool ok = es.ndjson
+    ? exportPrintf(es, "{\"t\":%lu,\"time\":\"%s\"", (unsigned long)epoch, iso)
+    : exportPrintf(es, "%lu,%s", (unsigned long)epoch, iso);
 
-  // Affichage sur TFT
-  String line2 = "v" + String(FW_VERSION) + " -> v" + remoteVer;
-  displayShowOtaStatus("Mise a jour dispo", line2);
-  delay(2000);
+  for (uint8_t m = 0; ok && m < H_METRIC_COUNT; m++) {
+    uint16_t scale = historyMetricScale(m);
+    uint8_t  dec   = scaleDecimals(scale);
+    if (es.ndjson) {
+      if (v[m] == HISTORY_NO_DATA) ok = exportPrintf(es, ",\"%s\":null", historyMetricName(m));
+      else ok = exportPrintf(es, ",\"%s\":%.*f", historyMetricName(m), dec, (double)v[m] / scale);
+    } else {
+      if (v[m] == HISTORY_NO_DATA) ok = exportPrintf(es, ",");
+      else ok = exportPrintf(es, ",%.*f", dec, (double)v[m] / scale);
+    }
+  }
+  if (ok) ok = exportPrintf(es, es.ndjson ? "}\n" : ",\n");
+  es.rows++;
+  return ok;
+}
 
-  displayShowOtaStatus("Telechargement...", "");
-  String url = String(GITHUB_FIRMWARE_BASE_URL) + remoteFile;
-  bool ok = otaFromUrl(url);
+static void handleExport(bool ndjson) {
+  time_t t = time(nullptr);
+  if (t < 1600000000) {
+    server.send(503, "text/plain", "heure non synchronisee");
+    return;
+  }
+  uint32_t to   = server.hasArg("to")   ? (uint32_t)server.arg("to").toInt()   : (uint32_t)t;
+  uint32_t from = server.hasArg("from") ? (uint32_t)server.arg("from").toInt() : to - 86400;
+  if (to > (uint32_t)t) to = (uint32_t)t;   // rien dans le futur : inutile de le parcourir
+  if (to <= from) {
+    server.send(400, "text/plain", "intervalle vide");
+    return;
+  }
 
-  if (!ok) {
-    displayShowOtaStatus("Echec mise a jour", "");
-    delay(2000);
+  server.sendHeader("Content-Disposition",
+                    ndjson ? "attachment; filename=kon8-history.ndjson" : "attachment; filename=kon8-history.csv");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, ndjson ? "application/x-ndjson" : "text/csv", "");
+
+  static ExportStream es;   // 1 Ko hors pile, un seul export a la fois (serveur mono-tache)
+  es.len    = 0;
+  es.ndjson = ndjson;
+  es.rows   = 0;
+  es.to     = to;
+  es.events = 0;
+  journalSeek(es.jc, from);
+  es.evPending = journalNext(es.jc, to, es.ev);
+
+  if (!ndjson) {
+    exportPrintf(es, "epoch,time");
+    for (uint8_t m = 0; m < H_METRIC_COUNT; m++) exportPrintf(es, ",%s", historyMetricName(m));
+    exportPrintf(es, ",event\n");
   }
+
+  historyForEachMinute(from, to, exportHistoryRow, &es);
+  exportEvents(es, to);   // evenements posterieurs a la derniere minute
+  exportFlush(es);
+  server.sendContent("");   // fin du transfert chunked
+  LOG_I("portal", "Export %s : %lu lignes, %lu evenements", ndjson ? "ndjson" : "csv",
+                (unsigned long)es.rows, (unsigned long)es.events);
 }
 
+static void handleExportCsv() {
+  handleExport(false);
+}
 
+static void handleExportNdjson() {
+  handleExport(true);
+}
 
+static void handleTimeSave() {
+  if (server.method() == HTTP_POST) {
+    String v = server.arg("offset");
+    int offset = v.toInt();
+    if (offset < -12) offset = -12;
+    if (offset > 12) offset = 12;
 
+    saveTimeConfig(offset);
+    applyTimeConfig();   // ⚡ applique immédiatement le nouvel offset
+    scheduleInvalidate();
 
+    server.send(200, "text/html",
+      "<html><body><h1>Fuseau mis à jour</h1>"
+      "<p>Nouveau décalage UTC : " + String(offset) + " h</p>"
+      "<script>setTimeout(function(){window.location='/'},1000);</script>"
+      "</body></html>");
+  } else {
+    server.send(405, "text/html", "Method not allowed");
+  }
+}
 
 
 // =======================
 // WIFI
 // =======================
 
-static bool connectToSavedWiFi(uint16_t timeoutMs = 15000) {
-  prefs.begin("wifi", true);
-  wifiSSID = prefs.getString("ssid", "");
-  wifiPASS = prefs.getString("pass", "");
+// Reconnexion rapide : reseau, BSSID et canal du dernier point d'acces sont
+// gardes en NVS (cf. wifiCacheGet) ; WiFi.begin() les utilise pour sauter
+// le scan complet des canaux. S'ils ne menent nulle part, on repart sur une
+// connexion classique, puis sur les autres reseaux enregistres.
+const uint32_t WIFI_FAST_TIMEOUT_MS = 3000;
+const uint32_t WIFI_POLL_MS         = 50;
+
+static bool     gWifiBegun   = false;
+static bool     gWifiFast    = false;   // tentative en cours avec le cache
+static uint32_t gWifiBeginMs = 0;
+static uint8_t  gWifiSlot    = 0;       // reseau enregistre en cours d'essai
+
+void portalBeginWiFi() {
+  if (gWifiBegun) return;
+
+  prefs.begin("sys", true);
+  bool forceAP = prefs.getBool("forceAP", false);
   prefs.end();
+  if (forceAP) return;   // portalSetup() partira en AP
+
+  uint8_t bssid[6], chan = 0, slot = 0;
+  bool cached = wifiCacheGet(slot, bssid, chan);
+  if (!cached || !wifiNetGet(slot, wifiSSID, wifiPASS)) {
+    cached = false;
+    slot   = 0;
+    if (!wifiNetGet(0, wifiSSID, wifiPASS)) return;
+  }
 
-  if (wifiSSID.length() == 0) {
-    Serial.println("Aucun WiFi sauvegarde.");
+  WiFi.mode(WIFI_STA);
+  wifiIpApply(wifiSSID);   // IP fixe seulement pour le reseau qui l'a recue
+
+  gWifiFast = cached;
+  gWifiSlot = slot;
+  if (gWifiFast) WiFi.begin(wifiSSID.c_str(), wifiPASS.c_str(), chan, bssid);
+  else           WiFi.begin(wifiSSID.c_str(), wifiPASS.c_str());
+  gWifiBegun   = true;
+  gWifiBeginMs = millis();
+  LOG_I("wifi", "Connexion a %s%s", wifiSSID.c_str(), gWifiFast ? " (canal / BSSID en cache)" : "");
+}
+
+static bool waitWiFi(uint32_t sinceMs, uint16_t timeoutMs) {
+  while (WiFi.status() != WL_CONNECTED && millis() - sinceMs < timeoutMs) {
+    if (gWifiFast && millis() - sinceMs >= WIFI_FAST_TIMEOUT_MS) {
+      // point d'acces deplace ou remplace : scan complet
+      LOG_W("wifi", "Cache BSSID / canal sans effet, connexion classique");
+      gWifiFast = false;
+      WiFi.disconnect();
+      WiFi.begin(wifiSSID.c_str(), wifiPASS.c_str());
+    }
+    delay(WIFI_POLL_MS);
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+
+static bool connectToSavedWiFi(uint16_t timeoutMs = 15000) {
+  portalBeginWiFi();   // deja lance au tout debut de setup() en general
+  if (!gWifiBegun) {
+    LOG_W("wifi", "Aucun WiFi sauvegarde.");
     return false;
   }
 
-  Serial.println("Tentative de connexion a : " + wifiSSID);
   displayShowConnecting(wifiSSID);
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(wifiSSID.c_str(), wifiPASS.c_str());
-
-  uint32_t start = millis();
-  while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
-    delay(500);
-    Serial.print(".");
+  bool fast = gWifiFast;
+  bool ok = waitWiFi(gWifiBeginMs, timeoutMs);
+  fast = fast && gWifiFast;
+
+  // reseau habituel absent : le plus fort des autres reseaux enregistres
+  if (!ok && wifiNetCount() > 1) {
+    WiFi.disconnect();
+    uint8_t bssid[6], chan = 0;
+    int32_t rssi = 0;
+    int16_t n = WiFi.scanNetworks();
+    int8_t slot = n > 0 ? wifiNetPickFromScan(n, gWifiSlot, bssid, chan, rssi) : -1;
+    WiFi.scanDelete();
+    if (slot >= 0 && wifiNetGet(slot, wifiSSID, wifiPASS)) {
+      LOG_I("wifi", "Essai du reseau enregistre %s (%ld dBm)", wifiSSID.c_str(), (long)rssi);
+      displayShowConnecting(wifiSSID);
+      gWifiSlot = slot;
+      wifiIpApply(wifiSSID);
+      WiFi.begin(wifiSSID.c_str(), wifiPASS.c_str(), chan, bssid);
+      ok = waitWiFi(millis(), timeoutMs);
+    }
   }
-  Serial.println();
 
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("WiFi CONNECTE, IP: " + WiFi.localIP().toString());
+  if (ok) {
+    LOG_I("wifi", "WiFi connecte en %lu ms, IP : %s", (unsigned long)(millis() - gWifiBeginMs),
+          WiFi.localIP().toString().c_str());
+    perfBootMark(BOOT_WIFI);
+    perfBootSetFastWifi(fast);
+    wifiCacheSave(gWifiSlot);
     //displayShowWiFiOK(wifiSSID, WiFi.localIP());
     return true;
   } else {
-    Serial.println("Echec de connexion WiFi.");
+    LOG_W("wifi", "Echec de connexion WiFi.");
     displayShowWiFiError();
     return false;
   }
 }
 
+// =======================
+// Instrumentation (/debug/perf)
+// =======================
+
+// Enregistre un handler chronometre : un histogramme par URI, et l'URI
+// comme section de loop() pour attribuer un eventuel blocage
+static void route(const char *uri, WebServer::THandlerFunction fn) {
+  int8_t probe = perfProbe(PERF_HTTP, uri);
+  server.on(uri, [fn, probe, uri]() {
+    const char *prev = stallSection(uri);
+    {
+      PerfScope ps(probe);
+      fn();
+    }
+    stallSection(prev);
+  });
+}
+
+// GET : histogrammes + tas en JSON ; POST : remise a zero
+static void handleDebugPerf() {
+  if (server.method() == HTTP_POST) {
+    perfReset();
+    server.send(200, "application/json", "{\"reset\":true}");
+    return;
+  }
+
+  PerfHeap hp = perfGetHeap();
+  String json = "{\"uptime_ms\":" + String(millis());
+  json += ",\"heap\":{\"free\":" + String(hp.freeHeap);
+  json += ",\"min_free\":" + String(hp.minFreeHeap);
+  json += ",\"largest_block\":" + String(hp.largestBlock);
+  json += ",\"min_largest_block\":" + String(hp.minLargestBlock);
+  json += ",\"age_ms\":" + String(hp.sampledMs ? millis() - hp.sampledMs : 0) + "}";
+
+  // jalons du demarrage (ms depuis le reset, 0 = pas encore atteint)
+  PerfBoot boot = perfGetBoot();
+  json += ",\"boot\":{\"fast_wifi\":" + String(boot.fastWifi ? "true" : "false");
+  for (uint8_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+    json += ",\"" + String(perfBootStageLabel(i)) + "_ms\":" + String(boot.ms[i]);
+  }
+  json += "}";
+
+  json += ",\"stacks\":{";
+  for (uint8_t i = 0; i < hp.taskCount; i++) {
+    if (i) json += ",";
+    json += "\"" + String(hp.tasks[i].name) + "\":" + String(hp.tasks[i].stackFree);
+  }
+  json += "},\"probes\":[";
+  for (uint8_t i = 0; i < perfProbeCount(); i++) {
+    PerfSummary ps;
+    if (!perfGet(i, ps)) break;
+    if (i) json += ",";
+    json += "{\"kind\":\"" + String(perfKindLabel(ps.kind)) + "\",\"name\":\"" + String(ps.name) + "\"";
+    json += ",\"count\":" + String(ps.count);
+    json += ",\"avg_us\":" + String(ps.avgUs);
+    json += ",\"p50_us\":" + String(ps.p50Us);
+    json += ",\"p95_us\":" + String(ps.p95Us);
+    json += ",\"p99_us\":" + String(ps.p99Us);
+    json += ",\"max_us\":" + String(ps.maxUs) + "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+// Supervision WiFi : etat, compteurs de coupures et duree des reconnexions
+static void handleDebugWifi() {
+  if (server.method() != HTTP_GET) {
+    server.send(405, "text/html", "Method not allowed");
+    return;
+  }
+
+  WifiSupStats ws = wifiSupGetStats();
+  uint32_t now = millis();
+  String json = "{\"state\":\"" + String(wifiSupStateLabel(ws.state)) + "\"";
+  json += ",\"ssid\":\"" + jsonEscape(WiFi.SSID()) + "\"";
+  json += ",\"bssid\":\"" + WiFi.BSSIDstr() + "\"";
+  json += ",\"channel\":" + String(WiFi.channel());
+  json += ",\"rssi\":" + String(WiFi.RSSI());
+  json += ",\"slot\":" + String(ws.slot);
+  json += ",\"attempts\":" + String(ws.attempts);
+  json += ",\"last_reason\":" + String(ws.lastReason);
+  json += ",\"disconnects\":" + String(ws.disconnects);
+  json += ",\"reconnects\":" + String(ws.reconnects);
+  json += ",\"failed_attempts\":" + String(ws.failedAttempts);
+  json += ",\"roams\":" + String(ws.roams);
+  json += ",\"last_reconnect_ms\":" + String(ws.lastReconnectMs);
+  json += ",\"max_reconnect_ms\":" + String(ws.maxReconnectMs);
+  json += ",\"total_down_ms\":" + String(ws.totalDownMs);
+  json += ",\"down_for_ms\":" + String(ws.downSinceMs ? now - ws.downSinceMs : 0);
+  json += ",\"next_try_ms\":" + String(ws.state == WSUP_WAIT ? (int32_t)(ws.nextTryMs - now) : 0);
+
+  json += ",\"networks\":[";
+  for (uint8_t i = 0; i < wifiNetCount(); i++) {
+    String ssid, pass;
+    if (!wifiNetGet(i, ssid, pass)) break;
+    if (i) json += ",";
+    json += "\"" + jsonEscape(ssid) + "\"";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+static bool exportTraceEvent(void *ctx, const TraceEvent &ev) {
+  ExportStream &es = *(ExportStream *)ctx;
+  const char *cat = ev.cat == TRACE_CAT_SPAN ? "span" : perfKindLabel(ev.cat);
+  bool ok = exportPrintf(es, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":%u,\"tid\":%u}",
+                         ev.name, cat, (unsigned long)ev.startUs, (unsigned long)ev.durUs,
+                         (unsigned)ev.core, (unsigned)ev.task);
+  es.rows++;
+  return ok;
+}
+
+// GET : spans des deux coeurs au format Chrome trace_event (chrome://tracing,
+// ui.perfetto.dev) ; pid = coeur, tid = tache. POST : vide les anneaux.
+static void handleDebugTrace() {
+  if (server.method() == HTTP_POST) {
+    traceClear();
+    server.send(200, "application/json", "{\"cleared\":true}");
+    return;
+  }
+
+  server.sendHeader("Content-Disposition", "attachment; filename=kon8-trace.json");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+
+  static ExportStream es;
+  es.len  = 0;
+  es.rows = 0;
+
+  exportPrintf(es, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%lu},\"traceEvents\":[",
+               (unsigned long)traceDropped());
+  // metadonnees : noms des coeurs et des taches
+  for (uint8_t core = 0; core < 2; core++) {
+    exportPrintf(es, "%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"core %u\"}}",
+                 core ? "," : "", (unsigned)core, (unsigned)core);
+    for (uint8_t t = 0; t < TRACE_MAX_TASKS; t++) {
+      if (traceTaskName(t)[0] == '\0') continue;
+      exportPrintf(es, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                   (unsigned)core, (unsigned)t, traceTaskName(t));
+    }
+  }
+  traceForEach(exportTraceEvent, &es);
+  exportPrintf(es, "\n]}\n");
+  exportFlush(es);
+  server.sendContent("");
+  LOG_I("portal", "Trace : %lu spans", (unsigned long)es.rows);
+}
+
+static bool exportLogLine(void *ctx, uint8_t level, const char *line) {
+  ExportStream &es = *(ExportStream *)ctx;
+  es.rows++;
+  return exportPrintf(es, "%s\n", line);
+}
+
+// Dernieres lignes du logger ; ?level=e|w|i|d (defaut : tout ce qui est compile)
+static void handleLog() {
+  uint8_t maxLevel = LOG_LEVEL_DEBUG;
+  if (server.hasArg("level")) {
+    switch (server.arg("level")[0]) {
+      case 'e': maxLevel = LOG_LEVEL_ERROR; break;
+      case 'w': maxLevel = LOG_LEVEL_WARN;  break;
+      case 'i': maxLevel = LOG_LEVEL_INFO;  break;
+    }
+  }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; charset=utf-8", "");
+
+  static ExportStream es;
+  es.len  = 0;
+  es.rows = 0;
+  if (logDropped()) exportPrintf(es, "(%lu ligne(s) perdue(s) avant Serial)\n", (unsigned long)logDropped());
+  logForEach(maxLevel, exportLogLine, &es);
+  exportFlush(es);
+  server.sendContent("");
+}
+
+// GET : blocages de loop() ; POST : clear=1, ou wdt / wdt_sec / threshold_ms
+static void handleDebugStalls() {
+  if (server.method() == HTTP_POST) {
+    if (server.hasArg("clear")) {
+      stallClear();
+    } else {
+      StallConfig cfg = stallGetConfig();
+      if (server.hasArg("wdt"))          cfg.wdt = server.arg("wdt") == "1";
+      if (server.hasArg("wdt_sec"))      cfg.wdtSec = server.arg("wdt_sec").toInt();
+      if (server.hasArg("threshold_ms")) cfg.thresholdMs = server.arg("threshold_ms").toInt();
+      stallSetConfig(cfg);
+    }
+  }
+
+  StallConfig cfg = stallGetConfig();
+  StallStats st = stallGetStats();
+  String json = "{\"wdt\":" + String(cfg.wdt ? "true" : "false");
+  json += ",\"wdt_sec\":" + String(cfg.wdtSec);
+  json += ",\"threshold_ms\":" + String(cfg.thresholdMs);
+  json += ",\"total\":" + String(st.total);
+  json += ",\"worst_loop_ms\":" + String(st.worstLoopMs);
+  json += ",\"last_reset\":";
+  if (st.lastResetReason) {
+    json += "{\"reason\":" + String(st.lastResetReason) + ",\"section\":\"" + String(st.lastResetSection) +
+            "\",\"epoch\":" + String(st.lastResetEpoch) + "}";
+  } else {
+    json += "null";
+  }
+  json += ",\"top\":[";
+  for (uint8_t i = 0; i < st.count; i++) {
+    if (i) json += ",";
+    json += "{\"section\":\"" + String(st.top[i].section) + "\",\"ms\":" + String(st.top[i].durMs) +
+            ",\"epoch\":" + String(st.top[i].epoch) + ",\"uptime_s\":" + String(st.top[i].uptimeS) + "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
 static void startAPMode() {
   configMode = true;
-  Serial.println("Demarrage du mode AP de configuration");
+  LOG_I("portal", "Demarrage du mode AP de configuration");
 
   WiFi.mode(WIFI_AP_STA);
   WiFi.softAP(apSSID, apPASS);
 
   IPAddress ip = WiFi.softAPIP();
-  Serial.print("AP IP address: ");
-  Serial.println(ip);
+  LOG_I("wifi", "Adresse IP de l'AP : %s", ip.toString().c_str());
 
   displayShowAPInfo(ip);
 
-  // Scan des reseaux
-  Serial.println("Scan des reseaux WiFi...");
-  int n = WiFi.scanNetworks();
-  ssidOptionsHTML = "";
-  if (n == 0) {
-    ssidOptionsHTML = "<option value=\"\">Aucun reseau trouve</option>";
-  } else {
-    for (int i = 0; i < n; i++) {
-      String ssid = WiFi.SSID(i);
-      int rssi = WiFi.RSSI(i);
-      ssidOptionsHTML += "<option value=\"";
-      ssidOptionsHTML += ssid;
-      ssidOptionsHTML += "\">";
-      ssidOptionsHTML += ssid;
-      ssidOptionsHTML += " (";
-      ssidOptionsHTML += String(rssi);
-      ssidOptionsHTML += " dBm)</option>";
-    }
-  }
-  WiFi.scanDelete();
-
-  server.on("/", handleRoot);
-  server.on("/save", handleSave);
-  server.on("/reconfig", handleReconfig);
-  server.on("/miner", handleMinerSave);
-  server.on("/miner_mode", handleMinerMode);
-  server.on("/time", handleTimeSave);
-  server.on("/miner_standby", handleMinerStandby);
-  server.on("/miner_wakeup", handleMinerWakeup);
+  // portail captif : tous les noms resolvent vers l'AP
+  dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
+  dnsServer.start(53, "*", ip);
+
+  // scan en tache de fond : la page de config est servie tout de suite
+  apScanStart();
+
+  route("/api/scan", handleApiScan);
+  server.onNotFound(handleCaptiveRedirect);
+
+  route("/", handleRoot);
+  route("/save", handleSave);
+  route("/reconfig", handleReconfig);
+  route("/wifi_add", handleWifiAdd);
+  route("/wifi_forget", handleWifiForget);
+  route("/miner", handleMinerSave);
+  route("/miner_mode", handleMinerMode);
+  route("/time", handleTimeSave);
+  route("/miner_standby", handleMinerStandby);
+  route("/miner_wakeup", handleMinerWakeup);
+  route("/api/poll", handleApiPoll);
+  route("/api/cmd", handleApiCmd);
+  route("/sched_add", handleSchedAdd);
+  route("/sched_del", handleSchedDel);
+  route("/sched_enable", handleSchedEnable);
+  route("/thermo", handleThermoSave);
+  route("/governor", handleGovernorSave);
+  route("/autotune", handleAutotune);
+  route("/analytics", handleAnalytics);
+  route("/pools", handlePoolsSave);
+  route("/api/pools", handleApiPools);
+  route("/fan", handleFanSave);
+  route("/alerts", handleAlertsSave);
+  route("/api/history.bin", handleApiHistory);
+  route("/api/history/agg", handleApiHistoryAgg);
+  route("/export.csv", handleExportCsv);
+  route("/export.ndjson", handleExportNdjson);
+  route("/debug/perf", handleDebugPerf);
+  route("/debug/wifi", handleDebugWifi);
+  route("/ota", handleOta);
+  route("/debug/stalls", handleDebugStalls);
+  route("/debug/trace", handleDebugTrace);
+  route("/log", handleLog);
   server.begin();
 }
 
 static void startNormalMode() {
   configMode = false;
-  Serial.println("Mode normal (connecte au WiFi).");
+  LOG_I("portal", "Mode normal (connecte au WiFi).");
 
   //displayShowWiFiOK(wifiSSID, WiFi.localIP());
 
-  server.on("/", handleRoot);
-  server.on("/reconfig", handleReconfig);
-  server.on("/miner", handleMinerSave);
-  server.on("/miner_mode", handleMinerMode);
-  server.on("/time", handleTimeSave);
-  server.on("/miner_standby", handleMinerStandby);
-  server.on("/miner_wakeup", handleMinerWakeup);
+  route("/", handleRoot);
+  route("/reconfig", handleReconfig);
+  route("/wifi_add", handleWifiAdd);
+  route("/wifi_forget", handleWifiForget);
+  route("/miner", handleMinerSave);
+  route("/miner_mode", handleMinerMode);
+  route("/time", handleTimeSave);
+  route("/miner_standby", handleMinerStandby);
+  route("/miner_wakeup", handleMinerWakeup);
+  route("/api/poll", handleApiPoll);
+  route("/api/cmd", handleApiCmd);
+  route("/sched_add", handleSchedAdd);
+  route("/sched_del", handleSchedDel);
+  route("/sched_enable", handleSchedEnable);
+  route("/thermo", handleThermoSave);
+  route("/governor", handleGovernorSave);
+  route("/autotune", handleAutotune);
+  route("/analytics", handleAnalytics);
+  route("/pools", handlePoolsSave);
+  route("/api/pools", handleApiPools);
+  route("/fan", handleFanSave);
+  route("/alerts", handleAlertsSave);
+  route("/api/history.bin", handleApiHistory);
+  route("/api/history/agg", handleApiHistoryAgg);
+  route("/export.csv", handleExportCsv);
+  route("/export.ndjson", handleExportNdjson);
+  route("/debug/perf", handleDebugPerf);
+  route("/debug/wifi", handleDebugWifi);
+  route("/ota", handleOta);
+  route("/debug/stalls", handleDebugStalls);
+  route("/debug/trace", handleDebugTrace);
+  route("/log", handleLog);
   server.begin();
 }
 
@@ -846,6 +2609,15 @@ static void startNormalMode() {
 
 void portalSetup() {
   minerInit();   // charge IP + mode du miner
+  scheduleInit(); // regles du planning
+  thermostatInit();
+  governorInit();
+  autotuneInit();
+  analyticsInit();
+  poolsInit();
+  fanInit();
+  alertsInit();
+  historyInit();
 
   // 1) On regarde si on doit FORCER le mode AP
   bool forceAP = false;
@@ -859,25 +2631,32 @@ void portalSetup() {
     prefs.putBool("forceAP", false);
     prefs.end();
 
-    Serial.println("Force AP mode au demarrage (flag forceAP)");
+    LOG_I("portal", "Force AP mode au demarrage (flag forceAP)");
     startAPMode();
     return;
   }
 
   // 2) Comportement normal : tentative de connexion WiFi
+  stallSection("wifi connect");
   bool ok = connectToSavedWiFi();
 
   if (ok) {
     startNormalMode();
-        // 🆕 Vérifie mise à jour GitHub
-    checkGithubUpdateAtBoot();
+    wifiSupStart(gWifiSlot);   // reconnexion automatique a partir d'ici
+    otaStart();   // verification du manifeste en tache de fond
   } else {
+    stallSection("ap mode");
     startAPMode();
   }
+  stallSection("setup");
 }
 
 
 void portalLoop() {
+  if (configMode) {
+    dnsServer.processNextRequest();
+    apScanLoop();
+  }
   server.handleClient();
 }
 
@@ -885,7 +2664,6 @@ bool portalIsConfigMode() {
   return configMode;
 }
 
-
 void portalFactoryReset() {
   Preferences p;
 
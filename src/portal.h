@@ -1,7 +1,11 @@
 #pragma once
 #include <Arduino.h>
 
+// Lance l'association WiFi (non bloquant) : a appeler tout au debut de
+// setup() pour que la connexion avance pendant le reste de l'init.
+void portalBeginWiFi();
 void portalSetup();
 void portalLoop();
 void portalFactoryReset();
 bool portalIsConfigMode();
+
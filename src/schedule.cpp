@@ -0,0 +1,256 @@
+#include "schedule.h"
+
+#include <Preferences.h>
+#include <time.h>
+
+#include "cmdqueue.h"
+#include "governor.h"
+#include "autotune.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences schedPrefs;
+
+static SchedRule gRules[SCHED_MAX_RULES];
+static uint8_t   gRuleCount = 0;
+static bool      gEnabled   = false;
+
+// softoff / softon sont envoyes en avance avec l'horodatage prevu :
+// le miner bascule a l'heure meme si le controleur est occupe a ce moment-la.
+const uint32_t SCHED_POWER_LEAD_S = 60;
+
+const uint32_t SCHED_MIN_VALID_EPOCH = 1600000000;   // heure NTP pas encore recue
+const uint8_t  SCHED_KEY_SHIFT       = 5;            // 32 > SCHED_MAX_RULES
+
+// Seule la prochaine echeance est calculee ; loop() ne fait que la comparer.
+// Cle = (epoch d'envoi << 5) | index : deux regles a la meme minute
+// partent l'une apres l'autre, dans l'ordre.
+static bool     gNextValid    = false;
+static uint64_t gNextKey      = 0;
+static uint64_t gLastFiredKey = 0;
+static bool     gDirty        = true;
+
+static bool isPowerAction(uint8_t action) {
+  return action == SCHED_STANDBY || action == SCHED_WAKEUP;
+}
+
+static uint32_t leadSeconds(uint8_t action) {
+  return isPowerAction(action) ? SCHED_POWER_LEAD_S : 0;
+}
+
+static void saveRules() {
+  schedPrefs.begin("sched", false);
+  schedPrefs.putBytes("rules", gRules, sizeof(SchedRule) * gRuleCount);
+  schedPrefs.putUChar("count", gRuleCount);
+  schedPrefs.putBool("enabled", gEnabled);
+  schedPrefs.end();
+}
+
+// Premiere echeance strictement apres afterKey
+static bool computeNext(uint32_t nowEpoch, uint64_t afterKey, uint64_t &outKey) {
+  time_t now = (time_t)nowEpoch;
+  struct tm lt;
+  localtime_r(&now, &lt);
+
+  // minuit local aujourd'hui, et jour de la semaine (0 = lundi)
+  uint32_t midnight = nowEpoch - (uint32_t)(lt.tm_sec + 60 * (lt.tm_min + 60 * lt.tm_hour));
+  uint8_t  today    = (uint8_t)((lt.tm_wday + 6) % 7);
+
+  bool found = false;
+  uint64_t best = 0;
+
+  for (uint8_t i = 0; i < gRuleCount; i++) {
+    const SchedRule &r = gRules[i];
+    uint32_t lead = leadSeconds(r.action);
+
+    // hier (envoi anticipe sur une regle juste apres minuit) .. dans 7 jours
+    for (int8_t d = -1; d <= 7; d++) {
+      uint8_t dow = (uint8_t)((today + 7 + d) % 7);
+      if (!(r.days & (1 << dow))) continue;
+
+      uint32_t at   = midnight + (int32_t)d * 86400 + ((uint32_t)r.hour * 60 + r.minute) * 60;
+      uint32_t send = at - lead;
+      uint64_t key  = ((uint64_t)send << SCHED_KEY_SHIFT) | i;
+
+      if (key <= afterKey) continue;
+      if (!found || key < best) {
+        best  = key;
+        found = true;
+      }
+      break;   // jours croissants : le premier qui convient est le bon
+    }
+  }
+
+  outKey = best;
+  return found;
+}
+
+static void recompute(uint32_t nowEpoch) {
+  gDirty = false;
+
+  // Ne rattrape pas le passe : on repart de maintenant
+  uint64_t floorKey = ((uint64_t)nowEpoch << SCHED_KEY_SHIFT) - 1;
+  uint64_t after = (gLastFiredKey > floorKey) ? gLastFiredKey : floorKey;
+
+  gNextValid = gEnabled && computeNext(nowEpoch, after, gNextKey);
+
+  if (gNextValid) {
+    uint8_t idx = (uint8_t)(gNextKey & ((1 << SCHED_KEY_SHIFT) - 1));
+    uint32_t at = (uint32_t)(gNextKey >> SCHED_KEY_SHIFT) + leadSeconds(gRules[idx].action);
+    LOG_I("sched", "Prochaine transition : %s a epoch %u",
+                  scheduleActionLabel(gRules[idx].action), (unsigned)at);
+  }
+}
+
+static void fire(uint8_t idx, uint32_t atEpoch) {
+  const SchedRule &r = gRules[idx];
+  uint32_t id = 0;
+
+  // le gouverneur de puissance a le dernier mot : mode ramene sous son plafond
+  uint8_t action = r.action;
+  int8_t cap = governorLevelCap();
+  if (action <= SCHED_SUPER && (int8_t)(action + 1) > cap) {
+    if (cap <= 0) {
+      LOG_I("sched", "Regle ignoree : miner bride en veille par le gouverneur");
+      return;
+    }
+    action = (uint8_t)(cap - 1);
+  }
+  if (action == SCHED_WAKEUP && cap <= 0) {
+    LOG_I("sched", "Reveil ignore : miner bride en veille par le gouverneur");
+    return;
+  }
+
+  if (autotuneIsRunning() && action <= SCHED_SUPER) {
+    LOG_I("sched", "Changement de mode ignore : autotune en cours");
+    return;
+  }
+
+  switch (action) {
+    case SCHED_ECO:      id = cmdQueueSubmit(CMD_MODE, "eco", 0, false, JSRC_SCHEDULE);       break;
+    case SCHED_STANDARD: id = cmdQueueSubmit(CMD_MODE, "standard", 0, false, JSRC_SCHEDULE);  break;
+    case SCHED_SUPER:    id = cmdQueueSubmit(CMD_MODE, "super", 0, false, JSRC_SCHEDULE);     break;
+    case SCHED_STANDBY:  id = cmdQueueSubmit(CMD_STANDBY, "", atEpoch, false, JSRC_SCHEDULE); break;
+    case SCHED_WAKEUP:   id = cmdQueueSubmit(CMD_WAKEUP, "", atEpoch, false, JSRC_SCHEDULE);  break;
+  }
+
+  LOG_I("sched", "Regle %u (%s) -> commande #%u",
+                (unsigned)idx, scheduleActionLabel(action), (unsigned)id);
+}
+
+// =======================
+// API publique
+// =======================
+
+void scheduleInit() {
+  schedPrefs.begin("sched", true);
+  gEnabled   = schedPrefs.getBool("enabled", false);
+  gRuleCount = schedPrefs.getUChar("count", 0);
+  if (gRuleCount > SCHED_MAX_RULES) gRuleCount = 0;
+  if (gRuleCount > 0 &&
+      schedPrefs.getBytes("rules", gRules, sizeof(SchedRule) * gRuleCount)
+        != sizeof(SchedRule) * gRuleCount) {
+    gRuleCount = 0;
+  }
+  schedPrefs.end();
+  gDirty = true;
+}
+
+void scheduleLoop() {
+  uint32_t now = (uint32_t)time(nullptr);
+  if (now < SCHED_MIN_VALID_EPOCH) return;
+
+  if (gDirty) recompute(now);
+  if (!gNextValid) return;
+
+  uint32_t sendAt = (uint32_t)(gNextKey >> SCHED_KEY_SHIFT);
+  if (now < sendAt) return;
+
+  uint8_t idx = (uint8_t)(gNextKey & ((1 << SCHED_KEY_SHIFT) - 1));
+  gLastFiredKey = gNextKey;
+
+  // Echeance ratee de beaucoup (controleur bloque, heure corrigee) : on l'ignore
+  if (now - sendAt <= 300) {
+    fire(idx, sendAt + leadSeconds(gRules[idx].action));
+  } else {
+    LOG_I("sched", "Echeance depassee, ignoree");
+  }
+  recompute(now);
+}
+
+void scheduleInvalidate() {
+  // les index ont pu changer : tout ce qui tombait a la seconde du dernier
+  // declenchement est considere comme fait
+  if (gLastFiredKey != 0) gLastFiredKey |= (1 << SCHED_KEY_SHIFT) - 1;
+  gDirty = true;
+}
+
+uint8_t scheduleGetRules(SchedRule *out, uint8_t max) {
+  uint8_t n = gRuleCount < max ? gRuleCount : max;
+  for (uint8_t i = 0; i < n; i++) out[i] = gRules[i];
+  return n;
+}
+
+bool scheduleAddRule(const SchedRule &rule) {
+  if (gRuleCount >= SCHED_MAX_RULES) return false;
+  if (rule.days == 0 || (rule.days & 0x80)) return false;
+  if (rule.hour > 23 || rule.minute > 59) return false;
+  if (rule.action >= SCHED_ACTION_COUNT) return false;
+
+  gRules[gRuleCount++] = rule;
+  saveRules();
+  scheduleInvalidate();
+  return true;
+}
+
+bool scheduleRemoveRule(uint8_t index) {
+  if (index >= gRuleCount) return false;
+  for (uint8_t i = index; i + 1 < gRuleCount; i++) gRules[i] = gRules[i + 1];
+  gRuleCount--;
+  saveRules();
+  scheduleInvalidate();
+  return true;
+}
+
+void scheduleSetEnabled(bool enabled) {
+  gEnabled = enabled;
+  saveRules();
+  scheduleInvalidate();
+}
+
+bool scheduleIsEnabled() {
+  return gEnabled;
+}
+
+bool scheduleNext(uint32_t &epoch, SchedRule &rule) {
+  if (gDirty || !gNextValid) return false;
+  uint8_t idx = (uint8_t)(gNextKey & ((1 << SCHED_KEY_SHIFT) - 1));
+  rule  = gRules[idx];
+  epoch = (uint32_t)(gNextKey >> SCHED_KEY_SHIFT) + leadSeconds(rule.action);
+  return true;
+}
+
+const char* scheduleActionLabel(uint8_t action) {
+  switch (action) {
+    case SCHED_ECO:      return "eco";
+    case SCHED_STANDARD: return "standard";
+    case SCHED_SUPER:    return "super";
+    case SCHED_STANDBY:  return "veille";
+    case SCHED_WAKEUP:   return "reveil";
+  }
+  return "?";
+}
+
+void scheduleFactoryReset() {
+  schedPrefs.begin("sched", false);
+  schedPrefs.clear();
+  schedPrefs.end();
+
+  gRuleCount = 0;
+  gEnabled   = false;
+  gNextValid = false;
+  scheduleInvalidate();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+
+// Planning hebdomadaire : a heure fixe, change le mode du miner ou
+// le met en veille / le reveille. Regles stockees en NVS.
+
+enum SchedAction : uint8_t {
+  SCHED_ECO = 0,
+  SCHED_STANDARD,
+  SCHED_SUPER,
+  SCHED_STANDBY,    // softoff
+  SCHED_WAKEUP,     // softon
+  SCHED_ACTION_COUNT
+};
+
+struct SchedRule {
+  uint8_t days;     // bit0 = lundi ... bit6 = dimanche
+  uint8_t hour;     // heure locale 0..23
+  uint8_t minute;   // 0..59
+  uint8_t action;   // SchedAction
+};
+
+const uint8_t SCHED_MAX_RULES = 16;
+
+void scheduleInit();                 // charge les regles depuis NVS
+void scheduleLoop();                 // a appeler dans loop()
+void scheduleInvalidate();           // heure ou fuseau modifie -> recalcul
+
+uint8_t scheduleGetRules(SchedRule *out, uint8_t max);
+bool scheduleAddRule(const SchedRule &rule);
+bool scheduleRemoveRule(uint8_t index);
+
+void scheduleSetEnabled(bool enabled);
+bool scheduleIsEnabled();
+
+// Prochaine transition (epoch de l'heure prevue). false si aucune.
+bool scheduleNext(uint32_t &epoch, SchedRule &rule);
+
+const char* scheduleActionLabel(uint8_t action);
+
+void scheduleFactoryReset();
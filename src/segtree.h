@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+// Arbre de segments (min / max / somme / nombre) sur un tableau de feuilles
+// de taille quelconque, version iterative "bas en haut" : 2n noeuds,
+// feuille i en t[n + i], requete et mise a jour en O(log n).
+// Sans dependance Arduino : compile aussi sur l'hote (bench/).
+
+struct AggNode {
+  int32_t  sum;
+  int16_t  mn;
+  int16_t  mx;
+  uint16_t n;      // 0 = vide (mn / mx sans signification)
+};
+
+inline AggNode aggEmpty() {
+  AggNode a = { 0, INT16_MAX, INT16_MIN, 0 };
+  return a;
+}
+
+inline void aggAdd(AggNode &a, int16_t v) {
+  a.sum += v;
+  if (v < a.mn) a.mn = v;
+  if (v > a.mx) a.mx = v;
+  a.n++;
+}
+
+inline AggNode aggMerge(const AggNode &a, const AggNode &b) {
+  AggNode r;
+  r.sum = a.sum + b.sum;
+  r.mn  = a.mn < b.mn ? a.mn : b.mn;
+  r.mx  = a.mx > b.mx ? a.mx : b.mx;
+  r.n   = a.n + b.n;
+  return r;
+}
+
+// construit tous les noeuds internes a partir des feuilles t[n .. 2n[
+inline void segBuild(AggNode *t, uint16_t n) {
+  for (uint16_t i = n - 1; i > 0; i--) t[i] = aggMerge(t[2 * i], t[2 * i + 1]);
+}
+
+// remplace la feuille i et remonte jusqu'a la racine
+inline void segSet(AggNode *t, uint16_t n, uint16_t i, const AggNode &v) {
+  i += n;
+  t[i] = v;
+  for (i >>= 1; i > 0; i >>= 1) t[i] = aggMerge(t[2 * i], t[2 * i + 1]);
+}
+
+// agregat des feuilles [l, r[
+inline AggNode segQuery(const AggNode *t, uint16_t n, uint16_t l, uint16_t r) {
+  AggNode acc = aggEmpty();
+  for (l += n, r += n; l < r; l >>= 1, r >>= 1) {
+    if (l & 1) acc = aggMerge(acc, t[l++]);
+    if (r & 1) acc = aggMerge(acc, t[--r]);
+  }
+  return acc;
+}
@@ -0,0 +1,274 @@
+#include "stall.h"
+
+#include <Preferences.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <time.h>
+
+#include "journal.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences stallPrefs;
+
+const uint32_t STALL_MAGIC        = 0x5354414C;   // "STAL"
+const uint32_t STALL_SAVE_MIN_MS  = 600000;       // NVS : au plus toutes les 10 min
+
+// Section en cours : ecrite a chaque changement, relue au boot suivant
+struct StallRtcCurrent {
+  uint32_t magic;
+  char     section[STALL_NAME_LEN];
+};
+
+// Classement des blocages, protege par une somme de controle
+struct StallRtcTop {
+  uint32_t    magic;
+  uint32_t    sum;
+  uint32_t    total;
+  uint8_t     count;
+  StallRecord top[STALL_TOP];
+};
+
+RTC_NOINIT_ATTR static StallRtcCurrent gRtcCur;
+RTC_NOINIT_ATTR static StallRtcTop     gRtcTop;
+
+static StallConfig gCfg = { false, 30, 250 };
+
+static const char *gSection      = "setup";
+static uint32_t    gSectionStart = 0;
+static uint32_t    gLoopStart    = 0;
+static uint32_t    gWorstLoopMs  = 0;
+
+static bool     gWdtArmed   = false;
+static bool     gDirty      = false;   // classement a recopier en NVS
+static uint32_t gLastSaveMs = 0;
+
+static uint8_t  gLastResetReason = 0;
+static char     gLastResetSection[STALL_NAME_LEN] = "";
+static uint32_t gLastResetEpoch  = 0;
+static bool     gResetThisBoot   = false;   // heure du reset a dater des que possible
+
+static uint32_t topSum() {
+  // FNV-1a sur le classement
+  const uint8_t *p = (const uint8_t *)&gRtcTop.total;
+  size_t n = sizeof(gRtcTop) - offsetof(StallRtcTop, total);
+  uint32_t h = 2166136261u;
+  while (n--) h = (h ^ *p++) * 16777619u;
+  return h;
+}
+
+static void sealTop() {
+  gRtcTop.magic = STALL_MAGIC;
+  gRtcTop.sum   = topSum();
+}
+
+static uint32_t nowEpoch() {
+  time_t t = time(nullptr);
+  return t > 1600000000 ? (uint32_t)t : 0;
+}
+
+static void loadTopFromNvs() {
+  memset(&gRtcTop, 0, sizeof(gRtcTop));
+  stallPrefs.begin("stall", true);
+  gRtcTop.total = stallPrefs.getUInt("total", 0);
+  size_t got = stallPrefs.getBytes("top", gRtcTop.top, sizeof(gRtcTop.top));
+  stallPrefs.end();
+  gRtcTop.count = got / sizeof(StallRecord);
+  for (uint8_t i = 0; i < gRtcTop.count; i++) gRtcTop.top[i].section[STALL_NAME_LEN - 1] = '\0';
+  sealTop();
+}
+
+static void saveTopToNvs() {
+  stallPrefs.begin("stall", false);
+  stallPrefs.putUInt("total", gRtcTop.total);
+  stallPrefs.putBytes("top", gRtcTop.top, gRtcTop.count * sizeof(StallRecord));
+  stallPrefs.end();
+  gDirty      = false;
+  gLastSaveMs = millis();
+}
+
+static void recordStall(const char *section, uint32_t durMs) {
+  gRtcTop.total++;
+  gDirty = true;
+
+  // insertion dans le classement (du plus long au plus court)
+  uint8_t pos = gRtcTop.count;
+  while (pos > 0 && gRtcTop.top[pos - 1].durMs < durMs) pos--;
+  if (pos < STALL_TOP) {
+    uint8_t last = gRtcTop.count < STALL_TOP ? gRtcTop.count : STALL_TOP - 1;
+    for (uint8_t i = last; i > pos; i--) gRtcTop.top[i] = gRtcTop.top[i - 1];
+    StallRecord &r = gRtcTop.top[pos];
+    memset(&r, 0, sizeof(r));
+    strncpy(r.section, section, STALL_NAME_LEN - 1);
+    r.durMs   = durMs;
+    r.epoch   = nowEpoch();
+    r.uptimeS = millis() / 1000;
+    if (gRtcTop.count < STALL_TOP) gRtcTop.count++;
+  }
+  sealTop();
+
+  LOG_W("stall", "%s : %lu ms", section, (unsigned long)durMs);
+}
+
+static void applyWdt() {
+  if (gCfg.wdt) {
+    // ESP-IDF 4.x : reconfigure le TWDT deja lance par le core Arduino
+    esp_task_wdt_init(gCfg.wdtSec, true);
+    if (!gWdtArmed) esp_task_wdt_add(nullptr);   // tache loop
+    gWdtArmed = true;
+  } else if (gWdtArmed) {
+    esp_task_wdt_delete(nullptr);
+    gWdtArmed = false;
+  }
+}
+
+// =======================
+// API publique
+// =======================
+
+void stallInit() {
+  // 1) ou en etait le boot precedent ?
+  esp_reset_reason_t why = esp_reset_reason();
+  bool abnormal = why == ESP_RST_TASK_WDT || why == ESP_RST_INT_WDT ||
+                  why == ESP_RST_WDT || why == ESP_RST_PANIC;
+
+  stallPrefs.begin("stall", true);
+  gCfg.wdt          = stallPrefs.getBool("wdt", false);
+  gCfg.wdtSec       = stallPrefs.getUShort("wdtSec", 30);
+  gCfg.thresholdMs  = stallPrefs.getUShort("thresh", 250);
+  gLastResetReason  = stallPrefs.getUChar("rstWhy", 0);
+  gLastResetEpoch   = stallPrefs.getUInt("rstAt", 0);
+  stallPrefs.getString("rstSec", gLastResetSection, sizeof(gLastResetSection));
+  stallPrefs.end();
+
+  if (abnormal && gRtcCur.magic == STALL_MAGIC) {
+    gRtcCur.section[STALL_NAME_LEN - 1] = '\0';
+    gLastResetReason = (uint8_t)why;
+    gLastResetEpoch  = 0;   // l'heure n'est pas encore connue (cf. stallLoop)
+    gResetThisBoot   = true;
+    strncpy(gLastResetSection, gRtcCur.section, sizeof(gLastResetSection) - 1);
+    gLastResetSection[sizeof(gLastResetSection) - 1] = '\0';
+
+    stallPrefs.begin("stall", false);
+    stallPrefs.putUChar("rstWhy", gLastResetReason);
+    stallPrefs.putUInt("rstAt", gLastResetEpoch);
+    stallPrefs.putString("rstSec", gLastResetSection);
+    stallPrefs.end();
+
+    LOG_E("stall", "Reset %d pendant la section '%s'", (int)why, gLastResetSection);
+    journalLog(JE_WATCHDOG, JSRC_SYSTEM, (int16_t)why, gLastResetSection);
+  }
+
+  // 2) classement : RTC si intact (reset logiciel), sinon NVS
+  if (gRtcTop.magic != STALL_MAGIC || gRtcTop.sum != topSum() || gRtcTop.count > STALL_TOP) {
+    loadTopFromNvs();
+  } else {
+    gDirty = true;   // peut contenir des blocages pas encore recopies
+  }
+
+  gRtcCur.magic = STALL_MAGIC;
+  gSectionStart = millis();
+  stallSection("setup");
+}
+
+void stallLoop() {
+  uint32_t now = millis();
+
+  if (gLoopStart != 0) {
+    uint32_t turn = now - gLoopStart;
+    if (turn > gWorstLoopMs) gWorstLoopMs = turn;
+  } else {
+    applyWdt();   // premier tour : setup() termine, on peut armer
+  }
+  gLoopStart = now;
+
+  if (gWdtArmed) esp_task_wdt_reset();
+
+  if (gResetThisBoot && nowEpoch() != 0) {
+    gResetThisBoot  = false;
+    gLastResetEpoch = nowEpoch() - now / 1000;
+    stallPrefs.begin("stall", false);
+    stallPrefs.putUInt("rstAt", gLastResetEpoch);
+    stallPrefs.end();
+  }
+
+  if (gDirty && (gLastSaveMs == 0 || now - gLastSaveMs >= STALL_SAVE_MIN_MS)) saveTopToNvs();
+}
+
+const char* stallSection(const char *name) {
+  uint32_t now = millis();
+  uint32_t dur = now - gSectionStart;
+  if (dur >= gCfg.thresholdMs) recordStall(gSection, dur);
+
+  const char *prev = gSection;
+  gSection      = name;
+  gSectionStart = now;
+
+  strncpy(gRtcCur.section, name, STALL_NAME_LEN - 1);
+  gRtcCur.section[STALL_NAME_LEN - 1] = '\0';
+  return prev;
+}
+
+void stallFeed() {
+  if (gWdtArmed) esp_task_wdt_reset();
+}
+
+StallConfig stallGetConfig() {
+  return gCfg;
+}
+
+void stallSetConfig(const StallConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.wdtSec < 10)       gCfg.wdtSec = 10;
+  if (gCfg.wdtSec > 120)      gCfg.wdtSec = 120;
+  if (gCfg.thresholdMs < 50)  gCfg.thresholdMs = 50;
+
+  stallPrefs.begin("stall", false);
+  stallPrefs.putBool("wdt", gCfg.wdt);
+  stallPrefs.putUShort("wdtSec", gCfg.wdtSec);
+  stallPrefs.putUShort("thresh", gCfg.thresholdMs);
+  stallPrefs.end();
+
+  if (gLoopStart != 0) applyWdt();
+}
+
+StallStats stallGetStats() {
+  StallStats st;
+  memset(&st, 0, sizeof(st));
+  st.total       = gRtcTop.total;
+  st.worstLoopMs = gWorstLoopMs;
+  strncpy(st.current, gSection, STALL_NAME_LEN - 1);
+  st.lastResetReason = gLastResetReason;
+  memcpy(st.lastResetSection, gLastResetSection, sizeof(st.lastResetSection));
+  st.lastResetEpoch  = gLastResetEpoch;
+  st.count = gRtcTop.count;
+  memcpy(st.top, gRtcTop.top, sizeof(st.top));
+  return st;
+}
+
+void stallClear() {
+  memset(&gRtcTop, 0, sizeof(gRtcTop));
+  sealTop();
+  gWorstLoopMs     = 0;
+  gLastResetReason = 0;
+  gLastResetSection[0] = '\0';
+
+  stallPrefs.begin("stall", false);
+  stallPrefs.remove("total");
+  stallPrefs.remove("top");
+  stallPrefs.remove("rstWhy");
+  stallPrefs.remove("rstAt");
+  stallPrefs.remove("rstSec");
+  stallPrefs.end();
+  gDirty = false;
+}
+
+void stallFactoryReset() {
+  stallPrefs.begin("stall", false);
+  stallPrefs.clear();
+  stallPrefs.end();
+  memset(&gRtcTop, 0, sizeof(gRtcTop));
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+
+// Surveillance des blocages de loop() : chaque portion de loop() /
+// portalLoop() se declare par stallSection(nom). Le temps passe dans une
+// section au-dela du seuil est un "blocage", attribue a cette section.
+// Les plus longs sont gardes en RTC (survivent a un reset logiciel) et
+// recopies en NVS (survivent a une coupure).
+//
+// Optionnel : watchdog de tache sur loop(). S'il expire, la section en
+// cours est retrouvee au demarrage suivant et inscrite au journal.
+
+const uint8_t STALL_TOP      = 8;
+const uint8_t STALL_NAME_LEN = 24;
+
+struct StallRecord {
+  char     section[STALL_NAME_LEN];
+  uint32_t durMs;
+  uint32_t epoch;       // 0 = heure inconnue
+  uint32_t uptimeS;
+};
+
+struct StallConfig {
+  bool     wdt;          // reset par watchdog si loop() ne revient pas
+  uint16_t wdtSec;       // 10..120
+  uint16_t thresholdMs;  // duree mini d'un blocage
+};
+
+struct StallStats {
+  uint32_t total;                    // blocages depuis la remise a zero
+  uint32_t worstLoopMs;              // plus long tour de loop() depuis le boot
+  char     current[STALL_NAME_LEN];  // section en cours
+  // dernier reset anormal (watchdog, panique) et section fautive
+  uint8_t  lastResetReason;          // esp_reset_reason_t, 0 = aucun
+  char     lastResetSection[STALL_NAME_LEN];
+  uint32_t lastResetEpoch;
+  uint8_t  count;
+  StallRecord top[STALL_TOP];        // du plus long au plus court
+};
+
+void stallInit();       // tout debut de setup(), apres journalInit()
+void stallLoop();       // debut de loop() : nourrit le watchdog, sauvegarde NVS
+
+// Entre dans une section (nom persistant, ex. litteral) ; renvoie la
+// precedente pour pouvoir la reprendre apres un appel imbrique.
+const char* stallSection(const char *name);
+void stallFeed();       // traitement long legitime (export) : nourrit le watchdog
+
+StallConfig stallGetConfig();
+void stallSetConfig(const StallConfig &cfg);
+StallStats stallGetStats();
+void stallClear();
+void stallFactoryReset();
@@ -0,0 +1,191 @@
+#include "thermostat.h"
+
+#include <Preferences.h>
+
+#include "miner.h"
+#include "cmdqueue.h"
+#include "governor.h"
+#include "autotune.h"
+#include "logger.h"
+
+// --- mesures DHT venant de main.cpp ---
+extern float gTempC;
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences thermoPrefs;
+
+static ThermoConfig gCfg = { false, 20.0f, 0.5f, 600, 0, 3 };
+static ThermoStats  gStats = {};
+
+const uint8_t  THERMO_LEVEL_MAX  = 3;
+const uint32_t THERMO_EVAL_MS    = 5000;   // rythme du DHT
+const uint8_t  THERMO_HISTORY    = 16;     // pour le compte "par heure"
+
+static uint32_t gLastEvalMs   = 0;
+static uint32_t gDemandSince  = 0;   // millis() de la sortie de bande (0 = dans la bande)
+static uint32_t gPendingCmd   = 0;   // commande en cours, on attend son issue
+static uint32_t gSwitchTimes[THERMO_HISTORY];
+static uint8_t  gSwitchHead   = 0;
+static uint64_t gLatencySum   = 0;
+
+static uint32_t submitLevel(int8_t from, int8_t to) {
+  if (to == 0) return cmdQueueSubmit(CMD_STANDBY, "", 0, false, JSRC_THERMOSTAT);
+  if (from == 0) return cmdQueueSubmit(CMD_WAKEUP, "", 0, false, JSRC_THERMOSTAT);   // repart dans son dernier mode
+  return cmdQueueSubmit(CMD_MODE, minerLevelMode(to), 0, false, JSRC_THERMOSTAT);
+}
+
+static void recordSwitch(uint32_t now) {
+  uint32_t latency = gDemandSince ? now - gDemandSince : 0;
+
+  gStats.switches++;
+  gStats.lastLatencyMs = latency;
+  if (latency > gStats.maxLatencyMs) gStats.maxLatencyMs = latency;
+  gLatencySum += latency;
+  gStats.avgLatencyMs = (uint32_t)(gLatencySum / gStats.switches);
+  gStats.lastSwitchMs = now;
+
+  gSwitchTimes[gSwitchHead] = now;
+  gSwitchHead = (gSwitchHead + 1) % THERMO_HISTORY;
+}
+
+static uint8_t countLastHour(uint32_t now) {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < THERMO_HISTORY && i < gStats.switches; i++) {
+    if (now - gSwitchTimes[i] < 3600000UL) n++;
+  }
+  return n;
+}
+
+// =======================
+// API publique
+// =======================
+
+void thermostatInit() {
+  thermoPrefs.begin("thermo", true);
+  gCfg.enabled     = thermoPrefs.getBool("enabled", false);
+  gCfg.setpointC   = thermoPrefs.getFloat("setpoint", 20.0f);
+  gCfg.hysteresisC = thermoPrefs.getFloat("hyst", 0.5f);
+  gCfg.dwellSec    = thermoPrefs.getUShort("dwell", 600);
+  gCfg.minLevel    = thermoPrefs.getUChar("minLvl", 0);
+  gCfg.maxLevel    = thermoPrefs.getUChar("maxLvl", THERMO_LEVEL_MAX);
+  thermoPrefs.end();
+
+  gStats.level = -1;
+}
+
+void thermostatLoop() {
+  uint32_t now = millis();
+  gStats.switchesLastHour = countLastHour(now);
+
+  if (!gCfg.enabled) {
+    gStats.demand = 0;
+    gDemandSince  = 0;
+    return;
+  }
+  if (now - gLastEvalMs < THERMO_EVAL_MS) return;
+  gLastEvalMs = now;
+
+  if (isnan(gTempC)) return;
+  if (autotuneIsRunning()) return;   // l'autotune pilote le mode pendant sa mesure
+
+  // Commande precedente pas encore confirmee : on attend son verdict
+  if (gPendingCmd) {
+    CmdInfo c;
+    if (cmdQueueGet(gPendingCmd, c) && !cmdStateIsFinal(c.state)) return;
+    gPendingCmd = 0;
+  }
+
+  MinerPollState ps = minerGetPollState();
+  if (ps.lastOkMs == 0 || ps.failures > 0) return;   // etat du miner inconnu
+
+  int8_t level = minerStatusLevel(minerGetStatus());
+  gStats.level = level;
+  if (level < 0) return;
+
+  // le gouverneur de puissance peut brider le niveau maxi
+  int8_t maxLevel = gCfg.maxLevel;
+  int8_t cap = governorLevelCap();
+  if (cap < maxLevel) maxLevel = cap;
+  int8_t minLevel = gCfg.minLevel;
+  if (minLevel > maxLevel) minLevel = maxLevel;
+
+  int8_t demand = 0;
+  if (gTempC < gCfg.setpointC - gCfg.hysteresisC && level < maxLevel) demand = +1;
+  if (gTempC > gCfg.setpointC + gCfg.hysteresisC && level > minLevel) demand = -1;
+
+  // hors bornes configurees : on ramene le niveau dedans
+  if (level > maxLevel) demand = -1;
+  if (level < minLevel) demand = +1;
+
+  gStats.demand = demand;
+  if (demand == 0) {
+    gDemandSince = 0;
+    return;
+  }
+  if (gDemandSince == 0) gDemandSince = now;
+
+  // anti-pompage : duree mini entre deux changements
+  if (gStats.lastSwitchMs != 0 &&
+      now - gStats.lastSwitchMs < (uint32_t)gCfg.dwellSec * 1000UL) {
+    return;
+  }
+
+  int8_t target = level + demand;
+  uint32_t id = submitLevel(level, target);
+  if (id == 0) return;   // file pleine, on reessaiera
+
+  LOG_I("thermo", "%.1f C (consigne %.1f) : %s -> %s, commande #%u",
+                gTempC, gCfg.setpointC,
+                thermostatLevelLabel(level), thermostatLevelLabel(target), (unsigned)id);
+
+  recordSwitch(now);
+  gPendingCmd  = id;
+  gDemandSince = 0;
+}
+
+ThermoConfig thermostatGetConfig() {
+  return gCfg;
+}
+
+void thermostatSetConfig(const ThermoConfig &cfg) {
+  gCfg = cfg;
+  if (gCfg.hysteresisC < 0.1f) gCfg.hysteresisC = 0.1f;
+  if (gCfg.maxLevel > THERMO_LEVEL_MAX) gCfg.maxLevel = THERMO_LEVEL_MAX;
+  if (gCfg.minLevel > gCfg.maxLevel) gCfg.minLevel = gCfg.maxLevel;
+
+  thermoPrefs.begin("thermo", false);
+  thermoPrefs.putBool("enabled", gCfg.enabled);
+  thermoPrefs.putFloat("setpoint", gCfg.setpointC);
+  thermoPrefs.putFloat("hyst", gCfg.hysteresisC);
+  thermoPrefs.putUShort("dwell", gCfg.dwellSec);
+  thermoPrefs.putUChar("minLvl", gCfg.minLevel);
+  thermoPrefs.putUChar("maxLvl", gCfg.maxLevel);
+  thermoPrefs.end();
+
+  gDemandSince = 0;
+  gLastEvalMs  = 0;
+}
+
+ThermoStats thermostatGetStats() {
+  return gStats;
+}
+
+const char* thermostatLevelLabel(int8_t level) {
+  switch (level) {
+    case 0: return "veille";
+    case 1: return "eco";
+    case 2: return "standard";
+    case 3: return "super";
+  }
+  return "inconnu";
+}
+
+void thermostatFactoryReset() {
+  thermoPrefs.begin("thermo", false);
+  thermoPrefs.clear();
+  thermoPrefs.end();
+  thermostatInit();
+}
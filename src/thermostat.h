@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+// Thermostat d'ambiance : le miner sert de chauffage.
+// Compare gTempC (DHT) a la consigne et monte / descend d'un cran a la fois
+// dans l'echelle veille < eco < standard < super, avec hysteresis et
+// duree minimale entre deux changements.
+
+struct ThermoConfig {
+  bool    enabled;
+  float   setpointC;     // consigne
+  float   hysteresisC;   // demi-bande morte autour de la consigne
+  uint16_t dwellSec;     // duree mini entre deux changements
+  uint8_t minLevel;      // 0 = veille autorisee, 1 = jamais en dessous d'eco
+  uint8_t maxLevel;      // 3 = super
+};
+
+struct ThermoStats {
+  uint32_t switches;         // changements envoyes depuis le boot
+  uint8_t  switchesLastHour;
+  uint32_t lastLatencyMs;    // sortie de bande -> commande envoyee
+  uint32_t avgLatencyMs;
+  uint32_t maxLatencyMs;
+  int8_t   level;            // niveau courant vu par le thermostat (-1 = inconnu)
+  int8_t   demand;           // -1 = veut descendre, +1 = veut monter, 0 = dans la bande
+  uint32_t lastSwitchMs;     // 0 = jamais
+};
+
+void thermostatInit();
+void thermostatLoop();        // a appeler dans loop()
+
+ThermoConfig thermostatGetConfig();
+void thermostatSetConfig(const ThermoConfig &cfg);
+ThermoStats thermostatGetStats();
+
+const char* thermostatLevelLabel(int8_t level);
+
+void thermostatFactoryReset();
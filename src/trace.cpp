@@ -0,0 +1,110 @@
+#include "trace.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// =======================
+// Etat interne
+// =======================
+
+struct TraceSlot {
+  uint32_t    seq;       // index d'ecriture + 1 une fois publie, 0 = en cours
+  uint32_t    startUs;
+  uint32_t    durUs;
+  const char *name;
+  uint8_t     cat;
+  uint8_t     task;
+};
+
+struct TraceRing {
+  uint32_t  head;        // prochain index a reserver (croissant)
+  uint32_t  base;        // index a partir duquel lire (clear)
+  TraceSlot slots[TRACE_RING_SIZE];
+};
+
+static TraceRing gRings[2];
+
+static TaskHandle_t gTasks[TRACE_MAX_TASKS];
+static char         gTaskNames[TRACE_MAX_TASKS][16];
+
+// index de la tache courante, enregistree au premier evenement
+static uint8_t taskIndex() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (uint8_t i = 0; i < TRACE_MAX_TASKS; i++) {
+    TaskHandle_t h = __atomic_load_n(&gTasks[i], __ATOMIC_ACQUIRE);
+    if (h == self) return i;
+    if (h == nullptr) {
+      TaskHandle_t expected = nullptr;
+      if (__atomic_compare_exchange_n(&gTasks[i], &expected, self, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        strncpy(gTaskNames[i], pcTaskGetTaskName(self), sizeof(gTaskNames[i]) - 1);
+        return i;
+      }
+      if (expected == self) return i;   // une autre ecriture de la meme tache
+    }
+  }
+  return TRACE_MAX_TASKS - 1;   // table pleine : regroupees sur la derniere
+}
+
+// =======================
+// API publique
+// =======================
+
+void traceComplete(const char *name, uint8_t cat, uint32_t startUs, uint32_t durUs) {
+  TraceRing &r = gRings[xPortGetCoreID() & 1];
+  uint32_t i = __atomic_fetch_add(&r.head, 1, __ATOMIC_RELAXED);
+  TraceSlot &s = r.slots[i % TRACE_RING_SIZE];
+
+  __atomic_store_n(&s.seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  s.startUs = startUs;
+  s.durUs   = durUs;
+  s.name    = name;
+  s.cat     = cat;
+  s.task    = taskIndex();
+  __atomic_store_n(&s.seq, i + 1, __ATOMIC_RELEASE);
+}
+
+void traceForEach(TraceSink sink, void *ctx) {
+  for (uint8_t core = 0; core < 2; core++) {
+    TraceRing &r = gRings[core];
+    uint32_t head  = __atomic_load_n(&r.head, __ATOMIC_ACQUIRE);
+    uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    if (first < r.base) first = r.base;
+
+    for (uint32_t i = first; i < head; i++) {
+      const TraceSlot &s = r.slots[i % TRACE_RING_SIZE];
+      if (__atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) != i + 1) continue;
+      TraceEvent ev;
+      ev.name    = s.name;
+      ev.cat     = s.cat;
+      ev.core    = core;
+      ev.task    = s.task;
+      ev.startUs = s.startUs;
+      ev.durUs   = s.durUs;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      // ecrase pendant la copie : on l'ignore
+      if (__atomic_load_n(&s.seq, __ATOMIC_RELAXED) != i + 1) continue;
+      if (!sink(ctx, ev)) return;
+    }
+  }
+}
+
+const char* traceTaskName(uint8_t task) {
+  return task < TRACE_MAX_TASKS ? gTaskNames[task] : "";
+}
+
+uint32_t traceDropped() {
+  uint32_t dropped = 0;
+  for (uint8_t core = 0; core < 2; core++) {
+    uint32_t n = gRings[core].head - gRings[core].base;
+    if (n > TRACE_RING_SIZE) dropped += n - TRACE_RING_SIZE;
+  }
+  return dropped;
+}
+
+void traceClear() {
+  for (uint8_t core = 0; core < 2; core++) {
+    gRings[core].base = __atomic_load_n(&gRings[core].head, __ATOMIC_ACQUIRE);
+  }
+}
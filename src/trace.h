@@ -0,0 +1,47 @@
+#pragma once
+#include <Arduino.h>
+
+// Traces de spans pour chrome://tracing / Perfetto : chaque span termine
+// est ecrit (debut + duree, coeur, tache) dans l'anneau du coeur courant.
+// Ecriture sans verrou : un index atomique reserve l'emplacement, un
+// numero de sequence publie l'entree ; le lecteur ignore ce qui est en
+// cours d'ecriture ou deja ecrase. Export JSON "trace_event" sur /debug/trace.
+//
+//   TRACE_SCOPE("pools");                      // jusqu'a la fin du bloc
+//   TRACE_BEGIN(t); ...; TRACE_END(t, "x");    // portion de fonction
+//
+// Les noms doivent rester valides (litteraux, noms de sondes perf).
+
+const uint16_t TRACE_RING_SIZE = 192;   // evenements par coeur
+const uint8_t  TRACE_MAX_TASKS = 8;
+const uint8_t  TRACE_CAT_SPAN  = 0xFF;  // categorie hors sondes perf
+
+void traceComplete(const char *name, uint8_t cat, uint32_t startUs, uint32_t durUs);
+
+struct TraceSpan {
+  const char *name;
+  uint32_t    t0;
+  explicit TraceSpan(const char *n) : name(n), t0(micros()) {}
+  ~TraceSpan() { traceComplete(name, TRACE_CAT_SPAN, t0, micros() - t0); }
+};
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b)  TRACE_CAT2(a, b)
+#define TRACE_SCOPE(name)    TraceSpan TRACE_CAT(traceSpan_, __LINE__)(name)
+#define TRACE_BEGIN(var)     uint32_t var = micros()
+#define TRACE_END(var, name) traceComplete((name), TRACE_CAT_SPAN, (var), micros() - (var))
+
+// Lecture pour l'export : parcourt les evenements encore presents.
+struct TraceEvent {
+  const char *name;
+  uint8_t     cat;
+  uint8_t     core;
+  uint8_t     task;      // index dans la table des taches
+  uint32_t    startUs;
+  uint32_t    durUs;
+};
+typedef bool (*TraceSink)(void *ctx, const TraceEvent &ev);
+void traceForEach(TraceSink sink, void *ctx);
+const char* traceTaskName(uint8_t task);   // "" si inconnue
+uint32_t traceDropped();                   // evenements ecrases depuis le dernier clear
+void traceClear();
@@ -1 +1 @@
-#define FW_VERSION "0.2"
\ No newline at end of file
+#define FW_VERSION "0.2.0"
\ No newline at end of file
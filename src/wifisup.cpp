@@ -0,0 +1,462 @@
+#include "wifisup.h"
+
+#include <WiFi.h>
+#include <Preferences.h>
+
+#include "miner.h"
+#include "journal.h"
+#include "perf.h"
+#include "logger.h"
+
+// =======================
+// Etat interne
+// =======================
+
+static Preferences wifiPrefs;
+
+const uint32_t WIFI_BACKOFF_MIN_MS = 1000;
+const uint32_t WIFI_BACKOFF_MAX_MS = 60000;
+const uint32_t WIFI_ATTEMPT_MS     = 10000;    // une tentative de connexion
+const uint32_t WIFI_SCAN_MAX_MS    = 8000;     // scan asynchrone sans reponse
+const uint32_t WIFI_ROAM_CHECK_MS  = 300000;   // lien faible : un scan toutes les 5 min
+const int32_t  WIFI_ROAM_RSSI      = -75;      // dBm, en dessous on cherche mieux
+const int32_t  WIFI_ROAM_HYST_DB   = 10;       // gain minimal pour basculer
+
+static WifiSupState gState = WSUP_OFF;
+static WifiSupStats gStats = {};
+static int8_t   gSlot       = -1;
+static uint32_t gAttemptMs  = 0;
+static uint32_t gScanMs     = 0;
+static uint32_t gLastRoamMs = 0;
+static int8_t   gProbe      = -1;
+
+// ecrits par la tache d'evenements du driver, lus par loop()
+static volatile uint32_t gEvtDown   = 0;
+static volatile uint32_t gEvtUp     = 0;
+static volatile uint8_t  gEvtReason = 0;
+static uint32_t gSeenDown = 0;
+static uint32_t gSeenUp   = 0;
+
+// le reseau 0 garde les cles historiques "ssid" / "pass"
+static void netKeys(uint8_t i, char *ssidKey, char *passKey) {
+  if (i == 0) {
+    strcpy(ssidKey, "ssid");
+    strcpy(passKey, "pass");
+  } else {
+    sprintf(ssidKey, "ssid%u", (unsigned)i);
+    sprintf(passKey, "pass%u", (unsigned)i);
+  }
+}
+
+static uint8_t loadNetworks(String *ssids, String *passes) {
+  uint8_t n = 0;
+  wifiPrefs.begin("wifi", true);
+  for (uint8_t i = 0; i < WIFI_MAX_NETWORKS; i++) {
+    char sk[8], pk[8];
+    netKeys(i, sk, pk);
+    String s = wifiPrefs.getString(sk, "");
+    if (s.length() == 0) break;
+    ssids[n]  = s;
+    passes[n] = wifiPrefs.getString(pk, "");
+    n++;
+  }
+  wifiPrefs.end();
+  return n;
+}
+
+static void storeNetworks(const String *ssids, const String *passes, uint8_t n) {
+  wifiPrefs.begin("wifi", false);
+  for (uint8_t i = 0; i < WIFI_MAX_NETWORKS; i++) {
+    char sk[8], pk[8];
+    netKeys(i, sk, pk);
+    if (i < n) {
+      wifiPrefs.putString(sk, ssids[i]);
+      wifiPrefs.putString(pk, passes[i]);
+    } else {
+      wifiPrefs.remove(sk);
+      wifiPrefs.remove(pk);
+    }
+  }
+  wifiPrefs.end();
+  wifiCacheClear();   // les index ont pu bouger
+}
+
+// =======================
+// Reseaux enregistres
+// =======================
+
+uint8_t wifiNetCount() {
+  String ssids[WIFI_MAX_NETWORKS], passes[WIFI_MAX_NETWORKS];
+  return loadNetworks(ssids, passes);
+}
+
+bool wifiNetGet(uint8_t i, String &ssid, String &pass) {
+  if (i >= WIFI_MAX_NETWORKS) return false;
+  char sk[8], pk[8];
+  netKeys(i, sk, pk);
+  wifiPrefs.begin("wifi", true);
+  ssid = wifiPrefs.getString(sk, "");
+  pass = wifiPrefs.getString(pk, "");
+  wifiPrefs.end();
+  return ssid.length() > 0;
+}
+
+void wifiNetSave(const String &ssid, const String &pass) {
+  String ssids[WIFI_MAX_NETWORKS + 1], passes[WIFI_MAX_NETWORKS + 1];
+  uint8_t n = loadNetworks(ssids + 1, passes + 1);
+  ssids[0]  = ssid;
+  passes[0] = pass;
+
+  // le nouveau en tete, l'ancienne entree du meme SSID disparait
+  uint8_t out = 1;
+  for (uint8_t i = 1; i <= n; i++) {
+    if (ssids[i] == ssid) continue;
+    ssids[out]  = ssids[i];
+    passes[out] = passes[i];
+    out++;
+  }
+  if (out > WIFI_MAX_NETWORKS) out = WIFI_MAX_NETWORKS;
+  storeNetworks(ssids, passes, out);
+}
+
+void wifiNetForget(uint8_t i) {
+  String ssids[WIFI_MAX_NETWORKS], passes[WIFI_MAX_NETWORKS];
+  uint8_t n = loadNetworks(ssids, passes);
+  if (i >= n) return;
+  for (uint8_t j = i; j + 1 < n; j++) {
+    ssids[j]  = ssids[j + 1];
+    passes[j] = passes[j + 1];
+  }
+  storeNetworks(ssids, passes, n - 1);
+  if (gSlot == (int8_t)i) gSlot = -1;
+  else if (gSlot > (int8_t)i) gSlot--;
+}
+
+// =======================
+// Cache de reconnexion rapide
+// =======================
+
+bool wifiCacheGet(uint8_t &slot, uint8_t bssid[6], uint8_t &chan) {
+  wifiPrefs.begin("wifi", true);
+  bool ok = wifiPrefs.getBytes("bssid", bssid, 6) == 6;
+  chan = wifiPrefs.getUChar("chan", 0);
+  slot = wifiPrefs.getUChar("slot", 0);
+  wifiPrefs.end();
+  return ok && chan >= 1 && chan <= 14 && slot < WIFI_MAX_NETWORKS;
+}
+
+void wifiCacheSave(uint8_t slot) {
+  uint8_t bssid[6];
+  memcpy(bssid, WiFi.BSSID(), sizeof(bssid));
+  uint8_t chan = WiFi.channel();
+
+  uint8_t oldSlot, oldBssid[6], oldChan;
+  bool same = wifiCacheGet(oldSlot, oldBssid, oldChan) && oldSlot == slot && oldChan == chan &&
+              memcmp(oldBssid, bssid, sizeof(bssid)) == 0;
+  if (same) return;   // evite une ecriture flash a chaque reconnexion
+
+  wifiPrefs.begin("wifi", false);
+  wifiPrefs.putBytes("bssid", bssid, sizeof(bssid));
+  wifiPrefs.putUChar("chan", chan);
+  wifiPrefs.putUChar("slot", slot);
+  wifiPrefs.end();
+}
+
+void wifiCacheClear() {
+  wifiPrefs.begin("wifi", false);
+  wifiPrefs.remove("bssid");
+  wifiPrefs.remove("chan");
+  wifiPrefs.remove("slot");
+  wifiPrefs.end();
+}
+
+// =======================
+// IP fixe
+// =======================
+
+void wifiIpSet(const String &ssid, IPAddress ip, IPAddress gw, IPAddress mask, IPAddress dns) {
+  wifiPrefs.begin("wifi", false);
+  if ((uint32_t)ip != 0) {
+    wifiPrefs.putUInt("ip", (uint32_t)ip);
+    wifiPrefs.putUInt("gw", (uint32_t)gw);
+    wifiPrefs.putUInt("mask", (uint32_t)mask);
+    wifiPrefs.putUInt("dns", (uint32_t)dns);
+    wifiPrefs.putString("ipssid", ssid);
+  } else {
+    wifiPrefs.remove("ip");
+    wifiPrefs.remove("ipssid");
+  }
+  wifiPrefs.end();
+}
+
+void wifiIpApply(const String &ssid) {
+  wifiPrefs.begin("wifi", true);
+  uint32_t ip = wifiPrefs.getUInt("ip", 0);
+  IPAddress gw(wifiPrefs.getUInt("gw", 0)), mask(wifiPrefs.getUInt("mask", 0)), dns(wifiPrefs.getUInt("dns", 0));
+  String owner = wifiPrefs.getString("ipssid", "");
+  if (owner.length() == 0) owner = wifiPrefs.getString("ssid", "");   // reglage saisi avant "ipssid"
+  wifiPrefs.end();
+
+  // la config reste appliquee a l'interface : on la remet a chaque connexion
+  if (ip != 0 && ssid == owner) WiFi.config(IPAddress(ip), gw, mask, dns);   // pas d'attente DHCP
+  else WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));   // DHCP
+}
+
+int8_t wifiNetPickFromScan(int16_t found, int8_t skipSlot, uint8_t bssid[6], uint8_t &chan, int32_t &rssi) {
+  String ssids[WIFI_MAX_NETWORKS], passes[WIFI_MAX_NETWORKS];
+  uint8_t n = loadNetworks(ssids, passes);
+
+  int8_t best = -1;
+  for (int16_t i = 0; i < found; i++) {
+    String s = WiFi.SSID(i);
+    for (uint8_t slot = 0; slot < n; slot++) {
+      if ((int8_t)slot == skipSlot || s != ssids[slot]) continue;
+      if (best >= 0 && WiFi.RSSI(i) <= rssi) break;
+      best = slot;
+      rssi = WiFi.RSSI(i);
+      chan = WiFi.channel(i);
+      memcpy(bssid, WiFi.BSSID(i), 6);
+      break;
+    }
+  }
+  return best;
+}
+
+// =======================
+// Supervision
+// =======================
+
+static void onWifiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    gEvtReason = info.wifi_sta_disconnected.reason;
+    gEvtDown   = gEvtDown + 1;
+  } else if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    gEvtUp = gEvtUp + 1;
+  }
+}
+
+static String slotSsid(int8_t slot) {
+  String ssid, pass;
+  if (slot >= 0) wifiNetGet(slot, ssid, pass);
+  return ssid;
+}
+
+static void startConnect(int8_t slot, const uint8_t *bssid, uint8_t chan) {
+  String ssid, pass;
+  if (slot < 0 || !wifiNetGet(slot, ssid, pass)) {
+    slot = 0;
+    wifiNetGet(0, ssid, pass);
+    bssid = nullptr;
+  }
+  gSlot      = slot;
+  gAttemptMs = millis();
+  gState     = WSUP_CONNECTING;
+
+  LOG_I("wifi", "Tentative %u sur %s%s", (unsigned)gStats.attempts + 1, ssid.c_str(),
+        bssid ? " (point d'acces choisi par scan)" : "");
+  wifiIpApply(ssid);
+  if (bssid) WiFi.begin(ssid.c_str(), pass.c_str(), chan, bssid);
+  else       WiFi.begin(ssid.c_str(), pass.c_str());
+}
+
+static void attemptFailed(uint32_t now) {
+  gStats.failedAttempts++;
+  if (gStats.attempts < 0xFF) gStats.attempts++;
+  WiFi.disconnect();
+
+  uint8_t shift = gStats.attempts < 7 ? gStats.attempts : 7;
+  uint32_t backoff = WIFI_BACKOFF_MIN_MS << shift;
+  if (backoff > WIFI_BACKOFF_MAX_MS) backoff = WIFI_BACKOFF_MAX_MS;
+  gStats.nextTryMs = now + backoff;
+  gState = WSUP_WAIT;
+  LOG_W("wifi", "Tentative %u echouee, nouvel essai dans %lu s", (unsigned)gStats.attempts,
+        (unsigned long)(backoff / 1000));
+}
+
+static void linkDown(uint32_t now, uint8_t reason) {
+  gStats.disconnects++;
+  gStats.lastReason = reason;
+  gStats.attempts   = 0;
+  if (gStats.downSinceMs == 0) gStats.downSinceMs = now ? now : 1;
+
+  String ssid = slotSsid(gSlot);
+  LOG_W("wifi", "Lien perdu (%s, raison %u)", ssid.c_str(), (unsigned)reason);
+  journalLog(JE_WIFI_DOWN, JSRC_SYSTEM, reason, ssid.c_str());
+  minerPollPause(true);
+
+  WiFi.disconnect();   // le driver ne relance plus rien : c'est nous qui decidons
+  gStats.nextTryMs = now + WIFI_BACKOFF_MIN_MS;
+  gState = WSUP_WAIT;
+}
+
+static void linkUp(uint32_t now) {
+  String ssid = slotSsid(gSlot);
+  if (gStats.downSinceMs != 0) {
+    uint32_t dur = now - gStats.downSinceMs;
+    gStats.reconnects++;
+    gStats.lastReconnectMs = dur;
+    gStats.totalDownMs    += dur;
+    if (dur > gStats.maxReconnectMs) gStats.maxReconnectMs = dur;
+    perfRecord(gProbe, dur < 4000000UL ? dur * 1000 : 0xFFFFFFFFUL);
+
+    LOG_I("wifi", "Lien retabli sur %s en %lu ms (%u tentative(s)), IP %s", ssid.c_str(),
+          (unsigned long)dur, (unsigned)gStats.attempts + 1, WiFi.localIP().toString().c_str());
+    uint32_t s = dur / 1000;
+    journalLog(JE_WIFI_UP, JSRC_SYSTEM, (int16_t)(s > 32767 ? 32767 : s), ssid.c_str());
+  }
+  gStats.downSinceMs = 0;
+  gStats.attempts    = 0;
+  gState      = WSUP_UP;
+  gLastRoamMs = now;
+  if (gSlot >= 0) wifiCacheSave(gSlot);
+  minerPollPause(false);
+}
+
+void wifiSupStart(uint8_t slot) {
+  if (gState != WSUP_OFF) return;
+  gProbe = perfProbe(PERF_NET, "wifi reconnect");
+  gSlot  = slot;
+
+  WiFi.setAutoReconnect(false);   // reconnexion geree ici (backoff, choix du reseau)
+  WiFi.onEvent(onWifiEvent, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  WiFi.onEvent(onWifiEvent, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  gSeenDown = gEvtDown;
+  gSeenUp   = gEvtUp;
+
+  gState      = WiFi.isConnected() ? WSUP_UP : WSUP_WAIT;
+  gLastRoamMs = millis();
+  if (gState == WSUP_WAIT) {
+    gStats.downSinceMs = millis();
+    gStats.nextTryMs   = millis();
+    minerPollPause(true);
+  }
+}
+
+void wifiSupLoop() {
+  if (gState == WSUP_OFF) return;
+  uint32_t now = millis();
+
+  uint32_t downs = gEvtDown, ups = gEvtUp;
+  bool gotDown = downs != gSeenDown;
+  bool gotUp   = ups != gSeenUp;
+  gSeenDown = downs;
+  gSeenUp   = ups;
+
+  bool linked = gState == WSUP_UP || gState == WSUP_ROAM_SCAN;
+  if (linked && (gotDown || !WiFi.isConnected())) {   // evenement manque : on regarde aussi le statut
+    if (gState == WSUP_ROAM_SCAN) WiFi.scanDelete();
+    linkDown(now, gotDown ? gEvtReason : 0);
+    return;
+  }
+  if (!linked && gotUp && WiFi.isConnected()) {
+    linkUp(now);
+    return;
+  }
+
+  switch (gState) {
+    case WSUP_UP:
+      // lien faible : un meilleur point d'acces (meme SSID ou autre reseau) ?
+      if (now - gLastRoamMs >= WIFI_ROAM_CHECK_MS) {
+        gLastRoamMs = now;
+        if (WiFi.RSSI() < WIFI_ROAM_RSSI && WiFi.scanNetworks(true) != WIFI_SCAN_FAILED) {
+          gScanMs = now;
+          gState  = WSUP_ROAM_SCAN;
+        }
+      }
+      break;
+
+    case WSUP_WAIT:
+      if ((int32_t)(now - gStats.nextTryMs) < 0) break;
+      if (wifiNetCount() > 1 && WiFi.scanNetworks(true) != WIFI_SCAN_FAILED) {
+        gScanMs = now;
+        gState  = WSUP_SCAN;
+      } else {
+        startConnect(gSlot, nullptr, 0);
+      }
+      break;
+
+    case WSUP_SCAN: {
+      int16_t n = WiFi.scanComplete();
+      if (n == WIFI_SCAN_RUNNING && now - gScanMs < WIFI_SCAN_MAX_MS) break;
+      if (n < 0) {
+        WiFi.scanDelete();
+        startConnect(gSlot, nullptr, 0);   // scan rate : on tente le reseau courant
+        break;
+      }
+      // une tentative sur deux evite le reseau qui vient d'echouer (mauvais
+      // mot de passe, point d'acces qui refuse) meme s'il est le plus fort
+      uint8_t bssid[6], chan = 0;
+      int32_t rssi = 0;
+      int8_t skip = (gStats.attempts & 1) ? gSlot : -1;
+      int8_t slot = wifiNetPickFromScan(n, skip, bssid, chan, rssi);
+      if (slot < 0 && skip >= 0) slot = wifiNetPickFromScan(n, -1, bssid, chan, rssi);
+      WiFi.scanDelete();
+      if (slot < 0) {
+        LOG_W("wifi", "Aucun reseau enregistre visible");
+        attemptFailed(now);
+      } else {
+        startConnect(slot, bssid, chan);
+      }
+      break;
+    }
+
+    case WSUP_CONNECTING: {
+      wl_status_t st = WiFi.status();
+      if (st == WL_CONNECTED) {
+        linkUp(now);   // IP obtenue avant que l'evenement soit vu
+      } else if (now - gAttemptMs >= WIFI_ATTEMPT_MS || st == WL_CONNECT_FAILED || st == WL_NO_SSID_AVAIL) {
+        attemptFailed(now);
+      }
+      break;
+    }
+
+    case WSUP_ROAM_SCAN: {
+      int16_t n = WiFi.scanComplete();
+      if (n == WIFI_SCAN_RUNNING && now - gScanMs < WIFI_SCAN_MAX_MS) break;
+      uint8_t bssid[6], chan = 0;
+      int32_t rssi = 0;
+      int8_t slot = n > 0 ? wifiNetPickFromScan(n, -1, bssid, chan, rssi) : -1;
+      WiFi.scanDelete();
+      gState = WSUP_UP;
+
+      int32_t cur = WiFi.RSSI();
+      if (slot < 0 || memcmp(bssid, WiFi.BSSID(), sizeof(bssid)) == 0 || rssi < cur + WIFI_ROAM_HYST_DB) break;
+
+      LOG_I("wifi", "Bascule vers %s canal %u (%ld dBm au lieu de %ld)", slotSsid(slot).c_str(),
+            (unsigned)chan, (long)rssi, (long)cur);
+      gStats.roams++;
+      gStats.attempts    = 0;
+      gStats.downSinceMs = now ? now : 1;   // la bascule compte comme une coupure
+      minerPollPause(true);
+      WiFi.disconnect();
+      startConnect(slot, bssid, chan);
+      break;
+    }
+
+    case WSUP_OFF:
+      break;
+  }
+}
+
+bool wifiSupLinkUp() {
+  return gState == WSUP_OFF ? WiFi.isConnected() : (gState == WSUP_UP || gState == WSUP_ROAM_SCAN);
+}
+
+WifiSupStats wifiSupGetStats() {
+  WifiSupStats s = gStats;
+  s.state = gState;
+  s.slot  = gSlot;
+  return s;
+}
+
+const char* wifiSupStateLabel(uint8_t state) {
+  switch (state) {
+    case WSUP_OFF:        return "arrete";
+    case WSUP_UP:         return "connecte";
+    case WSUP_WAIT:       return "attente";
+    case WSUP_SCAN:       return "scan";
+    case WSUP_CONNECTING: return "connexion";
+    case WSUP_ROAM_SCAN:  return "recherche AP";
+  }
+  return "?";
+}
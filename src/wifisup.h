@@ -0,0 +1,63 @@
+#pragma once
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Supervision du lien WiFi apres la connexion du boot : les evenements du
+// driver (deconnexion, IP obtenue) pilotent une reconnexion avec backoff
+// exponentiel. Jusqu'a WIFI_MAX_NETWORKS reseaux enregistres ; a chaque
+// tentative on prend le plus fort visible (scan asynchrone). Lien faible :
+// scan periodique et bascule sur un point d'acces nettement meilleur.
+// Les interrogations du miner sont suspendues pendant la coupure.
+
+const uint8_t WIFI_MAX_NETWORKS = 4;
+
+enum WifiSupState : uint8_t {
+  WSUP_OFF = 0,      // pas demarre (mode AP)
+  WSUP_UP,
+  WSUP_WAIT,         // backoff avant la prochaine tentative
+  WSUP_SCAN,         // scan pour choisir le reseau
+  WSUP_CONNECTING,
+  WSUP_ROAM_SCAN     // lien faible : recherche d'un meilleur point d'acces
+};
+
+struct WifiSupStats {
+  WifiSupState state;
+  int8_t   slot;               // reseau courant (-1 = aucun)
+  uint8_t  attempts;           // tentatives depuis la coupure
+  uint8_t  lastReason;         // wifi_err_reason_t de la derniere deconnexion
+  uint32_t disconnects;
+  uint32_t reconnects;
+  uint32_t failedAttempts;
+  uint32_t roams;
+  uint32_t lastReconnectMs;    // duree de la derniere coupure
+  uint32_t maxReconnectMs;
+  uint32_t totalDownMs;
+  uint32_t downSinceMs;        // 0 = lien etabli
+  uint32_t nextTryMs;
+};
+
+// Reseaux enregistres (NVS "wifi" ; le 0 est celui du dernier formulaire)
+uint8_t wifiNetCount();
+bool wifiNetGet(uint8_t i, String &ssid, String &pass);
+void wifiNetSave(const String &ssid, const String &pass);   // en tete, sans doublon
+void wifiNetForget(uint8_t i);
+
+// Cache de reconnexion rapide : reseau, BSSID et canal du dernier lien
+bool wifiCacheGet(uint8_t &slot, uint8_t bssid[6], uint8_t &chan);
+void wifiCacheSave(uint8_t slot);
+void wifiCacheClear();
+
+// IP fixe, rattachee au SSID pour lequel elle a ete saisie : tout autre
+// reseau repasse en DHCP (l'adresse ne vaudrait rien sur un autre sous-reseau).
+// ip = 0 : DHCP partout.
+void wifiIpSet(const String &ssid, IPAddress ip, IPAddress gw, IPAddress mask, IPAddress dns);
+void wifiIpApply(const String &ssid);   // avant chaque WiFi.begin()
+
+// Meilleur reseau enregistre dans les resultats du dernier scan, -1 si aucun
+int8_t wifiNetPickFromScan(int16_t found, int8_t skipSlot, uint8_t bssid[6], uint8_t &chan, int32_t &rssi);
+
+void wifiSupStart(uint8_t slot);   // lien du boot etabli sur ce reseau
+void wifiSupLoop();                // a appeler dans loop()
+bool wifiSupLinkUp();
+WifiSupStats wifiSupGetStats();
+const char* wifiSupStateLabel(uint8_t state);